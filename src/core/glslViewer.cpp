@@ -3,13 +3,16 @@
 #include <sys/stat.h>   // stat
 #include <algorithm>    // std::find
 #include <fstream>
+#include <cstring>      // memcpy
 #include <math.h>
 #include <memory>
 
 #include "tools/job.h"
+#include "tools/blendState.h"
 #include "tools/text.h"
 #include "tools/record.h"
 #include "tools/console.h"
+#include "tools/tiledImage.h"
 
 #include "vera/window.h"
 #include "vera/ops/fs.h"
@@ -49,9 +52,65 @@ static std::string geomPrefix(const std::string& _path) {
     return vera::toLower( vera::toUnderscore( vera::purifyString(base) ) );
 }
 
+// Converts the record FBO into planar YUV 4:2:0 (yuv420p) or semi-planar (nv12) bytes, BT.601 limited range.
+// Each output RGBA texel packs 4 consecutive bytes of the frame, so the target is (w/4) x (h*3/2).
+// Rows stay bottom-up like glReadPixels, the vflip filter in ffmpeg takes care of them
+const std::string record_yuv_frag = R"(
+#ifdef GL_ES
+precision highp float;
+#endif
+
+uniform sampler2D   u_tex0;
+uniform vec2        u_resolution;
+uniform float       u_nv12;
+
+vec3 pixel(vec2 p) { return clamp(texture2D(u_tex0, (p + 0.5) / u_resolution).rgb, 0.0, 1.0); }
+
+// chroma is sampled from the average of the 2x2 block it covers
+vec3 block(vec2 c) {
+    vec2 p = c * 2.0;
+    return (pixel(p) + pixel(p + vec2(1.0, 0.0)) + pixel(p + vec2(0.0, 1.0)) + pixel(p + vec2(1.0))) * 0.25;
+}
+
+float luma(vec3 c) { return (16.0 + dot(c, vec3(65.481, 128.553, 24.966))) / 255.0; }
+float cb(vec3 c) { return (128.0 + dot(c, vec3(-37.797, -74.203, 112.0))) / 255.0; }
+float cr(vec3 c) { return (128.0 + dot(c, vec3(112.0, -93.786, -18.214))) / 255.0; }
+
+float frameByte(vec2 texel, float k) {
+    float w = u_resolution.x;
+    float h = u_resolution.y;
+
+    // Y plane: one row of bytes per row of pixels
+    if (texel.y < h)
+        return luma(pixel(vec2(texel.x * 4.0 + k, texel.y)));
+
+    // chroma planes: index of the byte after the Y plane
+    float j = (texel.y - h) * w + texel.x * 4.0 + k;
+    float cw = w * 0.5;
+
+    if (u_nv12 > 0.5) {
+        float i = floor(j * 0.5);
+        vec3 c = block(vec2(mod(i, cw), floor(i / cw)));
+        return (mod(j, 2.0) < 0.5)? cb(c) : cr(c);
+    }
+
+    float plane = cw * h * 0.5;
+    if (j < plane)
+        return cb(block(vec2(mod(j, cw), floor(j / cw))));
+
+    j -= plane;
+    return cr(block(vec2(mod(j, cw), floor(j / cw))));
+}
+
+void main() {
+    vec2 texel = floor(gl_FragCoord.xy);
+    gl_FragColor = vec4(frameByte(texel, 0.0), frameByte(texel, 1.0), frameByte(texel, 2.0), frameByte(texel, 3.0));
+}
+)";
+
 // ------------------------------------------------------------------------- CONTRUCTOR
 GlslViewer::GlslViewer(): 
-    screenshotFile(""), lenticular(""), quilt_resolution(-1), quilt_tile(-1), 
+    screenshotFile(""), screenshotWidth(0), screenshotHeight(0), screenshotTiles(0), lenticular(""), quilt_resolution(-1), quilt_tile(-1), 
     frag_index(-1), vert_index(-1), geom_index(-1), 
     verbose(false), cursor(true), help(false), fxaa(false),
     // Main Vert/Frag/Geom
@@ -73,6 +132,9 @@ GlslViewer::GlslViewer():
     m_max_mem_in_queue(500 * 1024 * 1024),
     m_save_threads(std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1)),
     #endif
+    #if defined(SUPPORT_ASYNC_READBACK)
+    m_record_readback_size(3),
+    #endif
 
     // Scene
     m_view2d(1.0), m_time_offset(0.0),
@@ -82,11 +144,19 @@ GlslViewer::GlslViewer():
     m_cam_anim(CAM_NONE), m_cam_anim_phase(0.0f), m_cam_anim_amp(0.0f), m_cam_anim_min(0.0f), m_cam_anim_max(0.0f), m_cam_anim_speed(1.0f),
     m_cam_base_pos(0.0f), m_cam_base_target(0.0f), m_cam_base_rot(1.0f, 0.0f, 0.0f, 0.0f), m_cam_base_az(0.0f), m_cam_base_el(0.0f), m_cam_base_dist(1.0f),
     m_error_screen(vera::SHOW_MAGENTA_SHADER),
+    m_graph_skip(true), m_aliased(false), m_aliasing(true), m_vram_peak(0), m_vram_peak_unaliased(0),
     m_change_viewport(true), m_update_buffers(true), m_initialized(false), 
 
     // Debug
     m_showTextures(false), m_showPasses(false)
 {
+    // Recycle up to as much idle frame memory as the save queue is allowed to hold
+    #if defined(SUPPORT_MULTITHREAD_RECORDING)
+    m_frame_pool.setMaxMemory(m_max_mem_in_queue);
+    #else
+    m_frame_pool.setMaxMemory(500 * 1024 * 1024);
+    #endif
+
     // set vera scene values to uniforms
     vera::scene( (vera::Scene*)&uniforms );
 
@@ -108,13 +178,17 @@ GlslViewer::GlslViewer():
         return vera::toString( uniforms.isPlaying()? 1 : 0 );
     } );
 
-    uniforms.functions["u_time"] = UniformFunction( "float", [&](vera::Shader& _shader) {
+    auto time = [this]() {
         if (vera::getWindowStyle() == vera::EMBEDDED) 
-            _shader.setUniform("u_time", float(uniforms.getFrame()) * vera::getRestSec());
+            return float(uniforms.getFrame()) * vera::getRestSec();
         else if (isRecording()) 
-            _shader.setUniform("u_time", getRecordingTime());
+            return getRecordingTime();
         else 
-            _shader.setUniform("u_time", float(vera::getTime()) - m_time_offset);
+            return float(vera::getTime()) - m_time_offset;
+    };
+
+    uniforms.functions["u_time"] = UniformFunction( "float", [time](vera::Shader& _shader) {
+        _shader.setUniform("u_time", time());
     }, 
     [&]() {  
         if (isRecording()) return vera::toString( getRecordingTime() );
@@ -166,6 +240,27 @@ GlslViewer::GlslViewer():
 
 
     uniforms.functions["u_modelViewProjectionMatrix"] = UniformFunction("mat4");
+
+    // The app side of the GlslViewerFrame block, same values as the functions above
+    uniforms.blockFunction = [this, time](UniformBlock& _block) {
+        glm::vec4 date = vera::getDate();
+        glm::vec2 mouse = vera::getMousePositionFlipped();
+        _block.date[0] = date.x;
+        _block.date[1] = date.y;
+        _block.date[2] = date.z;
+        _block.date[3] = date.w;
+        _block.time = time();
+        _block.delta = isRecording() ? getRecordingDelta() : float(vera::getDelta());
+        _block.resolution[0] = float(vera::getWindowWidth());
+        _block.resolution[1] = float(vera::getWindowHeight());
+        _block.mouse[0] = mouse.x;
+        _block.mouse[1] = mouse.y;
+        _block.frame = (int)uniforms.getFrame();
+        _block.pixelDensity = vera::pixelDensity();
+    };
+
+    // Sequences with a frame rate play along u_time (recordings included)
+    uniforms.sequenceTime = [time]() { return double(time()); };
 }
 
 GlslViewer::~GlslViewer() {
@@ -561,6 +656,9 @@ void GlslViewer::commandsInit(CommandList &_commands ) {
 
                 else if (values[1] == "framerate")
                     std::cout << uniforms.tracker.logFramerate();
+
+                else if (values[1] == "counters")
+                    std::cout << uniforms.tracker.logCounters();
             }
 
             else if (values.size() == 3) {
@@ -585,6 +683,14 @@ void GlslViewer::commandsInit(CommandList &_commands ) {
 
                 else if (values[1] == "samples")
                     std::cout << uniforms.tracker.logSamples(values[2]);
+
+                else if (   values[1] == "counters" && 
+                            vera::haveExt(values[2],"csv") ) {
+                    std::ofstream out(values[2]);
+                    out << "counter,value\n";
+                    out << uniforms.tracker.logCounters();
+                    out.close();
+                }
                     
             }
             else if (values.size() == 4) {
@@ -608,7 +714,7 @@ void GlslViewer::commandsInit(CommandList &_commands ) {
         }
         return false;
     },
-    "track[,on|off|average|samples]", "start/stop tracking rendering time", false));
+    "track[,on|off|average|samples|counters]", "start/stop tracking rendering time", false));
 
     _commands.push_back(Command("glsl_version", [&](const std::string& _line){ 
         if (_line == "glsl_version") {
@@ -789,10 +895,54 @@ void GlslViewer::commandsInit(CommandList &_commands ) {
             console_uniforms( values[1] == "on" );
             return true; 
         }
+        else if (values[1] == "bindings") {
+            if (values.size() == 2)
+                std::cout << (uniforms.bindingTables ? "on" : "off") << std::endl;
+            else
+                uniforms.bindingTables = (values[2] == "on");
+            return true;
+        }
+        else if (values[1] == "bench") {
+            uniforms.benchmark( (values.size() > 2) ? std::max(1, vera::toInt(values[2])) : 1000 );
+            return true;
+        }
+        else if (values[1] == "sequences") {
+            uniforms.printSequences();
+            return true;
+        }
+        else if (values[1] == "sequence" && values.size() >= 4) {
+            UniformSequenceMap::iterator it = uniforms.sequences.find(values[2]);
+            if (it == uniforms.sequences.end()) {
+                std::cout << "// There is no sequence called " << values[2] << std::endl;
+                return true;
+            }
+            if (values[3] == "fps" && values.size() == 5) {
+                it->second->setFps( vera::toFloat(values[4]) );
+                return true;
+            }
+            for (size_t i = 0; i < 3; i++) {
+                if (values[3] == sequence_interpolation_options[i]) {
+                    it->second->setInterpolation( (SequenceInterpolation)i );
+                    return true;
+                }
+            }
+        }
+        else if (values[1] == "convert" && values.size() >= 3) {
+            uniforms.convertSequence(values[2], (values.size() > 3) ? vera::toFloat(values[3]) : 0.0f);
+            return true;
+        }
+        else if (values[1] == "policy" && values.size() >= 4) {
+            for (size_t i = 0; i < 3; i++) {
+                if (values[3] == uniform_policy_options[i]) {
+                    uniforms.setPolicy(values[2], (UniformPolicy)i, (values.size() > 4) ? std::max(1, vera::toInt(values[4])) : 64);
+                    return true;
+                }
+            }
+        }
 
         return false;
     },
-    "uniforms[,all|active|defined|textures|buffers|cubemaps|lights|cameras|on|off]", "return a list of uniforms", false));
+    "uniforms[,all|active|defined|textures|buffers|cubemaps|lights|cameras|sequences|on|off|bindings[,on|off]|bench[,<iterations>]|policy,<name>,latest|fifo|average[,<capacity>]|sequence,<name>,nearest|linear|cubic|fps,<fps>|convert,<file.csv>[,<fps>]]", "return a list of uniforms", false));
 
     _commands.push_back(Command("textures", [&](const std::string& _line){ 
         if (_line == "textures") {
@@ -847,18 +997,76 @@ void GlslViewer::commandsInit(CommandList &_commands ) {
                     values[1] = m_showPasses ? "off" : "on";
 
                 m_showPasses = (values[1] == "on" || values[1] == "show");
+
+                // the overlay samples every buffer after the passes
+                if (m_graph.isValid( uniforms.getBindingsStamp() ))
+                    _aliasTargets();
                 return true;
             }
             else if (values.size() == 3) {
                 size_t i = vera::toInt(values[1]);
-                if (i < uniforms.buffers.size())
-                    uniforms.buffers[i]->enabled = (values[1] == "on");
+                if (i < uniforms.buffers.size()) {
+                    // on its own target, then shared again with it in or out of the pool
+                    _unaliasTargets();
+                    uniforms.buffers[i]->enabled = (values[2] == "on");
+                    if (m_graph.isValid( uniforms.getBindingsStamp() ))
+                        _aliasTargets();
+                    return true;
+                }
             }
         }
         return false;
     },
     "buffers[,show|hide|list]", "Show/hide buffer on viewport, or return the list of buffers", false));
 
+    _commands.push_back(Command("passes", [&](const std::string& _line){
+        if (_line == "passes") {
+            m_graph.print();
+            return true;
+        }
+        else {
+            std::vector<std::string> values = vera::split(_line,',');
+            if (values.size() == 2) {
+                if (values[1] == "reset") {
+                    m_graph.resetStats();
+                    return true;
+                }
+                else if (values[1] == "on" || values[1] == "off") {
+                    m_graph_skip = (values[1] == "on");
+                    return true;
+                }
+            }
+        }
+        return false;
+    },
+    "passes[,on|off|reset]", "print the render graph of the buffer, double buffer, pyramid and flood passes with how often each one got skipped. on/off toggles skipping the unchanged ones", false));
+
+    _commands.push_back(Command("vram", [&](const std::string& _line){
+        size_t aliased = 0;
+        size_t unaliased = 0;
+        if (_line == "vram") {
+            _vram(aliased, unaliased, true);
+            return true;
+        }
+        else {
+            std::vector<std::string> values = vera::split(_line,',');
+            if (values.size() == 2 && values[1] == "reset") {
+                m_vram_peak = 0;
+                m_vram_peak_unaliased = 0;
+                _vram(aliased, unaliased, false);
+                return true;
+            }
+            else if (values.size() == 3 && values[1] == "aliasing") {
+                m_aliasing = (values[2] == "on");
+                if (m_graph.isValid( uniforms.getBindingsStamp() ))
+                    _aliasTargets();
+                return true;
+            }
+        }
+        return false;
+    },
+    "vram[,reset|aliasing,on|off]", "print the GPU memory of every render target, and the total and peak with and without the transient ones sharing targets. aliasing,on|off toggles the sharing", false));
+
     // CUBEMAPS
     _commands.push_back(Command("cubemaps", [&](const std::string& _line){
         if (_line == "cubemaps") {
@@ -1564,6 +1772,7 @@ void GlslViewer::commandsInit(CommandList &_commands ) {
         std::vector<std::string> values = vera::split(line,',');
         if (values.size() == 2) {
             m_max_mem_in_queue = std::stoll(values[1]);
+            m_frame_pool.setMaxMemory(m_max_mem_in_queue);
         }
         else {
             std::cout << m_max_mem_in_queue.load() << std::endl;
@@ -1572,6 +1781,25 @@ void GlslViewer::commandsInit(CommandList &_commands ) {
     }, "max_mem_in_queue[,<bytes>]", "set the maximum amount of memory used by a queue to export images to disk"));
     #endif
 
+    #if defined(SUPPORT_ASYNC_READBACK)
+    _commands.push_back(Command("readback", [&](const std::string & line) {
+        std::vector<std::string> values = vera::split(line,',');
+        if (values.size() == 2) {
+            if (isRecording()) {
+                std::cout << "Can't change the readback ring while recording" << std::endl;
+                return true;
+            }
+            m_record_readback_size = std::max(0, vera::toInt(values[1]));
+            return true;
+        }
+        else {
+            std::cout << m_record_readback_size << std::endl;
+            return true;
+        }
+        return false;
+    }, "readback[,<frames>]", "number of pixel buffers in flight while recording, 0 reads them synchronously (default: 3)"));
+    #endif
+
     if (vert_index != -1 || hasGeometry()) {
         m_sceneRender.commandsInit(_commands, uniforms);
         m_sceneRender.uniformsInit(uniforms);
@@ -1712,6 +1940,8 @@ void GlslViewer::loadAssets(WatchFileList &_files) {
     vera::clear(0.0f);
 
     addDefine("GLSLVIEWER", vera::toString(GLSLVIEWER_VERSION_MAJOR) + vera::toString(GLSLVIEWER_VERSION_MINOR) + vera::toString(GLSLVIEWER_VERSION_PATCH) );
+    if (Uniforms::isBlockSupported())
+        addDefine("GLSLVIEWER_UBO", Uniforms::getBlockDeclaration());
     if (uniforms.activeCubemap) {
         addDefine("SCENE_SH_ARRAY", "u_SH");
         addDefine("SCENE_CUBEMAP", "u_cubeMap");
@@ -1753,6 +1983,7 @@ void GlslViewer::loadModel(vera::Model* _model) {
 
     uniforms.models[_model->getName()] = _model;
     m_sceneRender.loadScene(uniforms);
+    uniforms.invalidateBindings();
     uniforms.activeCamera->orbit(m_camera_azimuth, m_camera_elevation, m_sceneRender.getArea() * 2.0);
     vera::flagChange();
 }
@@ -1774,6 +2005,7 @@ void GlslViewer::addDefine(const std::string &_define, const std::string &_value
         m_canvas_shader.addDefine(_define, _value);
 
     m_postprocessing_shader.addDefine(_define, _value);
+    uniforms.invalidateBindings();
     vera::flagChange();
 }
 
@@ -1794,6 +2026,7 @@ void GlslViewer::delDefine(const std::string &_define) {
         m_canvas_shader.delDefine(_define);
 
     m_postprocessing_shader.delDefine(_define);
+    uniforms.invalidateBindings();
     vera::flagChange();
 }
 
@@ -1806,6 +2039,7 @@ bool GlslViewer::isReady() {
 bool GlslViewer::haveChange() { 
     return  vera::haveChanged() ||
             uniforms.haveChange() ||
+            !commandQueue.empty() ||
             isRecording() ||
             screenshotFile != "";
 }
@@ -1925,17 +2159,17 @@ void GlslViewer::resetShaders( WatchFileList &_files ) {
         // Specific defines for this buffer
         m_postprocessing_shader.addDefine("POSTPROCESSING");
         m_postprocessing_shader.setSource(m_frag_source, vera::getDefaultSrc(vera::VERT_BILLBOARD));
-        uniforms.functions["u_scene"].present = true;
+        uniforms.setPresent(UNIFORM_ID_SCENE, true);
         m_postprocessing = true;
     }
     else if (lenticular.size() > 0) {
         m_postprocessing_shader.setSource(vera::getLenticularFragShader(vera::getVersionNumber()), vera::getDefaultSrc(vera::VERT_BILLBOARD));
-        uniforms.functions["u_scene"].present = true;
+        uniforms.setPresent(UNIFORM_ID_SCENE, true);
         m_postprocessing = true;
     }
     else if (fxaa) {
         m_postprocessing_shader.setSource(vera::getDefaultSrc(vera::FRAG_FXAA), vera::getDefaultSrc(vera::VERT_BILLBOARD));
-        uniforms.functions["u_scene"].present = true;
+        uniforms.setPresent(UNIFORM_ID_SCENE, true);
         m_postprocessing = true;
     }
     else 
@@ -1950,6 +2184,9 @@ void GlslViewer::resetShaders( WatchFileList &_files ) {
 
 // ------------------------------------------------------------------------- UPDATE
 void GlslViewer::_updateBuffers() {
+    // Every buffer back on its own target before they get replaced
+    _unaliasTargets();
+
     // Update Buffers
     if ( m_buffers_total != int(uniforms.buffers.size())) {
         if (verbose)
@@ -2032,7 +2269,8 @@ void GlslViewer::_updateBuffers() {
                 m_pyramid_subshaders[i].detach(GL_FRAGMENT_SHADER | GL_VERTEX_SHADER);        
 
         uniforms.pyramids.clear();
-        m_pyramid_fbos.clear();
+        m_pyramid_sizes.clear();
+        m_pyramid_targets.clear();
         m_pyramid_subshaders.clear();
         if (m_pyramid_total > 0)
             m_pyramid_subshaders.reserve(m_pyramid_total);
@@ -2055,6 +2293,7 @@ void GlslViewer::_updateBuffers() {
                 glClear(GL_COLOR_BUFFER_BIT);
                 m_pyramid_shader.use();
 
+                uniforms.blockResolution((float)_target->getWidth(), (float)_target->getHeight());
                 uniforms.feedTo( &m_pyramid_shader );
 
                 m_pyramid_shader.setUniform("u_pyramidDepth", _depth);
@@ -2069,13 +2308,13 @@ void GlslViewer::_updateBuffers() {
                 m_pyramid_shader.setUniform("u_pixel", 1.0f/((float)_target->getWidth()), 1.0f/((float)_target->getHeight()));
 
                 vera::billboard()->render( &m_pyramid_shader );
+                uniforms.blockReset();
                 _target->unbind();
             };
 
-            // Create input FBO
-            m_pyramid_fbos.push_back( vera::Fbo() );
-            m_pyramid_fbos[i].allocate(size.x, size.y, vera::COLOR_FLOAT_TEXTURE);
-            m_pyramid_fbos[i].scale = size.z;
+            // The input target comes from the pool when the pass renders
+            m_pyramid_sizes.push_back( size );
+            m_pyramid_targets.push_back( nullptr );
         }
     }
 
@@ -2172,13 +2411,76 @@ void GlslViewer::_renderBuffers() {
     glDisable(GL_BLEND);
 
     bool reset_viewport = false;
-    for (size_t i = 0; i < uniforms.buffers.size(); i++) {
-        if (!(uniforms.buffers[i]->enabled || m_update_buffers))
-            continue;
+
+    // The graph comes out of the binding tables of the passes. Until it matches them (new sources,
+    // new uniforms or buffers) every pass renders in declaration order, which also links and feeds
+    // them, and the graph gets built after
+    bool graph = !m_update_buffers && m_graph.isValid( uniforms.getBindingsStamp() );
+    if (graph) {
+        bool sceneChanged = vera::haveChanged() || uniforms.haveSceneChange();
+        if (m_change_viewport)
+            m_graph.force();
+
+        const std::vector<size_t>& order = m_graph.getOrder();
+        for (size_t i = 0; i < order.size(); i++) {
+            RenderPass& pass = m_graph[ order[i] ];
+            if (m_graph_skip && !m_graph.isDirty(order[i], sceneChanged)) {
+                m_graph.skipped(order[i]);
+                continue;
+            }
+
+            if (_renderPass(pass.type, pass.index, reset_viewport))
+                m_graph.ran(order[i]);
+        }
+    }
+    else {
+        _unaliasTargets();
+
+        for (size_t i = 0; i < uniforms.buffers.size(); i++)
+            _renderPass(PASS_BUFFER, i, reset_viewport);
+
+        for (size_t i = 0; i < uniforms.doubleBuffers.size(); i++)
+            _renderPass(PASS_DOUBLE_BUFFER, i, reset_viewport);
+
+        for (size_t i = 0; i < m_pyramid_subshaders.size(); i++)
+            _renderPass(PASS_PYRAMID, i, reset_viewport);
+
+        for (size_t i = 0; i < m_flood_subshaders.size(); i++)
+            _renderPass(PASS_FLOOD, i, reset_viewport);
+    }
+
+    uniforms.holdTextureUnits(false);
+
+    #if defined(__EMSCRIPTEN__)
+    if (vera::getWebGLVersionNumber() == 1)
+        reset_viewport = true;
+    #endif
+
+    if (vera::getWindowStyle() != vera::EMBEDDED && reset_viewport)
+        glViewport(0.0f, 0.0f, vera::getWindowWidth(), vera::getWindowHeight());
+
+    if (!graph)
+        _buildGraph();
+    
+    m_update_buffers = false;
+
+    vera::blendMode(vera::BLEND_ALPHA);
+}
+
+bool GlslViewer::_renderPass(PassType _type, size_t _index, bool& _resetViewport) {
+    size_t i = _index;
+
+    // Between the feeds of the buffer and double buffer passes nothing else binds textures (the
+    // scene buffers go by name before them), so the units keep what the last one left there
+    uniforms.holdTextureUnits(_type == PASS_BUFFER || _type == PASS_DOUBLE_BUFFER);
+
+    if (_type == PASS_BUFFER) {
+        if (i >= uniforms.buffers.size() || !(uniforms.buffers[i]->enabled || m_update_buffers))
+            return false;
 
         TRACK_BEGIN("render:buffer" + vera::toString(i))
 
-        reset_viewport += uniforms.buffers[i]->scale <= 0.0;
+        _resetViewport += uniforms.buffers[i]->scale <= 0.0;
 
         uniforms.buffers[i]->bind();
 
@@ -2188,22 +2490,14 @@ void GlslViewer::_renderBuffers() {
         m_buffers_shaders[i].setUniform("u_viewMatrix", glm::mat4(1.0f));
         m_buffers_shaders[i].setUniform("u_projectionMatrix", glm::mat4(1.0f));
 
-        // Pass textures for the other buffers
-        for (size_t j = 0; j < uniforms.buffers.size(); j++)
-            if (i != j)
-                m_buffers_shaders[i].setUniformTexture("u_buffer" + vera::toString(j), uniforms.buffers[j]  );
-
-        for (size_t j = 0; j < uniforms.doubleBuffers.size(); j++)
-            m_buffers_shaders[i].setUniformTexture("u_doubleBuffer" + vera::toString(j), uniforms.doubleBuffers[j]->src );
-
-        for (size_t j = 0; j < uniforms.floods.size(); j++)
-            m_buffers_shaders[i].setUniformTexture("u_flood" + vera::toString(j), uniforms.floods[j].dst );
-
         for (size_t j = 0; j < m_sceneRender.buffersFbo.size(); j++)
             m_buffers_shaders[i].setUniformTexture("u_sceneBuffer" + vera::toString(j), m_sceneRender.buffersFbo[j] );
 
-        // Update uniforms and textures
-        uniforms.feedTo( &m_buffers_shaders[i], true, false);
+        // Update uniforms and textures, the other buffers included (not this one)
+        uniforms.blockResolution(float(uniforms.buffers[i]->getWidth()), float(uniforms.buffers[i]->getHeight()));
+        uniforms.feedTarget( uniforms.buffers[i] );
+        uniforms.feedTo( &m_buffers_shaders[i], true, true);
+        uniforms.feedTarget( nullptr );
 
         // feedTo() above just set u_resolution to the WINDOW's size (its
         // only definition, glslViewer.cpp:136-138), but this buffer was just
@@ -2214,55 +2508,62 @@ void GlslViewer::_renderBuffers() {
         m_buffers_shaders[i].setUniform("u_resolution", float(uniforms.buffers[i]->getWidth()), float(uniforms.buffers[i]->getHeight()));
 
         vera::billboard()->render( &m_buffers_shaders[i] );
+        uniforms.blockReset();
 
         uniforms.buffers[i]->unbind();
 
         TRACK_END("render:buffer" + vera::toString(i))
     }
+    else if (_type == PASS_DOUBLE_BUFFER) {
+        if (i >= uniforms.doubleBuffers.size())
+            return false;
 
-    for (size_t i = 0; i < uniforms.doubleBuffers.size(); i++) {
         TRACK_BEGIN("render:doubleBuffer" + vera::toString(i))
 
-        reset_viewport += uniforms.doubleBuffers[i]->src->scale <= 0.0;
+        _resetViewport += uniforms.doubleBuffers[i]->src->scale <= 0.0;
 
         uniforms.doubleBuffers[i]->dst->bind();
 
         m_doubleBuffers_shaders[i].use();
 
-        // Pass textures for the other buffers
-        for (size_t j = 0; j < uniforms.buffers.size(); j++)
-            m_doubleBuffers_shaders[i].setUniformTexture("u_buffer" + vera::toString(j), uniforms.buffers[j] );
-
-        for (size_t j = 0; j < uniforms.doubleBuffers.size(); j++)
-            m_doubleBuffers_shaders[i].setUniformTexture("u_doubleBuffer" + vera::toString(j), uniforms.doubleBuffers[j]->src );
-
-        for (size_t j = 0; j < uniforms.floods.size(); j++)
-            m_doubleBuffers_shaders[i].setUniformTexture("u_flood" + vera::toString(j), uniforms.floods[j].dst );
-
         for (size_t j = 0; j < m_sceneRender.buffersFbo.size(); j++)
             m_doubleBuffers_shaders[i].setUniformTexture("u_sceneBuffer" + vera::toString(j), m_sceneRender.buffersFbo[j] );
 
-        // Update uniforms and textures
-        uniforms.feedTo( &m_doubleBuffers_shaders[i], true, false);
+        // Update uniforms and textures, all the buffers included (it reads its own src)
+        uniforms.blockResolution(float(uniforms.doubleBuffers[i]->dst->getWidth()), float(uniforms.doubleBuffers[i]->dst->getHeight()));
+        uniforms.feedTarget( uniforms.doubleBuffers[i]->dst );
+        uniforms.feedTo( &m_doubleBuffers_shaders[i], true, true);
+        uniforms.feedTarget( nullptr );
 
-        // See the equivalent u_resolution override in the u_buffer loop
+        // See the equivalent u_resolution override in the u_buffer pass
         // above -- same fix, this pass's target is dst, not the window.
         m_doubleBuffers_shaders[i].setUniform("u_resolution", float(uniforms.doubleBuffers[i]->dst->getWidth()), float(uniforms.doubleBuffers[i]->dst->getHeight()));
 
         vera::billboard()->render( &m_doubleBuffers_shaders[i] );
+        uniforms.blockReset();
         
         uniforms.doubleBuffers[i]->dst->unbind();
         uniforms.doubleBuffers[i]->swap();
 
         TRACK_END("render:doubleBuffer" + vera::toString(i))
     }
+    else if (_type == PASS_PYRAMID) {
+        if (i >= m_pyramid_subshaders.size())
+            return false;
 
-    for (size_t i = 0; i < m_pyramid_subshaders.size(); i++) {
         TRACK_BEGIN("render:pyramid" + vera::toString(i))
 
-        reset_viewport += m_pyramid_fbos[i].scale <= 0.0;
+        _resetViewport += m_pyramid_sizes[i].z <= 0.0;
 
-        m_pyramid_fbos[i].bind();
+        // The input only lives until the pyramid is processed
+        vera::Fbo* input = (i < m_pyramid_targets.size()) ? m_pyramid_targets[i] : nullptr;
+        bool pooled = (input == nullptr);
+        if (pooled) {
+            glm::ivec2 size = _pyramidSize(i);
+            input = m_targets.acquire(size.x, size.y, vera::COLOR_FLOAT_TEXTURE);
+        }
+
+        input->bind();
         m_pyramid_subshaders[i].use();
 
         // Clear the background
@@ -2270,30 +2571,38 @@ void GlslViewer::_renderBuffers() {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // Update uniforms and textures
+        uniforms.blockResolution(float(input->getWidth()), float(input->getHeight()));
         uniforms.feedTo( &m_pyramid_subshaders[i], true, true );
 
-        // See the equivalent u_resolution override in the u_buffer loop
-        // above -- same fix, this pass's target is m_pyramid_fbos[i].
-        m_pyramid_subshaders[i].setUniform("u_resolution", float(m_pyramid_fbos[i].getWidth()), float(m_pyramid_fbos[i].getHeight()));
+        // See the equivalent u_resolution override in the u_buffer pass
+        // above -- same fix, this pass's target is the pyramid's input.
+        m_pyramid_subshaders[i].setUniform("u_resolution", float(input->getWidth()), float(input->getHeight()));
 
         for (size_t j = 0; j < m_sceneRender.buffersFbo.size(); j++)
             if (m_sceneRender.buffersFbo[j]->isAllocated())
                 m_pyramid_subshaders[i].setUniformTexture("u_sceneBuffer" + vera::toString(j), m_sceneRender.buffersFbo[j] );
 
         vera::billboard()->render( &m_pyramid_subshaders[i] );
+        uniforms.blockReset();
 
-        m_pyramid_fbos[i].unbind();
+        input->unbind();
 
         vera::blendMode(vera::BLEND_ALPHA);
-        uniforms.pyramids[i].process(&m_pyramid_fbos[i]);
+        uniforms.pyramids[i].process(input);
+        glDisable(GL_BLEND);
+
+        if (pooled)
+            m_targets.release(input);
 
         TRACK_END("render:pyramid" + vera::toString(i))
     }
+    else {
+        if (i >= m_flood_subshaders.size())
+            return false;
 
-    for (size_t i = 0; i < m_flood_subshaders.size(); i++) {
         TRACK_BEGIN("render:flood" + vera::toString(i))
 
-        reset_viewport += uniforms.floods[i].scale <= 0.0;
+        _resetViewport += uniforms.floods[i].scale <= 0.0;
 
         uniforms.floods[i].dst->bind();
         m_flood_subshaders[i].use();
@@ -2316,38 +2625,253 @@ void GlslViewer::_renderBuffers() {
                 m_flood_subshaders[i].setUniformTexture("u_sceneBuffer" + vera::toString(j), m_sceneRender.buffersFbo[j] );
 
         // Update uniforms and textures
+        uniforms.blockResolution(float(uniforms.floods[i].dst->getWidth()), float(uniforms.floods[i].dst->getHeight()));
         uniforms.feedTo( &m_flood_subshaders[i], true, false );
 
-        // See the equivalent u_resolution override in the u_buffer loop
+        // See the equivalent u_resolution override in the u_buffer pass
         // above -- same fix, this pass's target is dst, not the window.
         m_flood_subshaders[i].setUniform("u_resolution", float(uniforms.floods[i].dst->getWidth()), float(uniforms.floods[i].dst->getHeight()));
 
         vera::billboard()->render( &m_flood_subshaders[i] );
+        uniforms.blockReset();
 
         uniforms.floods[i].dst->unbind();
 
         vera::blendMode(vera::BLEND_ALPHA);
         uniforms.floods[i].process();
+        glDisable(GL_BLEND);
 
         TRACK_END("render:flood" + vera::toString(i))
     }
 
-    #if defined(__EMSCRIPTEN__)
-    if (vera::getWebGLVersionNumber() == 1)
-        reset_viewport = true;
-    #endif
+    return true;
+}
 
-    if (vera::getWindowStyle() != vera::EMBEDDED && reset_viewport)
-        glViewport(0.0f, 0.0f, vera::getWindowWidth(), vera::getWindowHeight());
-    
-    m_update_buffers = false;
+// One node per pass with edges from the passes it samples, out of the tables of its programs
+void GlslViewer::_buildGraph() {
+    m_graph.clear();
+    for (size_t i = 0; i < uniforms.buffers.size(); i++)
+        m_graph.add(PASS_BUFFER, i);
+    for (size_t i = 0; i < uniforms.doubleBuffers.size(); i++)
+        m_graph.add(PASS_DOUBLE_BUFFER, i);
+    for (size_t i = 0; i < m_pyramid_subshaders.size(); i++)
+        m_graph.add(PASS_PYRAMID, i);
+    for (size_t i = 0; i < m_flood_subshaders.size(); i++)
+        m_graph.add(PASS_FLOOD, i);
+
+    bool linked = true;
+    for (size_t p = 0; p < m_graph.size(); p++) {
+        size_t i = m_graph[p].index;
+        switch (m_graph[p].type) {
+            case PASS_BUFFER:           linked = uniforms.getReads(&m_buffers_shaders[i], m_graph, p) && linked; break;
+            case PASS_DOUBLE_BUFFER:    linked = uniforms.getReads(&m_doubleBuffers_shaders[i], m_graph, p) && linked; break;
+            case PASS_PYRAMID:
+                linked = uniforms.getReads(&m_pyramid_subshaders[i], m_graph, p) && linked;
+                linked = uniforms.getReads(&m_pyramid_shader, m_graph, p) && linked;
+                break;
+            case PASS_FLOOD:            linked = uniforms.getReads(&m_flood_subshaders[i], m_graph, p) && linked; break;
+        }
+
+        // the scene buffers are bound by name to every pass, and rendered every frame
+        if (!m_sceneRender.buffersFbo.empty())
+            m_graph[p].reads |= PASS_READS_TIME;
+    }
+    m_graph.sort();
 
-    vera::blendMode(vera::BLEND_ALPHA);
+    // try again next frame
+    if (linked) {
+        m_graph.setStamp( uniforms.getBindingsStamp() );
+        _aliasTargets();
+    }
+}
+
+// Buffers that render every frame and are only sampled by the passes after them don't need to
+// keep their target from one frame to the next: each one takes it from the pool when its pass
+// comes in the order and gives it back after the last pass that samples it, so the ones that are
+// never alive at the same time share it. The inputs of the pyramids only live during their own
+// pass. The assignment stays until the graph gets built again
+void GlslViewer::_aliasTargets() {
+    _unaliasTargets();
+
+    // The scene and the pass overlay are not in the graph and sample them at any time
+    bool alias = uniforms.models.empty() && !m_showPasses;
+
+    // What the canvas and the postprocessing sample has to last until the end of the frame
+    RenderGraph graph = m_graph;
+    size_t sink = graph.add(PASS_BUFFER, (size_t)-1);
+    alias = alias && uniforms.getReads(&m_canvas_shader, graph, sink);
+    if (m_postprocessing)
+        alias = alias && uniforms.getReads(&m_postprocessing_shader, graph, sink);
+
+    const std::vector<size_t>& order = m_graph.getOrder();
+    size_t total = m_graph.size();
+    std::vector<size_t> position(total, 0);
+    for (size_t i = 0; i < order.size(); i++)
+        position[ order[i] ] = i;
+
+    // ... and up to which position it has to last
+    std::vector<size_t> last(position);
+    std::vector<bool> transient(total, false);
+    for (size_t p = 0; p < total; p++) {
+        const RenderPass& pass = m_graph[p];
+        if (pass.type != PASS_BUFFER || pass.index >= uniforms.buffers.size())
+            continue;
+
+        const vera::Fbo* fbo = uniforms.buffers[pass.index];
+        bool candidate = alias && fbo->enabled && fbo->scale > 0.0 && (pass.reads & PASS_READS_TIME);
+        for (size_t q = 0; q < graph.size() && candidate; q++) {
+            const std::vector<size_t>& inputs = graph[q].inputs;
+            if (std::find(inputs.begin(), inputs.end(), p) == inputs.end())
+                continue;
+
+            candidate = q != sink && q != p && position[q] > position[p];
+            if (candidate)
+                last[p] = std::max(last[p], position[q]);
+        }
+        transient[p] = candidate;
+    }
+
+    m_buffers_aliased.assign(uniforms.buffers.size(), AliasedBuffer());
+    std::vector< std::vector<vera::Fbo*> > releases(order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        const RenderPass& pass = m_graph[ order[i] ];
+        if (transient[ order[i] ]) {
+            vera::Fbo* own = uniforms.buffers[pass.index];
+            vera::Fbo* target = m_targets.acquire(own->getWidth(), own->getHeight(), vera::COLOR_FLOAT_TEXTURE);
+            target->scale = own->scale;
+
+            m_buffers_aliased[pass.index].aliased = true;
+            m_buffers_aliased[pass.index].scale = own->scale;
+            uniforms.buffers[pass.index] = target;
+            delete own;
+
+            releases[ last[ order[i] ] ].push_back(target);
+            m_aliased = true;
+        }
+        else if (pass.type == PASS_PYRAMID && pass.index < m_pyramid_targets.size()) {
+            glm::ivec2 size = _pyramidSize(pass.index);
+            m_pyramid_targets[pass.index] = m_targets.acquire(size.x, size.y, vera::COLOR_FLOAT_TEXTURE);
+            releases[i].push_back(m_pyramid_targets[pass.index]);
+            m_aliased = true;
+        }
+
+        // without aliasing every one keeps its target, which is what the pool costs then
+        if (m_aliasing)
+            for (size_t j = 0; j < releases[i].size(); j++)
+                m_targets.release(releases[i][j]);
+    }
+
+    size_t aliased = 0;
+    size_t unaliased = 0;
+    _vram(aliased, unaliased, false);
+}
+
+// Every buffer back on a target of its own, and the pool emptied of the ones handed out
+void GlslViewer::_unaliasTargets() {
+    for (size_t i = 0; i < m_pyramid_targets.size(); i++)
+        m_pyramid_targets[i] = nullptr;
+
+    if (!m_aliased)
+        return;
+
+    for (size_t i = 0; i < m_buffers_aliased.size() && i < uniforms.buffers.size(); i++) {
+        if (!m_buffers_aliased[i].aliased)
+            continue;
+
+        float scale = m_buffers_aliased[i].scale;
+        uniforms.buffers[i] = new vera::Fbo();
+        uniforms.buffers[i]->allocate(vera::getWindowWidth() * scale, vera::getWindowHeight() * scale, vera::COLOR_FLOAT_TEXTURE);
+        uniforms.buffers[i]->scale = scale;
+    }
+    m_buffers_aliased.clear();
+
+    m_targets.clear();
+    m_aliased = false;
+}
+
+glm::ivec2 GlslViewer::_pyramidSize(size_t _index) const {
+    const glm::vec3& size = m_pyramid_sizes[_index];
+    if (size.z > 0.0)
+        return glm::ivec2(vera::getWindowWidth() * size.z, vera::getWindowHeight() * size.z);
+    return glm::ivec2(size.x, size.y);
+}
+
+// Rough GPU memory of the render targets: what they take now, with the transient ones in the pool,
+// and what they would take each on its own
+void GlslViewer::_vram(size_t& _aliased, size_t& _unaliased, bool _print) {
+    if (_print)
+        std::cout << "// target, width, height, MB, pooled" << std::endl;
+
+    _aliased = m_targets.getBytes();
+    _unaliased = 0;
+    auto add = [&](const std::string& _name, int _width, int _height, vera::FboType _type, bool _pooled) {
+        size_t bytes = RenderTargets::bytesOf(_width, _height, _type);
+        _unaliased += bytes;
+        if (!_pooled)
+            _aliased += bytes;
+
+        if (_print && bytes > 0)
+            std::cout << _name << "," << _width << "," << _height << "," << double(bytes) / (1024.0 * 1024.0) << "," << (_pooled ? "yes" : "no") << std::endl;
+    };
+    auto addFbo = [&](const std::string& _name, const vera::Fbo& _fbo, bool _pooled) {
+        if (_fbo.isAllocated())
+            add(_name, _fbo.getWidth(), _fbo.getHeight(), _fbo.getType(), _pooled);
+    };
+
+    for (size_t i = 0; i < uniforms.buffers.size(); i++)
+        addFbo("u_buffer" + vera::toString(i), *uniforms.buffers[i], i < m_buffers_aliased.size() && m_buffers_aliased[i].aliased);
+
+    for (size_t i = 0; i < uniforms.doubleBuffers.size(); i++) {
+        addFbo("u_doubleBuffer" + vera::toString(i) + "[0]", uniforms.doubleBuffers[i]->buffer(0), false);
+        addFbo("u_doubleBuffer" + vera::toString(i) + "[1]", uniforms.doubleBuffers[i]->buffer(1), false);
+    }
+
+    for (size_t i = 0; i < m_pyramid_sizes.size(); i++) {
+        glm::ivec2 size = _pyramidSize(i);
+        add("u_pyramid" + vera::toString(i) + " input", size.x, size.y, vera::COLOR_FLOAT_TEXTURE, true);
+    }
+
+    for (size_t i = 0; i < uniforms.floods.size(); i++) {
+        addFbo("u_flood" + vera::toString(i) + " src", *uniforms.floods[i].src, false);
+        addFbo("u_flood" + vera::toString(i) + " dst", *uniforms.floods[i].dst, false);
+    }
+
+    addFbo("u_scene", m_sceneRender.renderFbo, false);
+    addFbo("u_sceneNormal", m_sceneRender.normalFbo, false);
+    addFbo("u_scenePosition", m_sceneRender.positionFbo, false);
+    for (size_t i = 0; i < m_sceneRender.buffersFbo.size(); i++)
+        addFbo("u_sceneBuffer" + vera::toString(i), *m_sceneRender.buffersFbo[i], false);
+
+    addFbo("record", m_record_fbo, false);
+    addFbo("record yuv", m_record_yuv_fbo, false);
+
+    m_vram_peak = std::max(m_vram_peak, _aliased);
+    m_vram_peak_unaliased = std::max(m_vram_peak_unaliased, _unaliased);
+
+    if (_print) {
+        const double mb = 1024.0 * 1024.0;
+        std::cout << "// MB with aliasing, without aliasing, peak with aliasing, peak without aliasing" << std::endl;
+        std::cout << double(_aliased) / mb << "," << double(_unaliased) / mb << "," << double(m_vram_peak) / mb << "," << double(m_vram_peak_unaliased) / mb << std::endl;
+    }
 }
 
 void GlslViewer::renderPrep() {
     TRACK_BEGIN("render")
 
+    // COMMANDS sent from the console, OSC, etc. since the last frame
+    // -----------------------------------------------
+    if (!commandQueue.empty()) {
+        TRACK_BEGIN("render:commands")
+        commandQueue.drain();
+        TRACK_END("render:commands")
+
+        if (uniforms.tracker.isRunning()) {
+            uniforms.tracker.setCounter("commands:executed", commandQueue.getFrameExecuted());
+            uniforms.tracker.setCounter("commands:latency_ms", commandQueue.getFrameLatencyMs());
+            uniforms.tracker.setCounter("commands:pending", commandQueue.size());
+        }
+    }
+
     updateCameraTransition();
     updateCameraAnimation();
 
@@ -2417,14 +2941,17 @@ void GlslViewer::renderPrep() {
         if (!m_record_fbo.isAllocated())
             m_record_fbo.allocate(vera::getWindowWidth(), vera::getWindowHeight(), vera::COLOR_TEXTURE_DEPTH_BUFFER);
 
-    if (uniforms.functions["u_sceneNormal"].present)
-        m_sceneRender.renderNormalBuffer(uniforms);
+    // The G-buffers in a single pass when the shader writes them all at once, one pass each otherwise
+    if (!m_sceneRender.renderGBuffer(uniforms)) {
+        if (uniforms.isPresent(UNIFORM_ID_SCENE_NORMAL))
+            m_sceneRender.renderNormalBuffer(uniforms);
 
-    if (uniforms.functions["u_scenePosition"].present)
-        m_sceneRender.renderPositionBuffer(uniforms);
+        if (uniforms.isPresent(UNIFORM_ID_SCENE_POSITION))
+            m_sceneRender.renderPositionBuffer(uniforms);
 
-    if (m_sceneRender.getBuffersTotal() != 0)
-        m_sceneRender.renderBuffers(uniforms);
+        if (m_sceneRender.getBuffersTotal() != 0)
+            m_sceneRender.renderBuffers(uniforms);
+    }
 
     if (m_postprocessing || m_plot == PLOT_LUMA || m_plot == PLOT_RGB || m_plot == PLOT_RED || m_plot == PLOT_GREEN || m_plot == PLOT_BLUE ) {
         m_sceneRender.renderFbo.bind();
@@ -2460,6 +2987,7 @@ void GlslViewer::render() {
                 uniforms.set("u_viewport", float(viewport.x), float(viewport.y), float(viewport.z), float(viewport.w));
 
                 // Update Uniforms and textures variables
+                uniforms.blockView(glm::mat4(1.0f), glm::mat4(1.0f));
                 uniforms.feedTo( &m_canvas_shader );
 
                 // Pass special uniforms
@@ -2469,11 +2997,13 @@ void GlslViewer::render() {
                 m_canvas_shader.setUniform("u_projectionMatrix", glm::mat4(1.0f));
                 m_canvas_shader.setUniform("u_modelViewProjectionMatrix", glm::mat4(1.));
                 vera::billboard()->render( &m_canvas_shader );
+                uniforms.blockReset();
             }, quilt_tile, true);
         }
 
         else {
             // Update Uniforms and textures variables
+            uniforms.blockView(glm::mat4(1.0f), glm::mat4(1.0f));
             uniforms.feedTo( &m_canvas_shader );
 
             // Pass special uniforms
@@ -2483,6 +3013,7 @@ void GlslViewer::render() {
             m_canvas_shader.setUniform("u_projectionMatrix", glm::mat4(1.0f));
             m_canvas_shader.setUniform("u_modelViewProjectionMatrix", glm::mat4(1.));
             vera::billboard()->render( &m_canvas_shader );
+            uniforms.blockReset();
         }
 
         TRACK_END("render:2D_scene")
@@ -2495,6 +3026,7 @@ void GlslViewer::render() {
 
                 // set up the camera rotation and position for current view
                 uniforms.activeCamera->setVirtualOffset(m_sceneRender.getArea() * 0.75, viewIndex, quilt.totalViews);
+                uniforms.blockUpdate();
 
                 uniforms.set("u_tile", float(quilt.columns), float(quilt.rows), float(quilt.totalViews));
                 uniforms.set("u_viewport", float(viewport.x), float(viewport.y), float(viewport.z), float(viewport.w));
@@ -2716,11 +3248,11 @@ void GlslViewer::renderUI() {
         nTotal += uniforms.floods.size();
         if (uniforms.models.size() > 0 ) {
             nTotal += 1;
-            nTotal += uniforms.functions["u_scene"].present;
-            nTotal += uniforms.functions["u_sceneDepth"].present;
+            nTotal += uniforms.isPresent(UNIFORM_ID_SCENE);
+            nTotal += uniforms.isPresent(UNIFORM_ID_SCENE_DEPTH);
         }
-        nTotal += uniforms.functions["u_sceneNormal"].present;
-        nTotal += uniforms.functions["u_scenePosition"].present;
+        nTotal += uniforms.isPresent(UNIFORM_ID_SCENE_NORMAL);
+        nTotal += uniforms.isPresent(UNIFORM_ID_SCENE_POSITION);
         nTotal += m_sceneRender.getBuffersTotal();
 
         if (nTotal > 0) {
@@ -2836,7 +3368,7 @@ void GlslViewer::renderUI() {
             // pyramids/floods loops above) instead of the old xStep==yStep,
             // which forced every one of these to a square regardless of the
             // window's actual shape.
-            if (uniforms.functions["u_scenePosition"].present) {
+            if (uniforms.isPresent(UNIFORM_ID_SCENE_POSITION)) {
                 glm::vec2 scale(yStep * ((float)m_sceneRender.positionFbo.getWidth() / (float)m_sceneRender.positionFbo.getHeight()), yStep);
                 float x = xOffset + xStep - scale.x;
                 vera::image(&m_sceneRender.positionFbo, x, yOffset, scale.x, scale.y);
@@ -2846,7 +3378,7 @@ void GlslViewer::renderUI() {
                 yOffset -= yStep * 2.0;
             }
 
-            if (uniforms.functions["u_sceneNormal"].present) {
+            if (uniforms.isPresent(UNIFORM_ID_SCENE_NORMAL)) {
                 glm::vec2 scale(yStep * ((float)m_sceneRender.normalFbo.getWidth() / (float)m_sceneRender.normalFbo.getHeight()), yStep);
                 float x = xOffset + xStep - scale.x;
                 vera::image(&m_sceneRender.normalFbo, x, yOffset, scale.x, scale.y);
@@ -2862,7 +3394,7 @@ void GlslViewer::renderUI() {
                 yOffset -= yStep * 2.0;
             }
 
-            if (uniforms.functions["u_scene"].present) {
+            if (uniforms.isPresent(UNIFORM_ID_SCENE)) {
                 glm::vec2 scale(yStep * ((float)m_sceneRender.renderFbo.getWidth() / (float)m_sceneRender.renderFbo.getHeight()), yStep);
                 float x = xOffset + xStep - scale.x;
                 vera::image(&m_sceneRender.renderFbo, x, yOffset, scale.x, scale.y);
@@ -2870,7 +3402,7 @@ void GlslViewer::renderUI() {
                 yOffset -= yStep * 2.0;
             }
 
-            if (uniforms.functions["u_sceneDepth"].present) {
+            if (uniforms.isPresent(UNIFORM_ID_SCENE_DEPTH)) {
                 glm::vec2 scale(yStep * ((float)m_sceneRender.renderFbo.getWidth() / (float)m_sceneRender.renderFbo.getHeight()), yStep);
                 float x = xOffset + xStep - scale.x;
                 vera::fill(0.0);
@@ -3045,15 +3577,35 @@ void GlslViewer::renderDone() {
 
     // RECORD
     if (isRecording()) {
-        onScreenshot( vera::toString( getRecordingCount() , 0, 5, '0') + ".png");
+        onScreenshot( vera::toString( getRecordingIndex() , 0, 5, '0') + ".png");
+
+        // Deliver the frames still in flight before the sequence gets closed
+        if (recordingLastFrame())
+            onRecordingEnd();
+
         recordingFrameAdded();
     }
     // SCREENSHOT 
     else if (screenshotFile != "") {
-        onScreenshot(screenshotFile);
+        if (screenshotWidth > 0 && screenshotHeight > 0)
+            onScreenshotTiled(screenshotFile, screenshotWidth, screenshotHeight, screenshotTiles);
+        else
+            onScreenshot(screenshotFile);
         screenshotFile = "";
+        screenshotWidth = screenshotHeight = screenshotTiles = 0;
     }
 
+    if (uniforms.tracker.isRunning()) {
+        uniforms.tracker.setCounter("frame_pool:allocations", m_frame_pool.getAllocations());
+        uniforms.tracker.setCounter("frame_pool:reuses", m_frame_pool.getReuses());
+        uniforms.tracker.setCounter("frame_pool:in_use", m_frame_pool.getInUse());
+        uniforms.tracker.setCounter("frame_pool:high_water", m_frame_pool.getHighWater());
+        uniforms.tracker.setCounter("frame_pool:idle_bytes", m_frame_pool.getIdleBytes());
+    }
+
+    // Times feeding uniforms once all the shaders of a frame are known
+    uniforms.benchmarkRun();
+
     vera::resetChange();
     uniforms.resetChange();
     m_change_viewport = false;
@@ -3149,6 +3701,7 @@ void GlslViewer::onFileChange(WatchFileList &_files, int index) {
 
     vera::flagChange();
     uniforms.flagChange();
+    wakeup.signal();
 }
 
 void GlslViewer::onScroll(float _yoffset) {
@@ -3380,6 +3933,11 @@ void GlslViewer::onWindowResize(int _newWidth, int _newHeight) {
     int physWidth = vera::getWindowWidth();
     int physHeight = vera::getWindowHeight();
 
+    // The shared targets get sized again when the graph is rebuilt
+    _unaliasTargets();
+    m_targets.clear();
+    m_graph.invalidate();
+
     for (size_t i = 0; i < uniforms.buffers.size(); i++)
         if (uniforms.buffers[i]->scale > 0.0)
             uniforms.buffers[i]->allocate(  physWidth * uniforms.buffers[i]->scale,
@@ -3397,14 +3955,10 @@ void GlslViewer::onWindowResize(int _newWidth, int _newHeight) {
         }
     }
 
-    for (size_t i = 0; i < uniforms.pyramids.size(); i++) {
-        if (m_pyramid_fbos[i].scale > 0.0) {
-            m_pyramid_fbos[i].allocate( physWidth * m_pyramid_fbos[i].scale,
-                                        physHeight * m_pyramid_fbos[i].scale,
-                                        vera::COLOR_FLOAT_TEXTURE);
-
-            uniforms.pyramids[i].allocate(  physWidth * m_pyramid_fbos[i].scale,
-                                            physHeight * m_pyramid_fbos[i].scale);
+    for (size_t i = 0; i < uniforms.pyramids.size() && i < m_pyramid_sizes.size(); i++) {
+        if (m_pyramid_sizes[i].z > 0.0) {
+            glm::ivec2 size = _pyramidSize(i);
+            uniforms.pyramids[i].allocate(size.x, size.y);
         }
     }
 
@@ -3439,52 +3993,72 @@ void GlslViewer::onScreenshot(std::string _file) {
         glBindFramebuffer(GL_FRAMEBUFFER, m_record_fbo.getId());
 
         if (vera::getExt(_file) == "hdr") {
-            float* pixels = new float[vera::getWindowWidth() * vera::getWindowHeight()*4];
-            glReadPixels(0, 0, vera::getWindowWidth(), vera::getWindowHeight(), GL_RGBA, GL_FLOAT, pixels);
-            vera::savePixelsFloat(_file, pixels, vera::getWindowWidth(), vera::getWindowHeight());
-        }
-        #if defined(SUPPORT_LIBAV) && !defined(PLATFORM_RPI)
-        else if (recordingPipe()) {
             int width = vera::getWindowWidth();
             int height = vera::getWindowHeight();
-            auto pixels = std::unique_ptr<unsigned char[]>(new unsigned char [width * height * 3]);
-            glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.get());
-            recordingPipeFrame( std::move(pixels) );
+            FramePtr pixels = m_frame_pool.get(width * height * 4 * sizeof(float));
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, pixels.get());
+            vera::savePixelsFloat(_file, (float*)pixels.get(), width, height);
         }
-        #endif
         else {
             int width = vera::getWindowWidth();
             int height = vera::getWindowHeight();
-            auto pixels = std::unique_ptr<unsigned char[]>(new unsigned char [width * height * 4]);
-            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.get());
-
-            #if defined(SUPPORT_MULTITHREAD_RECORDING) && !defined(PYTHON_RENDER)
-            std::shared_ptr<Job> saverPtr = std::make_shared<Job>(std::move(_file), width, height, std::move(pixels), m_task_count, m_max_mem_in_queue);
-            /** In the case that we render faster than we can safe frames, more and more frames
-             * have to be stored temporary in the save queue. That means that more and more ram is used.
-             * If to much is memory is used, we save the current frame directly to prevent that the system
-             * is running out of memory. Otherwise we put the frame in to the thread queue, so that we can utilize
-             * multilple cpu cores */
-            if (m_max_mem_in_queue <= 0) {
-                Job& saver = *saverPtr;
-                saver();
-            }
-            else {
-                auto func = [saverPtr]() {
-                    Job& saver = *saverPtr;
-                    saver();
-                };
-                m_save_threads.Submit(std::move(func));
+            int channels = 4;
+
+            #if defined(SUPPORT_LIBAV) && !defined(PLATFORM_RPI)
+            bool pipe = recordingPipe();
+            if (pipe) {
+                channels = 3;
+
+                // Convert on the GPU and read the YUV planes packed as RGBA texels
+                RecordingPixelFormat pix_fmt = recordingPipePixelFormat();
+                if (pix_fmt != PIX_FMT_RGB24) {
+                    _renderRecordYUV(pix_fmt == PIX_FMT_NV12);
+                    glBindFramebuffer(GL_FRAMEBUFFER, m_record_yuv_fbo.getId());
+                    width = m_record_yuv_fbo.getWidth();
+                    height = m_record_yuv_fbo.getHeight();
+                    channels = 4;
+                }
             }
             #else
-
-            vera::savePixels(_file, pixels.get(), width, height);
-            if (vera::getExt(_file) == "png" || 
-                vera::getExt(_file) == "jpg" || vera::getExt(_file) == "jpeg")
-                m_postprocessing_shader.addDefinesTo(_file);
-            
+            bool pipe = false;
             #endif
 
+            #if defined(SUPPORT_ASYNC_READBACK)
+            if (isRecording() && m_record_readback_size > 0) {
+                // Frames leave the ring in order once the GPU is done with them, usually a few frames later
+                m_record_readback.allocate(width, height, channels, m_record_readback_size);
+                m_record_readback.read(_file, [this, pipe, channels](const std::string& _f, const unsigned char* _pixels, int _w, int _h) {
+                    size_t size = (size_t)_w * _h * channels;
+                    FramePtr pixels = m_frame_pool.get(size);
+                    memcpy(pixels.get(), _pixels, size);
+
+                    #if defined(SUPPORT_LIBAV) && !defined(PLATFORM_RPI)
+                    if (pipe) {
+                        recordingPipeFrame( std::move(pixels) );
+                        return;
+                    }
+                    #endif
+                    _savePixels(_f, std::move(pixels), _w, _h);
+                });
+            }
+            else
+            #endif
+            {
+                FramePtr pixels = m_frame_pool.get(width * height * channels);
+
+                GLint alignment;
+                glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+                glPixelStorei(GL_PACK_ALIGNMENT, 1);
+                glReadPixels(0, 0, width, height, (channels == 3)? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, pixels.get());
+                glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+
+                #if defined(SUPPORT_LIBAV) && !defined(PLATFORM_RPI)
+                if (pipe)
+                    recordingPipeFrame( std::move(pixels) );
+                else
+                #endif
+                    _savePixels(_file, std::move(pixels), width, height);
+            }
         }
     
         if ( !isRecording() )
@@ -3499,68 +4073,239 @@ void GlslViewer::onScreenshot(std::string _file) {
     }
 }
 
-void GlslViewer::onPlot() {
-    // if ( !vera::isGL() )
-    //     return;
-    if (!m_sceneRender.renderFbo.isAllocated())
+// Waits for the frames of a recording still in the readback ring and hands them to the
+// pipe or the disk. Must run before the pipe closes, on every path that ends a recording.
+void GlslViewer::onRecordingEnd() {
+    #if defined(SUPPORT_ASYNC_READBACK)
+    if (m_record_readback.getPending() > 0)
+        m_record_readback.flush();
+    #endif
+}
+
+// Renders a _width x _height still in _tiles x _tiles pieces, each through its own crop of the
+// projection, and streams them to disk. Only one tile lives in VRAM and (for TGA) in RAM.
+void GlslViewer::onScreenshotTiled(const std::string& _file, int _width, int _height, int _tiles) {
+    #if !defined(PYTHON_RENDER)
+    if (!vera::isGL())
+        return;
+    #endif
+
+    if (!TiledImageWriter::isSupported(_file)) {
+        std::cerr << "Tiled screenshots can only be saved as PNG or TGA" << std::endl;
         return;
+    }
 
-    if ( (m_plot == PLOT_LUMA || m_plot == PLOT_RGB || m_plot == PLOT_RED || m_plot == PLOT_GREEN || m_plot == PLOT_BLUE ) && haveChange() ) {
-        TRACK_BEGIN("plot::histogram")
+    int windowWidth = vera::getWindowWidth();
+    int windowHeight = vera::getWindowHeight();
+    if (_tiles <= 0)
+        _tiles = std::max( (_width + windowWidth - 1) / windowWidth, (_height + windowHeight - 1) / windowHeight );
+    int tileWidth = (_width + _tiles - 1) / _tiles;
+    int tileHeight = (_height + _tiles - 1) / _tiles;
+
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    if (tileWidth > maxSize || tileHeight > maxSize) {
+        std::cerr << "Tiles of " << tileWidth << "x" << tileHeight << " are bigger than GL_MAX_TEXTURE_SIZE (" << maxSize << "), use more tiles" << std::endl;
+        return;
+    }
 
+    if (m_postprocessing || uniforms.buffers.size() > 0 || uniforms.doubleBuffers.size() > 0)
+        std::cout << "Tiled screenshots only render the main pass: postprocessing is skipped and buffers keep the window resolution" << std::endl;
 
-        // Extract pixels
-        glBindFramebuffer(GL_FRAMEBUFFER, m_sceneRender.renderFbo.getId());
-        int w = vera::getWindowWidth();
-        int h = vera::getWindowHeight();
-        int c = 4;  // RGBA format (required for WebGL compatibility)
-        int total = w * h * c;
-        unsigned char* pixels = new unsigned char[total];
-        glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    TiledImageWriter image;
+    if (!image.open(_file, _width, _height))
+        return;
 
-        // Count frequencies of appearances (weighted by alpha, ignoring transparent pixels)
-        float max_rgb_freq = 0;
-        float max_luma_freq = 0;
-        glm::vec4 freqs[256];
-        for (int i = 0; i < total; i += c) {
-            // Skip fully transparent pixels
-            unsigned char alpha = pixels[i+3];
-            if (alpha == 0)
+    TRACK_BEGIN("screenshot:tiled")
+
+    // PNG tiles blend premultiplied, whatever the user had is back once they are done
+    BlendState blend;
+
+    vera::Fbo tile;
+    tile.allocate(tileWidth, tileHeight, vera::COLOR_TEXTURE_DEPTH_BUFFER);
+    FramePtr pixels = m_frame_pool.get((size_t)tileWidth * tileHeight * 4);
+
+    bool scene = uniforms.models.size() > 0 && uniforms.activeCamera;
+    bool png = vera::haveExt(_file, "png") || vera::haveExt(_file, "PNG");
+
+    // The camera keeps the vertical field of view and widens or narrows to the aspect of the still
+    glm::mat4 projection;
+    glm::mat4 aspect = glm::scale(glm::mat4(1.0f), glm::vec3( (float(windowWidth) / float(windowHeight)) / (float(_width) / float(_height)), 1.0f, 1.0f));
+    if (scene)
+        projection = uniforms.activeCamera->getProjectionMatrix();
+
+    // gl_FragCoord is relative to the tile, once for all of them it's shifted by u_tileOffset
+    // to where the tile sits in the still
+    std::string tiledSource = scene ? "" : addTileOffset(m_frag_source);
+    bool tiled = tiledSource != m_frag_source;
+    if (tiled)
+        m_canvas_shader.setSource(tiledSource, m_vert_source);
+
+    GLint alignment;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    // Rows of tiles from the top down, the order PNG wants them
+    for (int ty = _tiles - 1; ty >= 0; ty--) {
+        for (int tx = 0; tx < _tiles; tx++) {
+            int x = tx * tileWidth;
+            int y = ty * tileHeight;
+            if (x >= _width || y >= _height)
                 continue;
-            
-            // Weight contributions by alpha to properly average visible geometry
-            float alpha_weight = alpha / 255.0f;
-            
-            m_plot_values[pixels[i]].r += alpha_weight;
-            if (m_plot_values[pixels[i]].r > max_rgb_freq)
-                max_rgb_freq = m_plot_values[pixels[i]].r;
 
-            m_plot_values[pixels[i+1]].g += alpha_weight;
-            if (m_plot_values[pixels[i+1]].g > max_rgb_freq)
-                max_rgb_freq = m_plot_values[pixels[i+1]].g;
+            // Stretches this tile's share of clip space over the whole tile
+            glm::mat4 crop = glm::translate(glm::mat4(1.0f), glm::vec3( float(_width - 2 * x - tileWidth) / float(tileWidth),
+                                                                        float(_height - 2 * y - tileHeight) / float(tileHeight), 0.0f));
+            crop = glm::scale(crop, glm::vec3(float(_width) / float(tileWidth), float(_height) / float(tileHeight), 1.0f));
 
-            m_plot_values[pixels[i+2]].b += alpha_weight;
-            if (m_plot_values[pixels[i+2]].b > max_rgb_freq)
-                max_rgb_freq = m_plot_values[pixels[i+2]].b;
+            tile.bind();
+            glViewport(0, 0, tileWidth, tileHeight);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-            int luma = 0.299 * pixels[i] + 0.587 * pixels[i+1] + 0.114 * pixels[i+2];
-            m_plot_values[luma].a += alpha_weight;
-            if (m_plot_values[luma].a > max_luma_freq)
-                max_luma_freq = m_plot_values[luma].a;
+            if (png) {
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            }
+
+            if (scene) {
+                uniforms.activeCamera->setProjection(crop * aspect * projection);
+                uniforms.activeCamera->bChange = true;
+                m_sceneRender.render(uniforms);
+            }
+            else {
+                m_canvas_shader.use();
+                uniforms.invalidateBindings();
+                uniforms.blockView(glm::mat4(1.0f), glm::mat4(1.0f));
+                uniforms.blockResolution(float(_width), float(_height));
+                uniforms.feedTo( &m_canvas_shader );
+                m_canvas_shader.setUniform("u_resolution", float(_width), float(_height));
+                m_canvas_shader.setUniform("u_model", glm::vec3(1.0f));
+                m_canvas_shader.setUniform("u_modelMatrix", glm::mat4(1.0f));
+                m_canvas_shader.setUniform("u_viewMatrix", glm::mat4(1.0f));
+                m_canvas_shader.setUniform("u_projectionMatrix", glm::mat4(1.0f));
+                m_canvas_shader.setUniform("u_modelViewProjectionMatrix", crop);
+                if (tiled)
+                    m_canvas_shader.setUniform("u_tileOffset", float(x), float(y));
+                vera::billboard()->render( &m_canvas_shader );
+                uniforms.blockReset();
+            }
+
+            int width = std::min(tileWidth, _width - x);
+            int height = std::min(tileHeight, _height - y);
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.get());
+            tile.unbind();
+
+            image.addTile(x, y, width, height, pixels.get());
         }
-        delete[] pixels;
+    }
 
-        // Normalize frequencies
-        for (int i = 0; i < 256; i ++)
-            m_plot_values[i] = m_plot_values[i] / glm::vec4(max_rgb_freq, max_rgb_freq, max_rgb_freq, max_luma_freq);
+    glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+    glViewport(0, 0, windowWidth, windowHeight);
 
-        if (m_plot_texture == nullptr)
-            m_plot_texture = new vera::Texture();
-        m_plot_texture->load(256, 1, 4, 32, &m_plot_values[0], vera::NEAREST, vera::CLAMP);
+    if (scene) {
+        uniforms.activeCamera->setProjection(projection);
+        uniforms.activeCamera->bChange = true;
+    }
+    else {
+        if (tiled)
+            m_canvas_shader.setSource(m_frag_source, m_vert_source);
+        uniforms.invalidateBindings();
+    }
+
+    if (image.close())
+        std::cout << "Screenshot saved to " << _file << " (" << _width << "x" << _height << " in " << _tiles * _tiles << " tiles)" << std::endl;
+
+    TRACK_END("screenshot:tiled")
+}
+
+// Packs the record FBO into YUV planes for the ffmpeg pipe (see record_yuv_frag)
+void GlslViewer::_renderRecordYUV(bool _nv12) {
+    int width = vera::getWindowWidth();
+    int height = vera::getWindowHeight();
+
+    if (!m_record_yuv_fbo.isAllocated() ||
+        m_record_yuv_fbo.getWidth() != width / 4 || m_record_yuv_fbo.getHeight() != height * 3 / 2) {
+        m_record_yuv_shader.setSource(record_yuv_frag, vera::getDefaultSrc(vera::VERT_BILLBOARD));
+        m_record_yuv_fbo.allocate(width / 4, height * 3 / 2, vera::COLOR_TEXTURE);
+    }
+
+    TRACK_BEGIN("screenshot:yuv")
+    BlendState blend;
+    glDisable(GL_BLEND);
+
+    m_record_yuv_fbo.bind();
+    m_record_yuv_shader.use();
+    m_record_yuv_shader.setUniformTexture("u_tex0", &m_record_fbo, 0);
+    m_record_yuv_shader.setUniform("u_resolution", float(width), float(height));
+    m_record_yuv_shader.setUniform("u_nv12", _nv12 ? 1.0f : 0.0f);
+    vera::billboard()->render( &m_record_yuv_shader );
+    m_record_yuv_fbo.unbind();
+
+    TRACK_END("screenshot:yuv")
+}
+
+void GlslViewer::_savePixels(const std::string& _file, FramePtr&& _pixels, int _width, int _height) {
+    #if defined(SUPPORT_MULTITHREAD_RECORDING) && !defined(PYTHON_RENDER)
+    std::shared_ptr<Job> saverPtr = std::make_shared<Job>(_file, _width, _height, std::move(_pixels), m_task_count, m_max_mem_in_queue);
+    /** In the case that we render faster than we can safe frames, more and more frames
+     * have to be stored temporary in the save queue. That means that more and more ram is used.
+     * If to much is memory is used, we save the current frame directly to prevent that the system
+     * is running out of memory. Otherwise we put the frame in to the thread queue, so that we can utilize
+     * multilple cpu cores */
+    if (m_max_mem_in_queue <= 0) {
+        Job& saver = *saverPtr;
+        saver();
+    }
+    else {
+        auto func = [saverPtr]() {
+            Job& saver = *saverPtr;
+            saver();
+        };
+        m_save_threads.Submit(std::move(func));
+    }
+    #else
 
-        uniforms.textures["u_plotData"] = m_plot_texture;
-        uniforms.flagChange();
+    vera::savePixels(_file, _pixels.get(), _width, _height);
+    if (vera::getExt(_file) == "png" || 
+        vera::getExt(_file) == "jpg" || vera::getExt(_file) == "jpeg")
+        m_postprocessing_shader.addDefinesTo(_file);
+    
+    #endif
+}
+
+void GlslViewer::onPlot() {
+    // if ( !vera::isGL() )
+    //     return;
+    if (!m_sceneRender.renderFbo.isAllocated())
+        return;
+
+    if ( (m_plot == PLOT_LUMA || m_plot == PLOT_RGB || m_plot == PLOT_RED || m_plot == PLOT_GREEN || m_plot == PLOT_BLUE ) && (haveChange() || m_plot_histogram.isPending()) ) {
+        TRACK_BEGIN("plot::histogram")
+
+        // Bins arrive asynchronously (a frame or two later on the GPU path)
+        if (m_plot_histogram.update(m_sceneRender.renderFbo)) {
+            const glm::vec4* bins = m_plot_histogram.getBins();
+
+            float max_rgb_freq = 0;
+            float max_luma_freq = 0;
+            for (int i = 0; i < 256; i++) {
+                max_rgb_freq = std::max(max_rgb_freq, std::max(bins[i].r, std::max(bins[i].g, bins[i].b)));
+                max_luma_freq = std::max(max_luma_freq, bins[i].a);
+            }
+            max_rgb_freq = std::max(max_rgb_freq, 1e-6f);
+            max_luma_freq = std::max(max_luma_freq, 1e-6f);
+
+            // Normalize frequencies
+            for (int i = 0; i < 256; i ++)
+                m_plot_values[i] = bins[i] / glm::vec4(max_rgb_freq, max_rgb_freq, max_rgb_freq, max_luma_freq);
+
+            if (m_plot_texture == nullptr)
+                m_plot_texture = new vera::Texture();
+            m_plot_texture->load(256, 1, 4, 32, &m_plot_values[0], vera::NEAREST, vera::CLAMP);
+
+            uniforms.textures["u_plotData"] = m_plot_texture;
+            uniforms.flagChange();
+        }
         TRACK_END("plot::histogram")
     }
 
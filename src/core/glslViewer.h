@@ -10,6 +10,13 @@
 
 #include "sceneRender.h"
 #include "tools/files.h"
+#include "tools/commandQueue.h"
+#include "tools/framePool.h"
+#include "tools/wakeup.h"
+#include "tools/histogram.h"
+#include "tools/readback.h"
+#include "tools/renderGraph.h"
+#include "tools/renderTargets.h"
 #include "vera/ops/string.h"
 
 enum ShaderType {
@@ -53,6 +60,12 @@ public:
 
     bool                haveChange();
 
+    // Commands from other threads, run at the start of renderPrep()
+    CommandQueue        commandQueue;
+
+    // Wakes up the idle main loop (commands, OSC, file changes) and times them to the screen
+    Wakeup              wakeup;
+
     void                renderPrep();
     void                render();
     void                renderPost();
@@ -78,6 +91,8 @@ public:
     void                onWindowResize( int _newWidth, int _newHeight );
     void                onFileChange( WatchFileList &_files, int _index );
     void                onScreenshot( std::string _file );
+    void                onScreenshotTiled( const std::string& _file, int _width, int _height, int _tiles = 0 );
+    void                onRecordingEnd();
     void                onPlot();
    
     // Include folders
@@ -88,6 +103,9 @@ public:
 
     // Screenshot file
     std::string         screenshotFile;
+    int                 screenshotWidth;        // when set (with the height) the screenshot is rendered in tiles
+    int                 screenshotHeight;
+    int                 screenshotTiles;        // tiles per side, 0 to fit each one in the window
 
     // Quilt/Lenticular
     std::string         lenticular;
@@ -108,6 +126,14 @@ public:
 protected:
     void                _updateBuffers();
     void                _renderBuffers();
+    bool                _renderPass(PassType _type, size_t _index, bool& _resetViewport);
+    void                _buildGraph();
+    void                _aliasTargets();
+    void                _unaliasTargets();
+    glm::ivec2          _pyramidSize(size_t _index) const;
+    void                _vram(size_t& _aliased, size_t& _unaliased, bool _print);
+    void                _savePixels(const std::string& _file, FramePtr&& _pixels, int _width, int _height);
+    void                _renderRecordYUV(bool _nv12);
 
     // Geometry files whose reload was requested from the file-watcher thread.
     // GL resources (VBOs, shaders, textures) can only be touched on the render
@@ -132,7 +158,8 @@ protected:
     int                 m_doubleBuffers_total;
 
     // Pyramids
-    FboList             m_pyramid_fbos;
+    std::vector<glm::vec3>  m_pyramid_sizes;        // of their inputs, as getBufferSize() gives them
+    std::vector<vera::Fbo*> m_pyramid_targets;      // inputs assigned by _aliasTargets(), or none
     ShaderList          m_pyramid_subshaders;
     vera::Shader        m_pyramid_shader;
     int                 m_pyramid_total;
@@ -142,6 +169,23 @@ protected:
     vera::Shader        m_flood_shader;
     int                 m_flood_total;
 
+    // Order of all the passes above and which ones can be skipped this frame
+    RenderGraph         m_graph;
+    bool                m_graph_skip;
+
+    // Targets of the passes that don't need to keep them from one frame to the next, shared by
+    // the ones that are not alive at the same time (see _aliasTargets)
+    struct AliasedBuffer {
+        bool            aliased = false;
+        float           scale   = 0.0f;     // to allocate its own target again
+    };
+    RenderTargets               m_targets;
+    std::vector<AliasedBuffer>  m_buffers_aliased;
+    bool                        m_aliased;
+    bool                        m_aliasing;
+    size_t                      m_vram_peak;
+    size_t                      m_vram_peak_unaliased;
+
     // A. CANVAS
     vera::Shader        m_canvas_shader;
 
@@ -159,15 +203,23 @@ protected:
     vera::Shader                    m_plot_shader;
     vera::Texture*                  m_plot_texture;
     glm::vec4                       m_plot_values[256];
+    Histogram                       m_plot_histogram;
     PlotType                        m_plot;
 
     // Recording
     vera::Fbo                       m_record_fbo;
+    vera::Fbo                       m_record_yuv_fbo;       // YUV planes packed 4 bytes per RGBA texel
+    vera::Shader                    m_record_yuv_shader;
+    FramePool                       m_frame_pool;
     #if defined(SUPPORT_MULTITHREAD_RECORDING)
     std::atomic<int>                m_task_count {0};
     std::atomic<long long>          m_max_mem_in_queue {0};
     thread_pool::ThreadPool         m_save_threads;
     #endif
+    #if defined(SUPPORT_ASYNC_READBACK)
+    PixelReadback                   m_record_readback;
+    int                             m_record_readback_size;
+    #endif
 
     // Other state properties
     glm::mat3                       m_view2d;
@@ -7,6 +7,7 @@
 
 #include <sys/stat.h>
 #include <random>
+#include <algorithm>
 
 #include "vera/ops/fs.h"
 #include "vera/ops/draw.h"
@@ -19,6 +20,7 @@
 #include "vera/xr/xr.h"
 
 #include "tools/text.h"
+#include "tools/frustum.h"
 
 
 #if defined(DEBUG)
@@ -39,18 +41,32 @@ SceneRender::SceneRender():
     // Camera.
     m_blend(vera::BLEND_ALPHA), m_culling(vera::CULL_NONE), m_depth_test(true),
     // Light
-    dynamicShadows(false), m_shadows(false),
+    dynamicShadows(false), frustumCulling(false), sortDraws(true), m_shadows(false),
     // Background
     m_background(false), 
     // Floor
     m_floor_height(0.0), m_floor_subd_target(-1), m_floor_subd(-1),
 
-    m_buffers_total(0), m_commands_loaded(false), m_uniforms_loaded(false)
+    m_buffers_total(0),
+    // G-buffer
+    m_gbuffer(false), m_gbuffer_normal(false), m_gbuffer_position(false), m_gbuffer_complete(false), m_gbuffer_outputs(0),
+    m_gbuffer_fbo(0), m_gbuffer_depth(0), m_gbuffer_width(0), m_gbuffer_height(0),
+    // Draw queue
+    m_programs_source(0), m_programs_stamp(0), m_draws(0), m_programs(0),
+
+    m_commands_loaded(false), m_uniforms_loaded(false)
     {
     m_origin.setPosition(glm::vec3(0.0));
+
+    for (size_t i = 0; i < SCENE_PASS_TOTAL; i++) {
+        m_drawn[i] = 0;
+        m_culled[i] = 0;
+    }
 }
 
 SceneRender::~SceneRender() {
+    if (m_gbuffer_fbo != 0)
+        glDeleteFramebuffers(1, &m_gbuffer_fbo);
 }
 
 void SceneRender::commandsInit(CommandList& _commands, Uniforms& _uniforms) {
@@ -321,6 +337,54 @@ void SceneRender::commandsInit(CommandList& _commands, Uniforms& _uniforms) {
             return false;
         },
         "bboxes[,on|off]", "show/hide models bounding boxes"));
+
+        _commands.push_back(Command("frustum_culling", [&](const std::string& _line){
+            if (_line == "frustum_culling") {
+                std::string rta = frustumCulling ? "on" : "off";
+                std::cout << rta << std::endl; 
+                return true;
+            }
+            else {
+                std::vector<std::string> values = vera::split(_line,',');
+                if (values.size() == 2) {
+                    if (values[1] == "stats")
+                        printCulling();
+                    else {
+                        if (values[1] == "toggle")
+                            values[1] = frustumCulling ? "off" : "on";
+                        frustumCulling = values[1] == "on";
+                    }
+                    return true;
+                }
+            }
+            return false;
+        },
+        "frustum_culling[,on|off|stats]", "skip the models out of the camera (or light) frustum, or print how many each pass drew and culled"));
+
+        _commands.push_back(Command("sort_draws", [&](const std::string& _line){
+            if (_line == "sort_draws") {
+                std::string rta = sortDraws ? "on" : "off";
+                std::cout << rta << std::endl; 
+                return true;
+            }
+            else {
+                std::vector<std::string> values = vera::split(_line,',');
+                if (values.size() == 2) {
+                    if (values[1] == "stats") {
+                        std::cout << "// draws, program switches" << std::endl;
+                        std::cout << m_draws << "," << m_programs << std::endl;
+                    }
+                    else {
+                        if (values[1] == "toggle")
+                            values[1] = sortDraws ? "off" : "on";
+                        sortDraws = values[1] == "on";
+                    }
+                    return true;
+                }
+            }
+            return false;
+        },
+        "sort_draws[,on|off|stats]", "sort the opaque models by program, material and depth, or print the draw calls and program switches of the last scene render"));
         m_commands_loaded = true;
     }
 }
@@ -329,30 +393,30 @@ void SceneRender::uniformsInit(Uniforms& _uniforms) {
     if (!m_uniforms_loaded) {
         // ADD UNIFORMS
         //
-        _uniforms.functions["u_area"] = UniformFunction("float", [this](vera::Shader& _shader) {
+        _uniforms.setFunction("u_area", UniformFunction("float", [this](vera::Shader& _shader) {
             _shader.setUniform("u_area", m_area);
         },
-        [this]() { return vera::toString(m_area); });
+        [this]() { return vera::toString(m_area); }));
 
-        _uniforms.functions["u_scene"] = UniformFunction("sampler2D", [this](vera::Shader& _shader) {
+        _uniforms.setFunction("u_scene", UniformFunction("sampler2D", [this](vera::Shader& _shader) {
             if (renderFbo.getTextureId())
                 _shader.setUniformTexture("u_scene", &renderFbo, _shader.textureIndex++ );
-        });
+        }));
 
-        _uniforms.functions["u_sceneDepth"] = UniformFunction("sampler2D", [this](vera::Shader& _shader) {
+        _uniforms.setFunction("u_sceneDepth", UniformFunction("sampler2D", [this](vera::Shader& _shader) {
             if (renderFbo.getTextureId())
                 _shader.setUniformDepthTexture("u_sceneDepth", &renderFbo, _shader.textureIndex++ );
-        });
+        }));
 
-        _uniforms.functions["u_sceneNormal"] = UniformFunction("sampler2D", [this](vera::Shader& _shader) {
+        _uniforms.setFunction("u_sceneNormal", UniformFunction("sampler2D", [this](vera::Shader& _shader) {
             if (normalFbo.getTextureId())
                 _shader.setUniformTexture("u_sceneNormal", &normalFbo, _shader.textureIndex++ );
-        });
+        }));
 
-        _uniforms.functions["u_scenePosition"] = UniformFunction("sampler2D", [this](vera::Shader& _shader) {
+        _uniforms.setFunction("u_scenePosition", UniformFunction("sampler2D", [this](vera::Shader& _shader) {
             if (positionFbo.getTextureId())
                 _shader.setUniformTexture("u_scenePosition", &positionFbo, _shader.textureIndex++ );
-        });
+        }));
 
         // SSAO data (https://learnopengl.com/Advanced-Lighting/SSAO)
         //
@@ -371,9 +435,9 @@ void SceneRender::uniformsInit(Uniforms& _uniforms) {
             m_ssaoSamples[i] = sample;
         }
 
-        _uniforms.functions["u_ssaoSamples"] = UniformFunction("vec3", [this](vera::Shader& _shader) {
+        _uniforms.setFunction("u_ssaoSamples", UniformFunction("vec3", [this](vera::Shader& _shader) {
             _shader.setUniform("u_ssaoSamples", m_ssaoSamples, 64 );
-        });
+        }));
 
         for (size_t i = 0; i < 16; i++) {
             m_ssaoNoise[i] = glm::vec3( randomFloats(generator) * 2.0 - 1.0, 
@@ -381,9 +445,9 @@ void SceneRender::uniformsInit(Uniforms& _uniforms) {
                                         0.0f );
         }
 
-        _uniforms.functions["u_ssaoNoise"] = UniformFunction("vec3", [this](vera::Shader& _shader) {
+        _uniforms.setFunction("u_ssaoNoise", UniformFunction("vec3", [this](vera::Shader& _shader) {
             _shader.setUniform("u_ssaoNoise", m_ssaoNoise, 16 );
-        });
+        }));
         m_uniforms_loaded = false;
     }
 }
@@ -471,6 +535,7 @@ bool SceneRender::loadScene(Uniforms& _uniforms) {
     }
     m_lightUI_shader.setSource(vera::getDefaultSrc(vera::FRAG_LIGHT), vera::getDefaultSrc(vera::VERT_LIGHT));
 
+    _uniforms.invalidateBindings();
     return true;
 }
 
@@ -479,6 +544,8 @@ bool SceneRender::clearScene() {
     m_floor_subd = -1;
     m_floor_height = 0.0;
     m_origin.setPosition(glm::vec3(0.0f, 0.0f, 0.0f));
+    m_programs_shared.clear();
+    m_programs_keys.clear();
     return true;
 }
 
@@ -498,6 +565,35 @@ void SceneRender::setShaders(Uniforms& _uniforms, const std::string& _fragmentSh
     m_buffers_total = std::max( countSceneBuffers(_vertexShader), 
                                 countSceneBuffers(_fragmentShader) );
 
+    // Shaders that handle SCENE_GBUFFER write every requested output at once, each one to
+    // gl_FragData[] at the index its define holds
+    m_gbuffer_normal = normal_buffer;
+    m_gbuffer_position = position_buffer;
+    m_gbuffer_outputs = (normal_buffer ? 1 : 0) + (position_buffer ? 1 : 0) + m_buffers_total;
+    m_gbuffer = m_gbuffer_outputs > 0 && findId(_fragmentShader, "SCENE_GBUFFER");
+    auto gbufferShader = [&](vera::Model* _model, bool _floor) {
+        _model->setBufferShader("gbuffer", _fragmentShader, _vertexShader);
+        vera::Shader* shader = _model->getBufferShader("gbuffer");
+        if (_floor)
+            shader->addDefine("FLOOR");
+        else
+            shader->delDefine("FLOOR");
+        shader->addDefine("SCENE_GBUFFER");
+
+        int output = 0;
+        if (normal_buffer)
+            shader->addDefine("SCENE_NORMAL_OUTPUT", vera::toString(output++));
+        if (position_buffer)
+            shader->addDefine("SCENE_POSITION_OUTPUT", vera::toString(output++));
+        for (size_t i = 0; i < m_buffers_total; i++)
+            shader->addDefine("SCENE_BUFFER_OUTPUT_" + vera::toString(i), vera::toString(output++));
+    };
+
+    // the models share programs by these sources (and their own defines)
+    m_programs_source = std::hash<std::string>()(_fragmentShader) * 31 + std::hash<std::string>()(_vertexShader);
+    m_programs_shared.clear();
+    m_programs_keys.clear();
+
     for (vera::ModelsMap::iterator it = _uniforms.models.begin(); it != _uniforms.models.end(); ++it) {
         it->second->setShader( _fragmentShader, _vertexShader);
 
@@ -516,6 +612,9 @@ void SceneRender::setShaders(Uniforms& _uniforms, const std::string& _fragmentSh
             it->second->getBufferShader(bufferName)->delDefine("FLOOR");
             it->second->getBufferShader(bufferName)->addDefine("SCENE_BUFFER_" + vera::toString(i));
         }
+
+        if (m_gbuffer)
+            gbufferShader(it->second, false);
     }
 
     // Floor
@@ -550,6 +649,9 @@ void SceneRender::setShaders(Uniforms& _uniforms, const std::string& _fragmentSh
             m_floor.getBufferShader(bufferName)->addDefine("FLOOR");
             m_floor.getBufferShader(bufferName)->addDefine("SCENE_BUFFER_" + vera::toString(i));
         }
+
+        if (m_gbuffer)
+            gbufferShader(&m_floor, true);
     }
 
     // DevLook
@@ -588,19 +690,19 @@ void SceneRender::setShaders(Uniforms& _uniforms, const std::string& _fragmentSh
 }
 
 void SceneRender::updateBuffers(Uniforms& _uniforms, int _width, int _height) {
-    vera::FboType type = _uniforms.functions["u_sceneDepth"].present ? vera::COLOR_DEPTH_TEXTURES : vera::COLOR_TEXTURE_DEPTH_BUFFER;
+    vera::FboType type = _uniforms.isPresent(UNIFORM_ID_SCENE_DEPTH) ? vera::COLOR_DEPTH_TEXTURES : vera::COLOR_TEXTURE_DEPTH_BUFFER;
 
     if (!renderFbo.isAllocated() ||
         renderFbo.getType() != type || 
         renderFbo.getWidth() != _width || renderFbo.getHeight() != _height )
         renderFbo.allocate(_width, _height, type);
 
-    if (_uniforms.functions["u_sceneNormal"].present &&
+    if (_uniforms.isPresent(UNIFORM_ID_SCENE_NORMAL) &&
         (   !normalFbo.isAllocated() ||
             normalFbo.getWidth() != _width || normalFbo.getHeight() != _height ) )
         normalFbo.allocate(_width, _height, vera::GBUFFER_TEXTURE);
 
-    if (_uniforms.functions["u_scenePosition"].present &&
+    if (_uniforms.isPresent(UNIFORM_ID_SCENE_POSITION) &&
         (   !positionFbo.isAllocated() || 
             positionFbo.getWidth() != _width || positionFbo.getHeight() != _height ) )
         positionFbo.allocate(_width, _height, vera::GBUFFER_TEXTURE);
@@ -616,6 +718,39 @@ void SceneRender::printBuffers() {
         std::cout << "uniform sampler2D u_sceneBuffer" << i << ";" << std::endl;
 }
 
+vera::Shader* SceneRender::_getProgram(Uniforms& _uniforms, vera::Model* _model) {
+    // Defines changed or shaders got recompiled (both invalidate the bindings), group them again
+    size_t stamp = _uniforms.getBindingsStamp() * 31 + m_programs_source;
+    if (stamp != m_programs_stamp) {
+        m_programs_shared.clear();
+        m_programs_keys.clear();
+        m_programs_stamp = stamp;
+    }
+
+    std::map<vera::Model*, vera::Shader*>::iterator it = m_programs_shared.find(_model);
+    if (it != m_programs_shared.end())
+        return it->second;
+
+    // Not compiled yet, it draws with its own until it is
+    vera::Shader* shader = _model->getShader();
+    if (!shader->isLoaded())
+        return shader;
+
+    // The key of a program is its sources plus its defines, models with the same one draw
+    // with the shader of the first model that had it
+    shader = m_programs_keys.insert( std::make_pair(_programKey(shader), shader) ).first->second;
+    m_programs_shared[_model] = shader;
+    return shader;
+}
+
+std::string SceneRender::_programKey(vera::Shader* _shader) const {
+    std::string key = std::to_string(m_programs_source);
+    const vera::DefinesMap& defines = _shader->getDefines();
+    for (vera::DefinesMap::const_iterator it = defines.begin(); it != defines.end(); ++it)
+        key += "\n" + it->first + " " + it->second;
+    return key;
+}
+
 void SceneRender::render(Uniforms& _uniforms) {
     // Render Background
     renderBackground(_uniforms);
@@ -637,6 +772,8 @@ void SceneRender::render(Uniforms& _uniforms) {
 
     vera::cullingMode(m_culling);
 
+    _cullBegin(SCENE_PASS_COLOR);
+
     // Two passes so opaque geometry and splats compose correctly when mixed.
     // Splats alpha-blend with depth writes disabled (see Gsplat::render), so
     // they must be drawn AFTER opaque models: pass 0 draws opaque meshes (which
@@ -644,39 +781,102 @@ void SceneRender::render(Uniforms& _uniforms) {
     // they're occluded behind meshes and blend in front of them). Without this
     // the map's alphabetical order can draw a splat before a mesh, letting the
     // opaque mesh paint over it unconditionally.
+    m_queue.clear();
+    size_t opaque = 0;
     for (int pass = 0; pass < 2; pass++) {
         for (vera::ModelsMap::iterator it = _uniforms.models.begin(); it != _uniforms.models.end(); ++it) {
             const bool isSplat = it->second->getGsplat() != nullptr;
             if (isSplat != (pass == 1))
                 continue;
 
-            TRACK_BEGIN("render:scene:" + it->second->getName() )
+            glm::mat4 mvp = vera::projectionViewWorldMatrix() * it->second->getTransformMatrix();
+            if (!_inFrustum(SCENE_PASS_COLOR, it->second, mvp))
+                continue;
 
-            // bind the shader
-            it->second->getShader()->use();
+            Draw draw;
+            draw.model = it->second;
+            draw.mvp = mvp;
+            if (!isSplat) {
+                draw.shader = _getProgram(_uniforms, it->second);
+                draw.program = draw.shader->getProgram();
+                draw.material = it->second->mesh.getMaterial().name;
+
+                vera::BoundingBox bbox = it->second->getBoundingBox();
+                glm::vec3 center = (bbox.min.x <= bbox.max.x) ? (bbox.min + bbox.max) * 0.5f : glm::vec3(0.0f);
+                draw.depth = (mvp * glm::vec4(center, 1.0f)).w;
+            }
+            m_queue.push_back(draw);
+        }
 
-            // Update Uniforms and textures variables to the shader
-            _uniforms.feedTo( it->second->getShader(), true, true );
+        if (pass == 0)
+            opaque = m_queue.size();
+    }
 
-            // Pass special uniforms
-            it->second->getShader()->setUniform( "u_modelViewProjectionMatrix", vera::projectionViewWorldMatrix() * it->second->getTransformMatrix() );
-            it->second->getShader()->setUniform( "u_modelMatrix", m_origin.getTransformMatrix() * it->second->getTransformMatrix() );
-            it->second->getShader()->setUniform( "u_model", m_origin.getPosition() + m_floor.getPosition() );
+    // The opaque ones by program, then material, then front to back
+    if (sortDraws)
+        std::stable_sort(m_queue.begin(), m_queue.begin() + opaque, [](const Draw& _a, const Draw& _b) {
+            if (_a.program != _b.program)
+                return _a.program < _b.program;
+            if (_a.material != _b.material)
+                return _a.material < _b.material;
+            return _a.depth < _b.depth;
+        });
 
-            for (size_t i = 0; i < buffersFbo.size(); i++)
-                it->second->getShader()->setUniformTexture("u_sceneBuffer" + vera::toString(i), buffersFbo[i], it->second->getShader()->textureIndex++);
+    m_draws = 0;
+    m_programs = 0;
+    vera::Shader* current = nullptr;
+    int textureIndex = 0;
+    for (size_t d = 0; d < m_queue.size(); d++) {
+        const Draw& draw = m_queue[d];
+        const bool isSplat = draw.model->getGsplat() != nullptr;
+        vera::Shader* shader = isSplat ? draw.model->getShader() : draw.shader;
+
+        TRACK_BEGIN("render:scene:" + draw.model->getName() )
+
+        // bind the shader and update uniforms and textures variables only when it changes, the
+        // models after it just get their own
+        if (shader != current) {
+            shader->use();
+            _uniforms.feedTo( shader, true, true );
+            textureIndex = shader->textureIndex;
+            current = shader;
+            m_programs++;
+        }
+        shader->textureIndex = textureIndex;
 
-            it->second->render();
+        // Pass special uniforms
+        shader->setUniform( "u_modelViewProjectionMatrix", draw.mvp );
+        shader->setUniform( "u_modelMatrix", m_origin.getTransformMatrix() * draw.model->getTransformMatrix() );
+        shader->setUniform( "u_model", m_origin.getPosition() + m_floor.getPosition() );
 
-            // Splats disable depth writes for their own (alpha-blended) color
-            // draw above, so without this they'd never appear in u_sceneDepth
-            // at all -- see Gsplat::renderDepth() for why this needs its own
-            // pass rather than just enabling depth writes on the color draw.
-            if (_uniforms.functions["u_sceneDepth"].present && isSplat)
-                it->second->getGsplat()->renderDepth(_uniforms.activeCamera, it->second->getTransformMatrix());
+        for (size_t i = 0; i < buffersFbo.size(); i++)
+            shader->setUniformTexture("u_sceneBuffer" + vera::toString(i), buffersFbo[i], shader->textureIndex++);
+
+        if (isSplat)
+            draw.model->render();
+        else
+            draw.model->render(shader);
+        m_draws++;
+
+        // Splats disable depth writes for their own (alpha-blended) color
+        // draw above, so without this they'd never appear in u_sceneDepth
+        // at all -- see Gsplat::renderDepth() for why this needs its own
+        // pass rather than just enabling depth writes on the color draw.
+        if (_uniforms.isPresent(UNIFORM_ID_SCENE_DEPTH) && isSplat)
+            draw.model->getGsplat()->renderDepth(_uniforms.activeCamera, draw.model->getTransformMatrix());
+
+        // splats draw with programs of their own
+        if (isSplat)
+            current = nullptr;
+
+        TRACK_END("render:scene:" + draw.model->getName() )
+    }
 
-            TRACK_END("render:scene:" + it->second->getName() )
-        }
+    _cullEnd(_uniforms, SCENE_PASS_COLOR);
+
+    if (_uniforms.tracker.isRunning()) {
+        _uniforms.tracker.setCounter("scene:draws", m_draws);
+        _uniforms.tracker.setCounter("scene:programs", m_programs);
     }
 
     TRACK_BEGIN("render:scene:devlook")
@@ -725,11 +925,18 @@ void SceneRender::renderNormalBuffer(Uniforms& _uniforms) {
 
     vera::cullingMode(m_culling);
 
+    _cullBegin(SCENE_PASS_NORMAL);
+
     for (vera::ModelsMap::iterator it = _uniforms.models.begin(); it != _uniforms.models.end(); ++it) {
+        glm::mat4 mvp = vera::projectionViewWorldMatrix() * it->second->getTransformMatrix();
+
         // Gaussian splats have no scene-graph shader to plug in here (their
         // vertex/attribute layout is fixed), so they render their own
         // internal normal-buffer shader instead of the generic mesh path.
         if (it->second->getGsplat() != nullptr) {
+            if (!_inFrustum(SCENE_PASS_NORMAL, it->second, mvp))
+                continue;
+
             TRACK_BEGIN("render:sceneNormal:" + it->second->getName() )
             it->second->getGsplat()->renderNormal( _uniforms.activeCamera, m_origin.getTransformMatrix() * it->second->getTransformMatrix() );
             TRACK_END("render:sceneNormal:" + it->second->getName() )
@@ -737,7 +944,7 @@ void SceneRender::renderNormalBuffer(Uniforms& _uniforms) {
         }
 
         normalShader = it->second->getBufferShader("normal");
-        if (normalShader != nullptr) {
+        if (normalShader != nullptr && _inFrustum(SCENE_PASS_NORMAL, it->second, mvp)) {
             TRACK_BEGIN("render:sceneNormal:" + it->second->getName() )
 
             // bind the shader
@@ -747,7 +954,7 @@ void SceneRender::renderNormalBuffer(Uniforms& _uniforms) {
             _uniforms.feedTo( normalShader, false );
 
             // Pass special uniforms
-            normalShader->setUniform( "u_modelViewProjectionMatrix", vera::projectionViewWorldMatrix() * it->second->getTransformMatrix());
+            normalShader->setUniform( "u_modelViewProjectionMatrix", mvp );
             normalShader->setUniform( "u_model", m_origin.getPosition() + it->second->getPosition() );
             normalShader->setUniform( "u_modelMatrix", m_origin.getTransformMatrix() * it->second->getTransformMatrix() );
             it->second->render(normalShader);
@@ -756,6 +963,8 @@ void SceneRender::renderNormalBuffer(Uniforms& _uniforms) {
         }
     }
 
+    _cullEnd(_uniforms, SCENE_PASS_NORMAL);
+
     if (m_depth_test)
         vera::setDepthTest(false);
 
@@ -797,9 +1006,12 @@ void SceneRender::renderPositionBuffer(Uniforms& _uniforms) {
 
     vera::cullingMode(m_culling);
 
+    _cullBegin(SCENE_PASS_POSITION);
+
     for (vera::ModelsMap::iterator it = _uniforms.models.begin(); it != _uniforms.models.end(); ++it) {
+        glm::mat4 mvp = vera::projectionViewWorldMatrix() * it->second->getTransformMatrix();
         positionShader = it->second->getBufferShader("position");
-        if (positionShader != nullptr) {
+        if (positionShader != nullptr && _inFrustum(SCENE_PASS_POSITION, it->second, mvp)) {
             TRACK_BEGIN("render:scenePosition:" + it->second->getName() )
 
             // bind the shader
@@ -809,7 +1021,7 @@ void SceneRender::renderPositionBuffer(Uniforms& _uniforms) {
             _uniforms.feedTo( positionShader, false );
 
             // Pass special uniforms
-            positionShader->setUniform( "u_modelViewProjectionMatrix", vera::projectionViewWorldMatrix() *  it->second->getTransformMatrix() );
+            positionShader->setUniform( "u_modelViewProjectionMatrix", mvp );
             positionShader->setUniform( "u_model", m_origin.getPosition() + it->second->getPosition() );
             positionShader->setUniform( "u_modelMatrix", m_origin.getTransformMatrix() * it->second->getTransformMatrix() );
             it->second->render(positionShader);
@@ -818,6 +1030,8 @@ void SceneRender::renderPositionBuffer(Uniforms& _uniforms) {
         }
     }
 
+    _cullEnd(_uniforms, SCENE_PASS_POSITION);
+
     if (m_depth_test)
         vera::setDepthTest(false);
 
@@ -827,7 +1041,7 @@ void SceneRender::renderPositionBuffer(Uniforms& _uniforms) {
     positionFbo.unbind();
 }
 
-void SceneRender::renderBuffers(Uniforms& _uniforms) {
+void SceneRender::_createBuffers() {
     if ( m_buffers_total != buffersFbo.size() ) {
         for (size_t i = 0; i < buffersFbo.size(); i++)
             delete buffersFbo[i];
@@ -841,6 +1055,12 @@ void SceneRender::renderBuffers(Uniforms& _uniforms) {
             buffersFbo[i]->allocate(vera::getWindowWidth(), vera::getWindowHeight(), vera::GBUFFER_TEXTURE);
         }
     }
+}
+
+void SceneRender::renderBuffers(Uniforms& _uniforms) {
+    _createBuffers();
+
+    _cullBegin(SCENE_PASS_BUFFERS);
 
     vera::Shader* bufferShader = nullptr;
     for (size_t i = 0; i < buffersFbo.size(); i++) {
@@ -877,9 +1097,10 @@ void SceneRender::renderBuffers(Uniforms& _uniforms) {
         vera::cullingMode(m_culling);
 
         for (vera::ModelsMap::iterator it = _uniforms.models.begin(); it != _uniforms.models.end(); ++it) {
+            glm::mat4 mvp = vera::projectionViewWorldMatrix() * it->second->getTransformMatrix();
             bufferShader = it->second->getBufferShader(bufferName);
 
-            if (bufferShader != nullptr) {
+            if (bufferShader != nullptr && _inFrustum(SCENE_PASS_BUFFERS, it->second, mvp)) {
                 TRACK_BEGIN("render:" + bufferName + ":" + it->second->getName())
 
                 // bind the shader
@@ -889,7 +1110,7 @@ void SceneRender::renderBuffers(Uniforms& _uniforms) {
                 _uniforms.feedTo( bufferShader, false );
 
                 // Pass special uniforms
-                bufferShader->setUniform( "u_modelViewProjectionMatrix", vera::projectionViewWorldMatrix() * it->second->getTransformMatrix() );
+                bufferShader->setUniform( "u_modelViewProjectionMatrix", mvp );
                 bufferShader->setUniform( "u_model", m_origin.getPosition() + it->second->getPosition() );
                 bufferShader->setUniform( "u_modelMatrix", m_origin.getTransformMatrix() * it->second->getTransformMatrix() );
                 it->second->render(bufferShader);
@@ -906,6 +1127,211 @@ void SceneRender::renderBuffers(Uniforms& _uniforms) {
 
         buffersFbo[i]->unbind();
     }
+
+    _cullEnd(_uniforms, SCENE_PASS_BUFFERS);
+}
+
+// The normal, position and scene buffers out of a single pass over the geometry, drawing to all
+// of their textures at once (multiple render targets) with the "gbuffer" shader of each model.
+// Returns false when it can't: the shader doesn't handle SCENE_GBUFFER, there is no MRT (GLES2,
+// WebGL1), a splat needs its own normal pass or a target is missing. The caller then renders
+// them one by one
+bool SceneRender::renderGBuffer(Uniforms& _uniforms) {
+#if !defined(PLATFORM_RPI)
+    if (!m_gbuffer)
+        return false;
+
+    // GLSL 100 means a GLES2 or WebGL1 context, without glDrawBuffers
+    #if defined(__EMSCRIPTEN__)
+    if (vera::getWebGLVersionNumber() == 1)
+        return false;
+    #endif
+    if (vera::getVersionNumber() == 100)
+        return false;
+
+    GLint maxDrawBuffers = 1;
+    GLint maxAttachments = 1;
+    glGetIntegerv(GL_MAX_DRAW_BUFFERS, &maxDrawBuffers);
+    glGetIntegerv(GL_MAX_COLOR_ATTACHMENTS, &maxAttachments);
+    if (GLint(m_gbuffer_outputs) > std::min(maxDrawBuffers, maxAttachments))
+        return false;
+
+    for (vera::ModelsMap::iterator it = _uniforms.models.begin(); it != _uniforms.models.end(); ++it)
+        if (it->second->getGsplat() != nullptr)
+            return false;
+
+    _createBuffers();
+
+    // Same order the SCENE_*_OUTPUT defines follow
+    std::vector<vera::Fbo*> targets;
+    if (m_gbuffer_normal)
+        targets.push_back(&normalFbo);
+    if (m_gbuffer_position)
+        targets.push_back(&positionFbo);
+    for (size_t i = 0; i < buffersFbo.size(); i++)
+        targets.push_back(buffersFbo[i]);
+
+    if (targets.size() != m_gbuffer_outputs)
+        return false;
+
+    // The depth goes to the depth texture of the first target, as its own pass would leave it
+    GLuint depth = targets[0]->getDepthTextureId();
+    if (depth == 0)
+        return false;
+
+    int width = targets[0]->getWidth();
+    int height = targets[0]->getHeight();
+    std::vector<GLuint> textures;
+    for (size_t i = 0; i < targets.size(); i++) {
+        if (!targets[i]->isAllocated() || targets[i]->getWidth() != width || targets[i]->getHeight() != height)
+            return false;
+        textures.push_back(targets[i]->getTextureId());
+    }
+
+    TRACK_BEGIN("render:gbuffer")
+
+    GLint previousFbo = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFbo);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+    if (m_gbuffer_fbo == 0)
+        glGenFramebuffers(1, &m_gbuffer_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_gbuffer_fbo);
+
+    // attach them again only when they got reallocated or resized
+    if (textures != m_gbuffer_attached || depth != m_gbuffer_depth || width != m_gbuffer_width || height != m_gbuffer_height) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        m_gbuffer_depth = depth;
+
+        for (size_t i = 0; i < textures.size(); i++)
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + GLenum(i), GL_TEXTURE_2D, textures[i], 0);
+        for (size_t i = textures.size(); i < m_gbuffer_attached.size(); i++)
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + GLenum(i), GL_TEXTURE_2D, 0, 0);
+
+        m_gbuffer_attached = textures;
+        m_gbuffer_width = width;
+        m_gbuffer_height = height;
+        m_gbuffer_complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!m_gbuffer_complete)
+            std::cout << "G-buffer incomplete with " << textures.size() << " outputs, rendering them one by one" << std::endl;
+    }
+
+    if (!m_gbuffer_complete) {
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+        TRACK_END("render:gbuffer")
+        return false;
+    }
+
+    std::vector<GLenum> attachments;
+    for (size_t i = 0; i < textures.size(); i++)
+        attachments.push_back(GL_COLOR_ATTACHMENT0 + GLenum(i));
+    glDrawBuffers(GLsizei(attachments.size()), attachments.data());
+
+    // as binding any of them would, every draw buffer and the depth
+    glViewport(0, 0, width, height);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Begining of DEPTH for 3D 
+    if (m_depth_test)
+        vera::setDepthTest(true);
+
+    if (_uniforms.activeCamera->bChange || m_origin.bChange) {
+        vera::setCamera( _uniforms.activeCamera );
+        vera::applyMatrix( m_origin.getTransformMatrix() );
+    }
+
+    vera::Shader* gbufferShader = nullptr;
+    if (m_floor_subd_target >= 0) {
+        gbufferShader = m_floor.getBufferShader("gbuffer");
+        if (gbufferShader != nullptr) {
+            TRACK_BEGIN("render:gbuffer:floor")
+            gbufferShader->use();
+            _uniforms.feedTo( gbufferShader, false );
+            gbufferShader->setUniform( "u_modelViewProjectionMatrix", vera::projectionViewWorldMatrix() * m_floor.getTransformMatrix() );
+            gbufferShader->setUniform( "u_model", m_origin.getPosition() + m_floor.getPosition() );
+            gbufferShader->setUniform( "u_modelMatrix", m_origin.getTransformMatrix() * m_floor.getTransformMatrix() );
+            m_floor.render(gbufferShader);
+            TRACK_END("render:gbuffer:floor")
+        }
+    }
+
+    vera::cullingMode(m_culling);
+
+    _cullBegin(SCENE_PASS_GBUFFER);
+
+    for (vera::ModelsMap::iterator it = _uniforms.models.begin(); it != _uniforms.models.end(); ++it) {
+        glm::mat4 mvp = vera::projectionViewWorldMatrix() * it->second->getTransformMatrix();
+        gbufferShader = it->second->getBufferShader("gbuffer");
+        if (gbufferShader != nullptr && _inFrustum(SCENE_PASS_GBUFFER, it->second, mvp)) {
+            TRACK_BEGIN("render:gbuffer:" + it->second->getName())
+
+            // bind the shader
+            gbufferShader->use();
+
+            // Update Uniforms and textures variables to the shader
+            _uniforms.feedTo( gbufferShader, false );
+
+            // Pass special uniforms
+            gbufferShader->setUniform( "u_modelViewProjectionMatrix", mvp );
+            gbufferShader->setUniform( "u_model", m_origin.getPosition() + it->second->getPosition() );
+            gbufferShader->setUniform( "u_modelMatrix", m_origin.getTransformMatrix() * it->second->getTransformMatrix() );
+            it->second->render(gbufferShader);
+
+            TRACK_END("render:gbuffer:" + it->second->getName())
+        }
+    }
+
+    _cullEnd(_uniforms, SCENE_PASS_GBUFFER);
+
+    if (m_depth_test)
+        vera::setDepthTest(false);
+
+    if (m_culling != 0)
+        vera::cullingMode(vera::CULL_NONE);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+
+    TRACK_END("render:gbuffer")
+    return true;
+#else
+    return false;
+#endif
+}
+
+void SceneRender::_cullBegin(ScenePass _pass) {
+    m_drawn[_pass] = 0;
+    m_culled[_pass] = 0;
+}
+
+void SceneRender::_cullEnd(Uniforms& _uniforms, ScenePass _pass) {
+    if (_uniforms.tracker.isRunning()) {
+        _uniforms.tracker.setCounter("culling:" + scene_pass_names[_pass] + "_drawn", m_drawn[_pass]);
+        _uniforms.tracker.setCounter("culling:" + scene_pass_names[_pass] + "_culled", m_culled[_pass]);
+    }
+}
+
+// Counts the model as drawn or culled by the pass. _mvp takes its bounding box to clip space,
+// with m_origin and its own transform in it
+bool SceneRender::_inFrustum(ScenePass _pass, vera::Model* _model, const glm::mat4& _mvp) {
+    bool visible = true;
+    if (frustumCulling) {
+        vera::BoundingBox bbox = _model->getBoundingBox();
+        visible = inFrustum(_mvp, bbox.min, bbox.max);
+    }
+
+    if (visible)
+        m_drawn[_pass]++;
+    else
+        m_culled[_pass]++;
+    return visible;
+}
+
+void SceneRender::printCulling() {
+    std::cout << "// pass, drawn, culled" << std::endl;
+    for (size_t i = 0; i < SCENE_PASS_TOTAL; i++)
+        std::cout << scene_pass_names[i] << "," << m_drawn[i] << "," << m_culled[i] << std::endl;
 }
 
 void SceneRender::renderShadowMap(Uniforms& _uniforms) {
@@ -914,15 +1340,22 @@ void SceneRender::renderShadowMap(Uniforms& _uniforms) {
 
     TRACK_BEGIN("render:scene:shadowmap")
 
+    // the counts of the last frame any shadow map got rendered, added over the lights
+    bool rendered = false;
     vera::Shader* shadowShader = nullptr;
     for (vera::LightsMap::iterator lit = _uniforms.lights.begin(); lit != _uniforms.lights.end(); ++lit) {
         if (dynamicShadows ||  lit->second->bChange || m_origin.bChange ) {
+            if (!rendered)
+                _cullBegin(SCENE_PASS_SHADOWMAP);
+            rendered = true;
+
             // Temporally move the MVP matrix from the view of the light 
             glm::mat4 m = m_origin.getTransformMatrix();
             // glm::mat4 p = lit->second->getProjectionMatrix();
             // glm::mat4 v = lit->second->getViewMatrix();
             
             lit->second->bindShadowMap();
+            _uniforms.blockView(lit->second->getViewMatrix(), lit->second->getProjectionMatrix());
 
             shadowShader = m_floor.getBufferShader("shadow");
             if (m_floor.getVbo() && shadowShader != nullptr) {
@@ -939,8 +1372,10 @@ void SceneRender::renderShadowMap(Uniforms& _uniforms) {
             }
 
             for (vera::ModelsMap::iterator mit = _uniforms.models.begin(); mit != _uniforms.models.end(); ++mit) {
+                // the light's own frustum
+                glm::mat4 mvp = lit->second->getMVPMatrix( m_origin.getTransformMatrix() * mit->second->getTransformMatrix(), m_area );
                 shadowShader = mit->second->getBufferShader("shadow");
-                if (shadowShader != nullptr) {
+                if (shadowShader != nullptr && _inFrustum(SCENE_PASS_SHADOWMAP, mit->second, mvp)) {
                     TRACK_BEGIN("render:scene:shadowmap:" + mit->second->getName())
 
                     // bind the shader
@@ -950,7 +1385,7 @@ void SceneRender::renderShadowMap(Uniforms& _uniforms) {
                     _uniforms.feedTo( shadowShader, false );
 
                     // Pass special uniforms
-                    shadowShader->setUniform( "u_modelViewProjectionMatrix", lit->second->getMVPMatrix( m_origin.getTransformMatrix() * mit->second->getTransformMatrix(), m_area ) );
+                    shadowShader->setUniform( "u_modelViewProjectionMatrix", mvp );
                     shadowShader->setUniform( "u_projectionMatrix", lit->second->getProjectionMatrix() );
                     shadowShader->setUniform( "u_viewMatrix", lit->second->getViewMatrix() );
                     shadowShader->setUniform( "u_modelMatrix", m_origin.getTransformMatrix() * mit->second->getTransformMatrix() );
@@ -961,9 +1396,16 @@ void SceneRender::renderShadowMap(Uniforms& _uniforms) {
                 }
             }
 
+            _uniforms.blockReset();
             lit->second->unbindShadowMap();
         }
     }
+    if (rendered) {
+        _cullEnd(_uniforms, SCENE_PASS_SHADOWMAP);
+
+        // the light matrices of the block come from this pass
+        _uniforms.blockUpdate();
+    }
     TRACK_END("shadowmap")
 }
 
@@ -1024,6 +1466,7 @@ void SceneRender::renderFloor(Uniforms& _uniforms) {
             m_floor.addDefine("FLOOR_SUBD", vera::toString(m_floor_subd) );
             m_floor.addDefine("FLOOR_AREA", vera::toString(m_area * 10.0f) );
             m_floor.addDefine("FLOOR_HEIGHT", vera::toString(m_floor_height) );
+            _uniforms.invalidateBindings();
         }
 
         if (m_floor.getVbo()) {
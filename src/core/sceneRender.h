@@ -1,5 +1,6 @@
 #pragma once
 
+#include <map>
 #include <memory>
 #include "uniforms.h"
 #include "tools/command.h"
@@ -10,6 +11,19 @@
 #include "vera/gl/textureCube.h"
 #include "vera/types/model.h"
 
+// The passes that draw the models, for the culling counts
+enum ScenePass {
+    SCENE_PASS_COLOR = 0,
+    SCENE_PASS_SHADOWMAP,
+    SCENE_PASS_NORMAL,
+    SCENE_PASS_POSITION,
+    SCENE_PASS_BUFFERS,
+    SCENE_PASS_GBUFFER,
+    SCENE_PASS_TOTAL
+};
+
+const std::string scene_pass_names[] = { "scene", "shadowmap", "sceneNormal", "scenePosition", "sceneBuffers", "gbuffer" };
+
 class SceneRender {
 public:
 
@@ -39,6 +53,7 @@ public:
     size_t          getBuffersTotal() const { return m_buffers_total; }
     void            updateBuffers(Uniforms& _uniforms, int _width, int _height);
     void            printBuffers();
+    void            printCulling();
 
     void            render(Uniforms& _uniforms);
     void            renderFloor(Uniforms& _uniforms);
@@ -49,6 +64,7 @@ public:
     void            renderNormalBuffer(Uniforms& _uniforms);
     void            renderPositionBuffer(Uniforms& _uniforms);
     void            renderBuffers(Uniforms& _uniforms);
+    bool            renderGBuffer(Uniforms& _uniforms);
 
     bool            showGrid;
     bool            showAxis;
@@ -61,6 +77,10 @@ public:
     BuffersList     buffersFbo;
 
     bool            dynamicShadows;
+    // Off by default: the bounding boxes are the ones of the loaded geometry, so a vertex shader
+    // that moves the vertices out of them would get its models culled while still on screen
+    bool            frustumCulling;
+    bool            sortDraws;
 
 protected:
     vera::Node                  m_origin;
@@ -103,6 +123,48 @@ protected:
     glm::vec3                   m_ssaoNoise[16];
 
     size_t                      m_buffers_total;
+    void                        _createBuffers();
+
+    // Frustum culling, with how many models the last run of each pass drew and culled
+    bool                        _inFrustum(ScenePass _pass, vera::Model* _model, const glm::mat4& _mvp);
+    void                        _cullBegin(ScenePass _pass);
+    void                        _cullEnd(Uniforms& _uniforms, ScenePass _pass);
+    size_t                      m_drawn[SCENE_PASS_TOTAL];
+    size_t                      m_culled[SCENE_PASS_TOTAL];
+
+    // Models whose shaders come from the same sources and defines draw with one program, the one
+    // of the first of them. Rebuilt when the shaders, their defines or the models change
+    vera::Shader*               _getProgram(Uniforms& _uniforms, vera::Model* _model);
+    std::string                 _programKey(vera::Shader* _shader) const;
+    std::map<vera::Model*, vera::Shader*> m_programs_shared;
+    std::map<std::string, vera::Shader*>  m_programs_keys;
+    size_t                      m_programs_source;
+    size_t                      m_programs_stamp;
+
+    // Draw queue of the scene pass, with the draw calls and program switches of its last run
+    struct Draw {
+        vera::Model*            model   = nullptr;
+        vera::Shader*           shader  = nullptr;
+        GLuint                  program = 0;
+        std::string             material;
+        float                   depth   = 0.0f;     // of the center of its bounding box
+        glm::mat4               mvp;
+    };
+    std::vector<Draw>           m_queue;
+    size_t                      m_draws;
+    size_t                      m_programs;
+
+    // G-buffer: normal, position and scene buffers written by a single pass (see renderGBuffer)
+    bool                        m_gbuffer;
+    bool                        m_gbuffer_normal;
+    bool                        m_gbuffer_position;
+    bool                        m_gbuffer_complete;
+    size_t                      m_gbuffer_outputs;
+    GLuint                      m_gbuffer_fbo;
+    GLuint                      m_gbuffer_depth;            // depth texture of the first target, not ours
+    std::vector<GLuint>         m_gbuffer_attached;
+    int                         m_gbuffer_width;
+    int                         m_gbuffer_height;
 
     bool                        m_commands_loaded;
     bool                        m_uniforms_loaded;
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "vera/gl/gl.h"
+
+/** Keeps the blending state of the context (enabled, functions and equations) from the moment
+ *  it's created, and puts it back when it goes out of scope. For passes that need their own
+ *  blending in the middle of a frame without changing the one the user picked **/
+class BlendState {
+public:
+    BlendState() {
+        m_enabled = glIsEnabled(GL_BLEND);
+        glGetIntegerv(GL_BLEND_SRC_RGB, &m_src_rgb);
+        glGetIntegerv(GL_BLEND_DST_RGB, &m_dst_rgb);
+        glGetIntegerv(GL_BLEND_SRC_ALPHA, &m_src_alpha);
+        glGetIntegerv(GL_BLEND_DST_ALPHA, &m_dst_alpha);
+        glGetIntegerv(GL_BLEND_EQUATION_RGB, &m_equation_rgb);
+        glGetIntegerv(GL_BLEND_EQUATION_ALPHA, &m_equation_alpha);
+    }
+
+    BlendState(const BlendState&) = delete;
+    BlendState& operator=(const BlendState&) = delete;
+
+    ~BlendState() { restore(); }
+
+    void restore() {
+        if (m_enabled)
+            glEnable(GL_BLEND);
+        else
+            glDisable(GL_BLEND);
+        glBlendFuncSeparate(m_src_rgb, m_dst_rgb, m_src_alpha, m_dst_alpha);
+        glBlendEquationSeparate(m_equation_rgb, m_equation_alpha);
+    }
+
+protected:
+    GLboolean   m_enabled;
+    GLint       m_src_rgb;
+    GLint       m_dst_rgb;
+    GLint       m_src_alpha;
+    GLint       m_dst_alpha;
+    GLint       m_equation_rgb;
+    GLint       m_equation_alpha;
+};
@@ -2,17 +2,20 @@
 
 #include <vector>
 #include <string>
+#include <utility>
+#include <algorithm>
 #include <functional>
 
 struct Command {
     Command() {}
 
-    Command(const std::string &_trigger, std::function<bool(const std::string&)> _do, const std::string &_formula, const std::string &_description, bool _mutex = true) {
+    Command(const std::string &_trigger, std::function<bool(const std::string&)> _do, const std::string &_formula, const std::string &_description, bool _mutex = true, bool _wait = false) {
         trigger = _trigger;
         exec = _do;
         formula = _formula;
         description = _description;
         mutex = _mutex;
+        wait = _wait;
     }
 
     std::string                             trigger;
@@ -20,6 +23,82 @@ struct Command {
     std::string                             description;
     std::function<bool(const std::string&)> exec;
     bool                                    mutex;
+    bool                                    wait = false;   // waits on the render loop (progress, sleeps), so it runs on the thread that sends it instead of going through the queue
 };
 
 typedef std::vector<Command> CommandList;
+
+/** Finds the commands a line can trigger without scanning the whole list. A trigger matches
+ *  every line that begins with it, so walking a trie of the triggers along the line, the
+ *  deepest node reached holds all the candidates (in the order they were added) and the one
+ *  with the longest trigger. Commands only get appended, build a new table when the list grows. **/
+class CommandTable {
+public:
+    CommandTable(const CommandList& _commands) : m_size(_commands.size()) {
+        m_nodes.push_back(Node());
+        for (size_t i = 0; i < _commands.size(); i++) {
+            const std::string& trigger = _commands[i].trigger;
+            int node = 0;
+            for (size_t c = 0; c < trigger.size(); c++) {
+                int next = _child(node, trigger[c]);
+                if (next < 0) {
+                    next = (int)m_nodes.size();
+                    m_nodes.push_back(Node());
+                    m_nodes[next].parent = node;
+                    m_nodes[node].children.push_back( std::make_pair(trigger[c], next) );
+                }
+                node = next;
+            }
+            m_nodes[node].commands.push_back(i);
+        }
+
+        // Children are always added after their parent, so one pass in order inherits everything above
+        for (size_t n = 1; n < m_nodes.size(); n++) {
+            Node& node = m_nodes[n];
+            const Node& parent = m_nodes[node.parent];
+            node.longest = node.commands.empty() ? parent.longest : (int)node.commands[0];
+            node.candidates = parent.candidates;
+            node.candidates.insert(node.candidates.end(), node.commands.begin(), node.commands.end());
+            std::sort(node.candidates.begin(), node.candidates.end());
+        }
+    }
+
+    // Indices of the commands whose trigger begins _line, in list order
+    const std::vector<size_t>& find(const std::string& _line) const { return m_nodes[_walk(_line)].candidates; }
+
+    // Index of the command with the longest trigger that begins _line, -1 if none
+    int     longest(const std::string& _line) const { return m_nodes[_walk(_line)].longest; }
+
+    size_t  size() const { return m_size; }
+
+private:
+    struct Node {
+        std::vector< std::pair<char, int> > children;
+        std::vector<size_t> commands;           // with exactly this trigger
+        std::vector<size_t> candidates;         // with this trigger or a shorter one above it
+        int                 parent  = 0;
+        int                 longest = -1;
+    };
+
+    int _child(int _node, char _c) const {
+        const std::vector< std::pair<char, int> >& children = m_nodes[_node].children;
+        for (size_t i = 0; i < children.size(); i++)
+            if (children[i].first == _c)
+                return children[i].second;
+        return -1;
+    }
+
+    int _walk(const std::string& _line) const {
+        int node = 0;
+        for (size_t c = 0; c < _line.size(); c++) {
+            int next = _child(node, _line[c]);
+            if (next < 0)
+                break;
+            node = next;
+        }
+        return node;
+    }
+
+    std::vector<Node>   m_nodes;
+    size_t              m_size;
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+
+#include "lockFreeQueue.h"
+
+struct QueuedCommand {
+    std::string                             line;
+    std::vector<std::string>                batch;      // when not empty, lines that run together instead of line
+    std::chrono::steady_clock::time_point   queued;
+};
+
+/** Commands sent from other threads (console, OSC, -e arguments) wait here until the render
+ *  thread runs them at the start of a frame, so they never change GL state under a frame in
+ *  progress. Sending never blocks; running can be capped to a time budget per frame, whatever
+ *  doesn't fit waits for the next one. **/
+class CommandQueue {
+public:
+    CommandQueue(size_t _capacity = 4096) : m_queue(_capacity), m_pending(0), m_budgetMs(0.0) {
+        resetStats();
+    }
+
+    // Runs a command on the render thread
+    std::function<void(const std::string&)> exec;
+
+    // Any thread. Returns false if the queue is full and the command got dropped
+    bool push(const std::string& _line) {
+        QueuedCommand cmd;
+        cmd.line = _line;
+        cmd.queued = std::chrono::steady_clock::now();
+
+        m_pending++;
+        if (m_queue.push( std::move(cmd) ))
+            return true;
+        m_pending--;
+        return false;
+    }
+
+    // Any thread. The lines run one after the other in the same frame, whatever the budget
+    bool push(std::vector<std::string>&& _batch) {
+        if (_batch.empty())
+            return true;
+
+        QueuedCommand cmd;
+        cmd.batch = std::move(_batch);
+        cmd.queued = std::chrono::steady_clock::now();
+
+        m_pending++;
+        if (m_queue.push( std::move(cmd) ))
+            return true;
+        m_pending--;
+        return false;
+    }
+
+    // Any thread. True once everything sent so far has finished running
+    bool    isIdle() const { return m_pending.load() == 0; }
+
+    // Render thread. Returns how many commands ran. At least one always runs, so a budget
+    // shorter than a command doesn't stall the queue
+    size_t drain() {
+        if (!exec)
+            return 0;
+
+        auto start = std::chrono::steady_clock::now();
+        m_frameExecuted = 0;
+        m_frameLatencyMs = 0.0;
+
+        QueuedCommand cmd;
+        while (m_queue.pop(cmd)) {
+            auto now = std::chrono::steady_clock::now();
+            double latency = std::chrono::duration<double, std::milli>(now - cmd.queued).count();
+            m_frameLatencyMs = std::max(m_frameLatencyMs, latency);
+            m_latencyMaxMs = std::max(m_latencyMaxMs, latency);
+
+            size_t lines = 1;
+            if (cmd.batch.empty())
+                exec(cmd.line);
+            else {
+                for (size_t i = 0; i < cmd.batch.size(); i++)
+                    exec(cmd.batch[i]);
+                lines = cmd.batch.size();
+                m_batches++;
+            }
+            m_pending--;
+            m_frameExecuted += lines;
+            m_executed += lines;
+            m_latencySumMs += latency * lines;
+
+            if (m_budgetMs > 0.0 && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= m_budgetMs) {
+                if (!m_queue.empty())
+                    m_deferred++;
+                break;
+            }
+        }
+
+        return m_frameExecuted;
+    }
+
+    // Render thread
+    bool    empty() const { return m_queue.empty(); }
+    size_t  size() const { return m_queue.size(); }
+
+    // 0 runs everything that is waiting
+    void    setBudget(double _ms) { m_budgetMs = std::max(0.0, _ms); }
+    double  getBudget() const { return m_budgetMs; }
+
+    void    resetStats() {
+        m_executed = 0;
+        m_batches = 0;
+        m_deferred = 0;
+        m_frameExecuted = 0;
+        m_frameLatencyMs = 0.0;
+        m_latencySumMs = 0.0;
+        m_latencyMaxMs = 0.0;
+    }
+
+    size_t  getExecuted() const { return m_executed; }
+    size_t  getBatches() const { return m_batches; }
+    size_t  getDropped() const { return m_queue.getDropped(); }
+    size_t  getDeferred() const { return m_deferred; }              // frames that ran out of budget
+    size_t  getFrameExecuted() const { return m_frameExecuted; }
+    double  getFrameLatencyMs() const { return m_frameLatencyMs; }  // oldest command run this frame
+    double  getLatencyMaxMs() const { return m_latencyMaxMs; }
+    double  getLatencyAverageMs() const { return (m_executed > 0) ? m_latencySumMs / m_executed : 0.0; }
+
+private:
+    LockFreeQueue<QueuedCommand>    m_queue;
+    std::atomic<size_t>             m_pending;          // sent and not done yet
+    double                          m_budgetMs;
+
+    // Stats, only touched by the render thread
+    size_t                          m_executed;
+    size_t                          m_batches;
+    size_t                          m_deferred;
+    size_t                          m_frameExecuted;
+    double                          m_frameLatencyMs;
+    double                          m_latencySumMs;
+    double                          m_latencyMaxMs;
+};
@@ -171,7 +171,7 @@ void refresh_stt_win() {
     if (have_colors) wattron(stt_win, COLOR_PAIR(2));
     uniforms_starts_at = y;
     int i = 0;
-    for (UniformDataMap::iterator it= uniforms->data.begin(); it != uniforms->data.end(); ++it) {
+    for (UniformDataMap::const_iterator it = uniforms->getData().begin(); it != uniforms->getData().end(); ++it) {
         if (it->second.size > 4)
             continue;
 
@@ -425,7 +425,7 @@ bool console_getline(std::string& _cmd, CommandList& _commands, GlslViewer& _san
                     if ( vera::beginsWith(cmd, _commands[i].trigger) )
                         std::cout << "      " << std::left << std::setw(16) << _commands[i].formula << "   " << _commands[i].description << std::endl;
 
-                for (UniformDataMap::iterator it = _sandbox.uniforms.data.begin(); it != _sandbox.uniforms.data.end(); ++it) {
+                for (UniformDataMap::const_iterator it = _sandbox.uniforms.getData().begin(); it != _sandbox.uniforms.getData().end(); ++it) {
                     if ( vera::beginsWith(cmd, it->first) ) {
                         std::cout << it->first;
 
@@ -563,10 +563,13 @@ bool console_getline(std::string& _cmd, CommandList& _commands, GlslViewer& _san
                         if (mouse_at >= 0) {
                             if (wmouse_trafo(stt_win, &m.y, &m.x, false) ) {
                                 float delta = (m.x - mouse_x) * 0.01 + (m.y - mouse_y) * 0.1;
-                                if (uniforms->data[mouse_at_key].size < 5) {
-                                    uniforms->data[mouse_at_key].value[mouse_at_index] += delta;
-                                    uniforms->data[mouse_at_key].change = true;
-                                    uniforms->flagChange();
+                                UniformDataMap::const_iterator it = uniforms->getData().find(mouse_at_key);
+                                if (it != uniforms->getData().end() && it->second.size < 5 && mouse_at_index < it->second.size) {
+                                    const UniformData& data = it->second;
+                                    // through set() so the new value gets a version and is uploaded
+                                    std::vector<float> values(data.value.begin(), data.value.begin() + data.size);
+                                    values[mouse_at_index] += delta;
+                                    uniforms->set(mouse_at_key, values, false);
                                 }
                             }
                         }
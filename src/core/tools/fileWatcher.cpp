@@ -0,0 +1,298 @@
+#include "fileWatcher.h"
+
+#include <set>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <sys/stat.h>
+
+#if defined(SUPPORT_INOTIFY)
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+namespace {
+
+// Bigger files (videos, huge models) are never read, their modification time and size tell instead
+const int64_t MAX_HASH_BYTES = 64 * 1024 * 1024;
+
+// Up to (and with) the last slash, exactly as written in the path so folder + name gives it back
+std::string folderOf(const std::string& _path) {
+    size_t slash = _path.find_last_of('/');
+    return (slash == std::string::npos) ? "" : _path.substr(0, slash + 1);
+}
+
+}
+
+FileWatcher::FileWatcher() : m_notify(-1), m_debounceMs(50), m_pollMs(500), m_events(0), m_unchanged(0) {
+    #if defined(SUPPORT_INOTIFY)
+    m_notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_notify < 0)
+        std::cerr << "// inotify is not available, watching files by polling them" << std::endl;
+    #endif
+}
+
+FileWatcher::~FileWatcher() {
+    #if defined(SUPPORT_INOTIFY)
+    if (m_notify >= 0)
+        close(m_notify);
+    #endif
+}
+
+std::vector<std::string> FileWatcher::update(WatchFileList& _files, std::mutex& _mutex, int _timeoutMs) {
+    std::vector<std::string> changed;
+    std::vector<std::string> paths;
+    std::set<std::string> forced;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (size_t i = 0; i < _files.size(); i++) {
+            paths.push_back(_files[i].path);
+            if (_files[i].lastChange == 0)
+                forced.insert(_files[i].path);
+        }
+    }
+
+    _sync(paths);
+
+    // Reloads requested by zeroing lastChange skip the wait and the hash
+    for (std::set<std::string>::iterator it = forced.begin(); it != forced.end(); ++it) {
+        Entry& entry = m_entries[*it];
+        if (!_stat(*it, entry.modified, entry.size))
+            continue;
+        entry.hashed = _hash(*it, entry.size, entry.hash);
+        entry.pending = false;
+        changed.push_back(*it);
+    }
+
+    // Wait for events, or just for the debounce when something is already settling
+    bool pending = false;
+    for (std::map<std::string, Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+        pending = pending || it->second.pending;
+    int wait = (pending || !changed.empty()) ? std::min(m_debounceMs, _timeoutMs) : _timeoutMs;
+
+    #if defined(SUPPORT_INOTIFY)
+    if (m_notify >= 0)
+        _read(wait);
+    else
+    #endif
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds( std::min(wait, m_pollMs) ));
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (pending || now - m_lastPoll >= std::chrono::milliseconds(m_pollMs)) {
+            m_lastPoll = now;
+            for (std::map<std::string, Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+                // IMPORTANT: files that can't be stat'd (e.g. an #include dependency that is gone) are
+                // skipped, acting on stale data would reload them on every pass
+                int64_t modified, size;
+                if (!_stat(it->first, modified, size))
+                    continue;
+                if (modified != it->second.modified || size != it->second.size) {
+                    it->second.modified = modified;
+                    it->second.size = size;
+                    _touch(it->first);
+                }
+            }
+        }
+    }
+
+    // Report the ones that went quiet for a debounce period, if their content is really different
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for (std::map<std::string, Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+        Entry& entry = it->second;
+        if (!entry.pending || now - entry.last < std::chrono::milliseconds(m_debounceMs))
+            continue;
+
+        entry.pending = false;
+        int64_t modified = entry.modified;
+        int64_t size = entry.size;
+        if (!_stat(it->first, entry.modified, entry.size))
+            continue;
+
+        uint64_t hash = 0;
+        bool hashed = _hash(it->first, entry.size, hash);
+        if ( (hashed && entry.hashed && hash == entry.hash) ||
+             (!hashed && !entry.hashed && modified == entry.modified && size == entry.size) ) {
+            m_unchanged++;
+            continue;
+        }
+
+        entry.hash = hash;
+        entry.hashed = hashed;
+        if (std::find(changed.begin(), changed.end(), it->first) == changed.end())
+            changed.push_back(it->first);
+    }
+
+    if (!changed.empty()) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (size_t i = 0; i < _files.size(); i++) {
+            std::map<std::string, Entry>::iterator it = m_entries.find(_files[i].path);
+            if (it != m_entries.end() && std::find(changed.begin(), changed.end(), _files[i].path) != changed.end())
+                _files[i].lastChange = std::max((int64_t)1, it->second.modified / 1000000000);
+        }
+    }
+
+    return changed;
+}
+
+// Starts tracking new paths (with a baseline to compare against) and forgets the ones that are gone
+void FileWatcher::_sync(const std::vector<std::string>& _paths) {
+    std::set<std::string> current(_paths.begin(), _paths.end());
+
+    for (std::map<std::string, Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ) {
+        if (current.find(it->first) == current.end())
+            it = m_entries.erase(it);
+        else
+            ++it;
+    }
+
+    for (std::set<std::string>::iterator it = current.begin(); it != current.end(); ++it) {
+        if (m_entries.find(*it) != m_entries.end())
+            continue;
+
+        Entry& entry = m_entries[*it];
+        if (_stat(*it, entry.modified, entry.size))
+            entry.hashed = _hash(*it, entry.size, entry.hash);
+    }
+
+    #if defined(SUPPORT_INOTIFY)
+    if (m_notify < 0)
+        return;
+
+    std::set<std::string> folders;
+    for (std::set<std::string>::iterator it = current.begin(); it != current.end(); ++it)
+        folders.insert(folderOf(*it));
+
+    for (std::map<std::string, int>::iterator it = m_watches.begin(); it != m_watches.end(); ) {
+        if (folders.find(it->first) != folders.end()) {
+            ++it;
+            continue;
+        }
+
+        // The same folder written in two different ways shares the descriptor, keep it while one is used
+        int wd = it->second;
+        it = m_watches.erase(it);
+        bool shared = false;
+        for (std::map<std::string, int>::iterator other = m_watches.begin(); other != m_watches.end(); ++other)
+            shared = shared || (other->second == wd);
+        if (!shared)
+            inotify_rm_watch(m_notify, wd);
+    }
+
+    for (std::set<std::string>::iterator it = folders.begin(); it != folders.end(); ++it) {
+        if (m_watches.find(*it) != m_watches.end())
+            continue;
+
+        // Editors often save to a temporary file and rename it, so watch the folder, not the file
+        std::string folder = it->empty() ? "." : *it;
+        int wd = inotify_add_watch(m_notify, folder.c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE | IN_ATTRIB);
+        if (wd < 0) {
+            // most likely out of watches (fs.inotify.max_user_watches), poll everything instead
+            std::cerr << "// Can't watch " << folder << ", watching files by polling them" << std::endl;
+            close(m_notify);
+            m_notify = -1;
+            m_watches.clear();
+            return;
+        }
+        m_watches[*it] = wd;
+    }
+    #endif
+}
+
+void FileWatcher::_touch(const std::string& _path) {
+    std::map<std::string, Entry>::iterator it = m_entries.find(_path);
+    if (it == m_entries.end())
+        return;
+
+    it->second.pending = true;
+    it->second.last = std::chrono::steady_clock::now();
+    m_events++;
+}
+
+bool FileWatcher::_stat(const std::string& _path, int64_t& _modified, int64_t& _size) {
+    struct stat st;
+    if ( stat( _path.c_str(), &st ) != 0 )
+        return false;
+
+    #if defined(__APPLE__)
+    _modified = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+    #elif defined(__linux__)
+    _modified = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    #else
+    _modified = (int64_t)st.st_mtime * 1000000000;
+    #endif
+    _size = (int64_t)st.st_size;
+    return true;
+}
+
+// 64 bit FNV-1a of the whole content. False for files over MAX_HASH_BYTES, which don't get opened
+bool FileWatcher::_hash(const std::string& _path, int64_t _size, uint64_t& _hash) {
+    if (_size > MAX_HASH_BYTES)
+        return false;
+
+    FILE* file = fopen(_path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    uint64_t hash = 14695981039346656037ull;
+    unsigned char buffer[65536];
+    int64_t total = 0;
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        total += read;
+        if (total > MAX_HASH_BYTES) {
+            fclose(file);
+            return false;
+        }
+        for (size_t i = 0; i < read; i++) {
+            hash ^= buffer[i];
+            hash *= 1099511628211ull;
+        }
+    }
+    fclose(file);
+
+    _hash = hash;
+    return true;
+}
+
+#if defined(SUPPORT_INOTIFY)
+
+void FileWatcher::_read(int _timeoutMs) {
+    struct pollfd pfd;
+    pfd.fd = m_notify;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, _timeoutMs) <= 0)
+        return;
+
+    alignas(struct inotify_event) char buffer[16384];
+    for (;;) {
+        ssize_t length = read(m_notify, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+
+        for (char* ptr = buffer; ptr < buffer + length; ) {
+            const struct inotify_event* event = (const struct inotify_event*)ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            // Lost track of what happened, check everything
+            if (event->mask & IN_Q_OVERFLOW) {
+                for (std::map<std::string, Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+                    _touch(it->first);
+                continue;
+            }
+
+            if (event->len == 0)
+                continue;
+
+            std::string name(event->name);
+            for (std::map<std::string, int>::iterator it = m_watches.begin(); it != m_watches.end(); ++it)
+                if (it->second == event->wd)
+                    _touch(it->first + name);
+        }
+    }
+}
+
+#endif
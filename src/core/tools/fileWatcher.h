@@ -0,0 +1,68 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "files.h"
+
+// Linux gets notified by the kernel, everything else (or a failing inotify) polls stat()
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+#define SUPPORT_INOTIFY
+#endif
+
+/** Tells which of the watched files changed. With inotify it watches the folders that hold
+ *  them and sleeps until the kernel reports something, otherwise it stat()s every file at a
+ *  fixed interval. Either way a burst of events on a file (editors save in several steps) is
+ *  debounced until it settles, and the change is only reported if the content hash differs
+ *  from the last one seen. A WatchFile with lastChange == 0 is always reported (forced reload). **/
+class FileWatcher {
+public:
+    FileWatcher();
+    virtual ~FileWatcher();
+
+    // Waits up to _timeoutMs for changes on _files (read under _mutex) and returns their paths
+    std::vector<std::string> update(WatchFileList& _files, std::mutex& _mutex, int _timeoutMs = 500);
+
+    bool    isNotified() const { return m_notify >= 0; }
+
+    void    setDebounce(int _ms) { m_debounceMs = _ms; }
+    void    setPollInterval(int _ms) { m_pollMs = _ms; }
+
+    size_t  getEvents() const { return m_events; }          // raw events (or stat differences) seen
+    size_t  getUnchanged() const { return m_unchanged; }    // settled events with the same content
+
+protected:
+    struct Entry {
+        int64_t     modified    = 0;    // nanoseconds
+        int64_t     size        = -1;
+        uint64_t    hash        = 0;
+        bool        hashed      = false;
+        bool        pending     = false;
+        std::chrono::steady_clock::time_point   last;       // latest event while pending
+    };
+
+    void        _sync(const std::vector<std::string>& _paths);
+    void        _touch(const std::string& _path);
+    bool        _stat(const std::string& _path, int64_t& _modified, int64_t& _size);
+    bool        _hash(const std::string& _path, int64_t _size, uint64_t& _hash);
+
+    std::map<std::string, Entry>    m_entries;
+
+#if defined(SUPPORT_INOTIFY)
+    void        _read(int _timeoutMs);
+
+    std::map<std::string, int>      m_watches;          // folder (as written in the paths) -> watch descriptor
+#endif
+
+    int         m_notify;
+    int         m_debounceMs;
+    int         m_pollMs;
+    std::chrono::steady_clock::time_point   m_lastPoll;
+
+    size_t      m_events;
+    size_t      m_unchanged;
+};
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 
 enum FileType {
     FRAG_SHADER     = 0,
@@ -16,7 +17,7 @@ enum FileType {
 struct WatchFile {
     std::string path;
     FileType    type;
-    int         lastChange;
+    int64_t     lastChange; // seconds, 0 forces a reload
     bool        vFlip;      // Use for textures to know if they should be flipped or not
 };
 
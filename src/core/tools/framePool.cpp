@@ -0,0 +1,103 @@
+#include "framePool.h"
+
+void FrameRecycler::operator()(unsigned char* _pixels) const {
+    if (pool)
+        pool->release(_pixels, size);
+    else
+        delete[] _pixels;
+}
+
+FramePoolData::~FramePoolData() {
+    for (std::map<size_t, std::vector<unsigned char*> >::iterator it = idle.begin(); it != idle.end(); ++it)
+        for (size_t i = 0; i < it->second.size(); i++)
+            delete[] it->second[i];
+}
+
+void FramePoolData::release(unsigned char* _pixels, size_t _size) {
+    inUse--;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if ( (long long)(idleBytes + _size) > maxBytes ) {
+        delete[] _pixels;
+        return;
+    }
+
+    idle[_size].push_back(_pixels);
+    idleBytes += _size;
+}
+
+// Drops idle buffers until they fit in maxBytes, the caller holds the mutex
+void FramePoolData::trim() {
+    std::map<size_t, std::vector<unsigned char*> >::iterator it = idle.begin();
+    while ( (long long)idleBytes > maxBytes && it != idle.end() ) {
+        while ( !it->second.empty() && (long long)idleBytes > maxBytes ) {
+            delete[] it->second.back();
+            it->second.pop_back();
+            idleBytes -= it->first;
+        }
+        ++it;
+    }
+}
+
+FramePool::FramePool() : m_data(std::make_shared<FramePoolData>()) {
+}
+
+FramePool::~FramePool() {
+    // Frames still in flight keep m_data alive through their deleter
+}
+
+void FramePool::setMaxMemory(long long _bytes) {
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    m_data->maxBytes = _bytes;
+    m_data->trim();
+}
+
+long long FramePool::getMaxMemory() const {
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    return m_data->maxBytes;
+}
+
+FramePtr FramePool::get(size_t _size) {
+    unsigned char* pixels = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        std::map<size_t, std::vector<unsigned char*> >::iterator it = m_data->idle.find(_size);
+        if (it != m_data->idle.end() && !it->second.empty()) {
+            pixels = it->second.back();
+            it->second.pop_back();
+            m_data->idleBytes -= _size;
+        }
+    }
+
+    if (pixels)
+        m_data->reuses++;
+    else {
+        pixels = new unsigned char[_size];
+        m_data->allocations++;
+    }
+
+    size_t inUse = ++m_data->inUse;
+    size_t highWater = m_data->highWater.load();
+    while (inUse > highWater && !m_data->highWater.compare_exchange_weak(highWater, inUse));
+
+    return FramePtr(pixels, FrameRecycler(m_data, _size));
+}
+
+void FramePool::clear() {
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    for (std::map<size_t, std::vector<unsigned char*> >::iterator it = m_data->idle.begin(); it != m_data->idle.end(); ++it)
+        for (size_t i = 0; i < it->second.size(); i++)
+            delete[] it->second[i];
+    m_data->idle.clear();
+    m_data->idleBytes = 0;
+}
+
+size_t FramePool::getAllocations() const { return m_data->allocations.load(); }
+size_t FramePool::getReuses() const { return m_data->reuses.load(); }
+size_t FramePool::getInUse() const { return m_data->inUse.load(); }
+size_t FramePool::getHighWater() const { return m_data->highWater.load(); }
+size_t FramePool::getIdleBytes() const {
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    return m_data->idleBytes;
+}
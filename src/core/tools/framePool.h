@@ -0,0 +1,68 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+struct FramePoolData;
+
+/** Deleter that gives the memory back to its pool instead of freeing it. Frames made with plain
+ *  new[] (or whose pool is gone) get deleted as usual, so a std::unique_ptr<unsigned char[]>
+ *  converts into a FramePtr. **/
+struct FrameRecycler {
+    FrameRecycler() {}
+    FrameRecycler(const std::default_delete<unsigned char[]>&) {}
+    FrameRecycler(const std::shared_ptr<FramePoolData>& _pool, size_t _size) : pool(_pool), size(_size) {}
+
+    void operator()(unsigned char* _pixels) const;
+
+    std::shared_ptr<FramePoolData>  pool;
+    size_t                          size = 0;
+};
+
+using FramePtr = std::unique_ptr<unsigned char[], FrameRecycler>;
+
+/** Recycles the fixed-size pixel buffers that travel from the render thread to the saving threads
+ *  (PNG jobs or the ffmpeg pipe), so long recordings don't churn the heap. **/
+class FramePool {
+public:
+    FramePool();
+    virtual ~FramePool();
+
+    // Upper bound for the memory kept idle in the pool (usually max_mem_in_queue)
+    void        setMaxMemory(long long _bytes);
+    long long   getMaxMemory() const;
+
+    // Thread safe. The buffer comes back to the pool when the FramePtr is destroyed
+    FramePtr    get(size_t _size);
+
+    void        clear();
+
+    size_t      getAllocations() const;     // buffers created with new[]
+    size_t      getReuses() const;          // requests served from the pool
+    size_t      getInUse() const;           // buffers currently out of the pool
+    size_t      getHighWater() const;       // max buffers out at the same time
+    size_t      getIdleBytes() const;       // memory held idle by the pool
+
+private:
+    std::shared_ptr<FramePoolData>  m_data;
+};
+
+struct FramePoolData {
+    ~FramePoolData();
+
+    void    release(unsigned char* _pixels, size_t _size);
+    void    trim();
+
+    std::mutex                                      mutex;
+    std::map<size_t, std::vector<unsigned char*> >  idle;
+    size_t                                          idleBytes   = 0;
+    long long                                       maxBytes    = 0;
+
+    std::atomic<size_t>                             allocations {0};
+    std::atomic<size_t>                             reuses {0};
+    std::atomic<size_t>                             inUse {0};
+    std::atomic<size_t>                             highWater {0};
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
+
+#include "framePool.h"
+
+using Pixels        = FramePtr;
+
+// What the producer does when the queue is full
+enum FramePolicy {
+    FRAME_BLOCK = 0,    // wait for the consumer, every frame gets written (offline renders)
+    FRAME_DROP,         // discard the new frame, the renderer never waits
+    FRAME_DUPLICATE     // like DROP, plus the consumer repeats the last frame when it runs dry to keep a constant rate
+};
+
+const std::string frame_policy_options[] = { "block", "drop", "duplicate" };
+
+/** Bounded single producer / single consumer ring of frames. Both sides sleep on a
+ *  condition variable instead of spinning, so the throughput is set by the slowest of the two. **/
+class FrameQueue {
+public:
+    FrameQueue(size_t _capacity = 8, FramePolicy _policy = FRAME_BLOCK) {
+        setCapacity(_capacity);
+        setPolicy(_policy);
+    }
+
+    // Only takes effect on an empty queue
+    bool setCapacity(size_t _capacity) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_count > 0 || _capacity == 0)
+            return false;
+        m_ring.clear();
+        m_ring.resize(_capacity);
+        m_head = 0;
+        return true;
+    }
+
+    void setPolicy(FramePolicy _policy) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_policy = _policy;
+    }
+
+    // Resets the counters and accepts frames again
+    void open() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = false;
+        m_last.reset();
+        m_maxDepth = 0;
+        m_stalls = 0;
+        m_stallSecs = 0.0;
+        m_dropped = 0;
+        m_duplicated = 0;
+        m_consumed = 0;
+    }
+
+    // Wakes up the consumer, which will drain what is left and then stop
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+    // Returns false if the frame was dropped
+    bool produce(Pixels&& _pixels) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_closed)
+            return false;
+
+        if (m_count == m_ring.size()) {
+            if (m_policy != FRAME_BLOCK) {
+                m_dropped++;
+                return false;
+            }
+
+            m_stalls++;
+            auto start = std::chrono::steady_clock::now();
+            m_notFull.wait(lock, [this]{ return m_count < m_ring.size() || m_closed; });
+            m_stallSecs += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if (m_closed)
+                return false;
+        }
+
+        m_ring[(m_head + m_count) % m_ring.size()] = std::move(_pixels);
+        m_count++;
+        if (m_count > m_maxDepth)
+            m_maxDepth = m_count;
+
+        lock.unlock();
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    // Blocks until there is a frame. Returns false once the queue is closed and empty.
+    // With FRAME_DUPLICATE and a non-zero _period, an empty wait longer than _period hands back
+    // a copy of the last frame (of _size bytes) so the output keeps its rate.
+    bool consume(Pixels& _pixels, float _period = 0.0f, size_t _size = 0) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        if (m_policy == FRAME_DUPLICATE && _period > 0.0f && _size > 0 && m_last) {
+            auto timeout = std::chrono::duration<float>(_period);
+            if (!m_notEmpty.wait_for(lock, timeout, [this]{ return m_count > 0 || m_closed; })) {
+                _pixels = Pixels(new unsigned char[_size]);
+                std::copy(m_last.get(), m_last.get() + _size, _pixels.get());
+                m_duplicated++;
+                return true;
+            }
+        }
+        else
+            m_notEmpty.wait(lock, [this]{ return m_count > 0 || m_closed; });
+
+        if (m_count == 0)
+            return false;
+
+        _pixels = std::move(m_ring[m_head]);
+        m_head = (m_head + 1) % m_ring.size();
+        m_count--;
+        m_consumed++;
+        bool keep = (m_policy == FRAME_DUPLICATE && _size > 0);
+
+        lock.unlock();
+        m_notFull.notify_one();
+
+        // keep a copy around to repeat it if the producer falls behind (m_last is only touched by the consumer)
+        if (keep) {
+            if (!m_last)
+                m_last = Pixels(new unsigned char[_size]);
+            std::copy(_pixels.get(), _pixels.get() + _size, m_last.get());
+        }
+        return true;
+    }
+
+    size_t      size() const        { std::lock_guard<std::mutex> lock(m_mutex); return m_count; }
+    size_t      getCapacity() const { std::lock_guard<std::mutex> lock(m_mutex); return m_ring.size(); }
+    FramePolicy getPolicy() const   { std::lock_guard<std::mutex> lock(m_mutex); return m_policy; }
+    bool        isClosed() const    { std::lock_guard<std::mutex> lock(m_mutex); return m_closed; }
+
+    size_t      getMaxDepth() const     { std::lock_guard<std::mutex> lock(m_mutex); return m_maxDepth; }
+    size_t      getStalls() const       { std::lock_guard<std::mutex> lock(m_mutex); return m_stalls; }
+    double      getStallSecs() const    { std::lock_guard<std::mutex> lock(m_mutex); return m_stallSecs; }
+    size_t      getDropped() const      { std::lock_guard<std::mutex> lock(m_mutex); return m_dropped; }
+    size_t      getDuplicated() const   { std::lock_guard<std::mutex> lock(m_mutex); return m_duplicated; }
+    size_t      getConsumed() const     { std::lock_guard<std::mutex> lock(m_mutex); return m_consumed; }
+
+private:
+    mutable std::mutex          m_mutex;
+    std::condition_variable     m_notEmpty;
+    std::condition_variable     m_notFull;
+
+    std::vector<Pixels>         m_ring;
+    size_t                      m_head      = 0;
+    size_t                      m_count     = 0;
+    FramePolicy                 m_policy    = FRAME_BLOCK;
+    bool                        m_closed    = true;
+    Pixels                      m_last;
+
+    // Stats
+    size_t                      m_maxDepth  = 0;
+    size_t                      m_stalls    = 0;       // times the producer had to wait
+    double                      m_stallSecs = 0.0;     // time the producer spent waiting
+    size_t                      m_dropped   = 0;
+    size_t                      m_duplicated= 0;
+    size_t                      m_consumed  = 0;
+};
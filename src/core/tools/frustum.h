@@ -0,0 +1,30 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+/** Whether an axis aligned box (in the space _mvp takes from) can be seen: it's out only when
+ *  its eight corners, in clip space, are all on the outer side of the same plane. That keeps some
+ *  boxes that are out near the edges of the frustum, but never drops one that is in. Empty boxes
+ *  (min over max) are always kept. **/
+inline bool inFrustum(const glm::mat4& _mvp, const glm::vec3& _min, const glm::vec3& _max) {
+    if (_min.x > _max.x || _min.y > _max.y || _min.z > _max.z)
+        return true;
+
+    int outside[6] = { 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < 8; i++) {
+        glm::vec4 p = _mvp * glm::vec4( (i & 1) ? _max.x : _min.x,
+                                        (i & 2) ? _max.y : _min.y,
+                                        (i & 4) ? _max.z : _min.z, 1.0f);
+        outside[0] += p.x < -p.w;
+        outside[1] += p.x >  p.w;
+        outside[2] += p.y < -p.w;
+        outside[3] += p.y >  p.w;
+        outside[4] += p.z < -p.w;
+        outside[5] += p.z >  p.w;
+    }
+
+    for (int i = 0; i < 6; i++)
+        if (outside[i] == 8)
+            return false;
+    return true;
+}
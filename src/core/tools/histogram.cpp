@@ -0,0 +1,354 @@
+#include "histogram.h"
+
+#include <thread>
+#include <future>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include "vera/types/mesh.h"
+
+#include "blendState.h"
+
+#if defined(SUPPORT_GPU_HISTOGRAM)
+
+// Every vertex is a sample of the frame, it lands on the bin of its value
+const std::string histogram_vert = R"(
+#ifdef GL_ES
+precision highp float;
+#endif
+
+uniform sampler2D   u_tex0;
+uniform vec3        u_channel;
+
+attribute vec4      a_position;
+varying float       v_weight;
+
+void main() {
+    vec4 color = texture2DLod(u_tex0, a_position.xy, 0.0);
+    float bin = floor(dot(clamp(color.rgb, 0.0, 1.0), u_channel) * 255.0 + 0.5);
+
+    gl_Position = vec4((bin + 0.5) / 128.0 - 1.0, 0.0, 0.0, 1.0);
+    gl_PointSize = 1.0;
+    v_weight = color.a;
+}
+)";
+
+const std::string histogram_frag = R"(
+#ifdef GL_ES
+precision highp float;
+#endif
+
+uniform vec4        u_mask;
+varying float       v_weight;
+
+void main() {
+    gl_FragColor = u_mask * v_weight;
+}
+)";
+
+#endif
+
+Histogram::Histogram() : m_max_samples(1 << 20), m_pending(false), m_gpu(false)
+#if defined(SUPPORT_GPU_HISTOGRAM)
+    , m_points_width(0), m_points_height(0), m_texture(0), m_fbo(0), m_pbo(0), m_fence(0), m_init(false)
+#endif
+{
+    for (int i = 0; i < 256; i++)
+        m_bins[i] = glm::vec4(0.0f);
+}
+
+Histogram::~Histogram() {
+    clear();
+}
+
+void Histogram::clear() {
+    #if defined(SUPPORT_GPU_HISTOGRAM)
+    if (m_fence)
+        glDeleteSync(m_fence);
+    if (m_pbo)
+        glDeleteBuffers(1, &m_pbo);
+    if (m_fbo)
+        glDeleteFramebuffers(1, &m_fbo);
+    if (m_texture)
+        glDeleteTextures(1, &m_texture);
+    m_fence = 0;
+    m_pbo = 0;
+    m_fbo = 0;
+    m_texture = 0;
+    m_points.reset();
+    m_points_width = m_points_height = 0;
+    m_init = false;
+    #endif
+
+    m_pixels.clear();
+    m_partial.clear();
+    m_pending = false;
+    m_gpu = false;
+}
+
+bool Histogram::update(vera::Fbo& _fbo) {
+    if (!_fbo.isAllocated())
+        return false;
+
+    #if defined(SUPPORT_GPU_HISTOGRAM)
+    if (!m_init)
+        m_gpu = _initGPU();
+
+    if (m_gpu)
+        return _updateGPU(_fbo);
+    #endif
+
+    return _updateCPU(_fbo);
+}
+
+// Reads the whole frame and splits its rows between all the cores. Each thread counts into its own
+// bins (no sharing, no atomics) and they get merged at the end
+bool Histogram::_updateCPU(vera::Fbo& _fbo) {
+    int width = _fbo.getWidth();
+    int height = _fbo.getHeight();
+    if (width <= 0 || height <= 0)
+        return false;
+
+    m_pixels.resize((size_t)width * height * 4);
+
+    GLint alignment;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo.getId());
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, m_pixels.data());
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+
+    // This thread takes a share too
+    if (!m_threads)
+        m_threads = std::unique_ptr<thread_pool::ThreadPool>(new thread_pool::ThreadPool( std::max(1, (int)std::thread::hardware_concurrency() - 1) ));
+    unsigned int threads = std::min(m_threads->num_threads() + 1, (unsigned int)height);
+
+    // r, g, b and luma bins (weighted by alpha, so in 1/255 units) for each thread
+    m_partial.resize(threads);
+    std::vector< std::array<uint64_t, 1024> >& partial = m_partial;
+    const unsigned char* pixels = m_pixels.data();
+
+    auto count = [&](unsigned int _thread) {
+        std::array<uint64_t, 1024>& bins = partial[_thread];
+        bins.fill(0);
+
+        size_t start = (size_t)width * (height * _thread / threads) * 4;
+        size_t end = (size_t)width * (height * (_thread + 1) / threads) * 4;
+        for (size_t i = start; i < end; i += 4) {
+            uint32_t a = pixels[i + 3];
+            if (a == 0)
+                continue;
+
+            uint32_t r = pixels[i];
+            uint32_t g = pixels[i + 1];
+            uint32_t b = pixels[i + 2];
+            bins[r] += a;
+            bins[256 + g] += a;
+            bins[512 + b] += a;
+            // 0.299, 0.587, 0.114 in 8 bit fixed point
+            bins[768 + ((77 * r + 150 * g + 29 * b) >> 8)] += a;
+        }
+    };
+
+    std::vector< std::future<void> > workers;
+    for (unsigned int t = 1; t < threads; t++)
+        workers.push_back( m_threads->Submit(count, t) );
+    count(0);
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].wait();
+
+    for (int i = 0; i < 256; i++) {
+        uint64_t r = 0, g = 0, b = 0, l = 0;
+        for (unsigned int t = 0; t < threads; t++) {
+            r += partial[t][i];
+            g += partial[t][256 + i];
+            b += partial[t][512 + i];
+            l += partial[t][768 + i];
+        }
+        m_bins[i] = glm::vec4(float(r), float(g), float(b), float(l)) / 255.0f;
+    }
+
+    return true;
+}
+
+#if defined(SUPPORT_GPU_HISTOGRAM)
+
+// Blending into 32 bit float targets is core since desktop GL 3.0, GLES needs EXT_color_buffer_float
+// (to render into them) and EXT_float_blend (to blend them)
+bool floatBlending() {
+    const char* version = (const char*)glGetString(GL_VERSION);
+    if (version == nullptr)
+        return false;
+
+    const char* es = strstr(version, "OpenGL ES");
+    if (es == nullptr && atoi(version) >= 3)
+        return true;
+
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    if (extensions == nullptr)
+        return false;
+
+    if (es == nullptr)
+        return strstr(extensions, "GL_ARB_color_buffer_float") != nullptr;
+
+    return  strstr(extensions, "GL_EXT_color_buffer_float") != nullptr &&
+            strstr(extensions, "GL_EXT_float_blend") != nullptr;
+}
+
+bool Histogram::_initGPU() {
+    m_init = true;
+
+    if (!floatBlending()) {
+        std::cout << "Float render targets can't be blended, the histogram will be computed on the CPU" << std::endl;
+        return false;
+    }
+
+    // Points read the frame from the vertex shader
+    GLint units = 0;
+    glGetIntegerv(GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS, &units);
+    if (units <= 0)
+        return false;
+
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, 256, 1, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint previous = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+    glGenFramebuffers(1, &m_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texture, 0);
+    bool complete = (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+    if (!complete) {
+        std::cout << "Float render targets are not supported, the histogram will be computed on the CPU" << std::endl;
+        clear();
+        m_init = true;
+        return false;
+    }
+
+    glGenBuffers(1, &m_pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, 256 * 4 * sizeof(float), NULL, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    m_shader.setSource(histogram_frag, histogram_vert);
+    return true;
+}
+
+bool Histogram::_updateGPU(vera::Fbo& _fbo) {
+    // Only one pass in flight, the plot doesn't need more
+    bool ready = false;
+    if (m_pending) {
+        if (!_resolve())
+            return false;
+        ready = true;
+    }
+
+    // Sample the frame on a regular grid of at most m_max_samples points
+    int width = _fbo.getWidth();
+    int height = _fbo.getHeight();
+    int step = 1;
+    while ((size_t)((width + step - 1) / step) * ((height + step - 1) / step) > m_max_samples)
+        step++;
+    int samplesWidth = (width + step - 1) / step;
+    int samplesHeight = (height + step - 1) / step;
+
+    if (!m_points || samplesWidth != m_points_width || samplesHeight != m_points_height) {
+        vera::Mesh mesh;
+        mesh.setDrawMode(vera::POINTS);
+        for (int y = 0; y < samplesHeight; y++)
+            for (int x = 0; x < samplesWidth; x++)
+                mesh.addVertex( (x * step + 0.5f) / float(width), (y * step + 0.5f) / float(height), 0.0f );
+
+        m_points = std::unique_ptr<vera::Vbo>(new vera::Vbo(mesh));
+        m_points_width = samplesWidth;
+        m_points_height = samplesHeight;
+    }
+
+    GLint previous = 0;
+    GLint viewport[4];
+    GLfloat clearColor[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glViewport(0, 0, 256, 1);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    BlendState blend;
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    #if defined(GL_PROGRAM_POINT_SIZE)
+    GLboolean pointSize = glIsEnabled(GL_PROGRAM_POINT_SIZE);
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    #endif
+
+    // One pass per channel, each one adds into its own component of the bins
+    static const glm::vec3 channels[4] = {  glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+                                            glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.299f, 0.587f, 0.114f) };
+    m_shader.use();
+    m_shader.setUniformTexture("u_tex0", &_fbo, 0);
+    for (int i = 0; i < 4; i++) {
+        glm::vec4 mask(0.0f);
+        mask[i] = 1.0f;
+        m_shader.setUniform("u_channel", channels[i]);
+        m_shader.setUniform("u_mask", mask);
+        m_points->render(&m_shader);
+    }
+
+    // 4KB, copied into the pixel pack buffer without waiting
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo);
+    glReadPixels(0, 0, 256, 1, GL_RGBA, GL_FLOAT, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_pending = true;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+    blend.restore();
+    if (depthTest)
+        glEnable(GL_DEPTH_TEST);
+    #if defined(GL_PROGRAM_POINT_SIZE)
+    if (!pointSize)
+        glDisable(GL_PROGRAM_POINT_SIZE);
+    #endif
+
+    return ready;
+}
+
+bool Histogram::_resolve() {
+    if (m_fence) {
+        if (glClientWaitSync(m_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+            return false;
+
+        glDeleteSync(m_fence);
+        m_fence = 0;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo);
+    const float* bins = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 256 * 4 * sizeof(float), GL_MAP_READ_BIT);
+    if (bins) {
+        for (int i = 0; i < 256; i++)
+            m_bins[i] = glm::vec4(bins[i * 4], bins[i * 4 + 1], bins[i * 4 + 2], bins[i * 4 + 3]);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    m_pending = false;
+    return bins != nullptr;
+}
+
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+#include "readback.h"
+
+#include "vera/gl/gl.h"
+#include "vera/gl/fbo.h"
+#include "vera/gl/vbo.h"
+#include "vera/gl/shader.h"
+#include "glm/glm.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+// The GPU path scatters into a 32 bit float target with additive blending and reads the
+// 256 bins back through a pixel pack buffer, everything else uses the CPU path
+#if defined(SUPPORT_ASYNC_READBACK) && defined(GL_RGBA32F)
+#define SUPPORT_GPU_HISTOGRAM
+#endif
+
+/** Red, green, blue and luma histograms (256 bins each, weighted by alpha) of a framebuffer.
+ *  On the GPU every sample is drawn as a point into its bin of a 256x1 target and only those
+ *  bins travel back, a frame or two later. The fallback (also used when the GPU can't blend
+ *  float targets) reads the whole frame and counts it on all the CPU cores. **/
+class Histogram {
+public:
+    Histogram();
+    virtual ~Histogram();
+
+    // Starts a new pass over _fbo when the previous one is done. Returns true when new bins are ready
+    bool                update(vera::Fbo& _fbo);
+
+    // Frequencies per bin: r, g, b and luma in a
+    const glm::vec4*    getBins() const { return m_bins; }
+
+    bool                isPending() const { return m_pending; }
+    bool                isGPU() const { return m_gpu; }
+
+    // Upper bound of points scattered per channel on the GPU (default 1<<20), bigger frames are
+    // sampled on a regular grid, so the bins count samples and not pixels
+    void                setMaxSamples(size_t _samples) { m_max_samples = _samples; }
+
+    void                clear();
+
+protected:
+    bool                _updateCPU(vera::Fbo& _fbo);
+
+    glm::vec4           m_bins[256];
+    std::vector<unsigned char>  m_pixels;
+
+    // Started the first time the CPU path runs and kept for the next frames
+    std::unique_ptr<thread_pool::ThreadPool>    m_threads;
+    std::vector< std::array<uint64_t, 1024> >   m_partial;
+
+    size_t              m_max_samples;
+    bool                m_pending;
+    bool                m_gpu;
+
+#if defined(SUPPORT_GPU_HISTOGRAM)
+    bool                _initGPU();
+    bool                _updateGPU(vera::Fbo& _fbo);
+    bool                _resolve();
+
+    std::unique_ptr<vera::Vbo>  m_points;
+    vera::Shader        m_shader;
+    int                 m_points_width;
+    int                 m_points_height;
+
+    GLuint              m_texture;
+    GLuint              m_fbo;
+    GLuint              m_pbo;
+    GLsync              m_fence;
+    bool                m_init;
+#endif
+};
@@ -7,12 +7,14 @@
 
 #include "vera/ops/pixel.h"
 
+#include "framePool.h"
+
 /** Just a small helper that captures all the relevant data to save an image **/
 class Job {
 public:
     Job (const Job& ) = delete;
     Job (Job && ) = default;
-    Job (std::string _filename, int _width, int _height, std::unique_ptr<unsigned char[]>&& _pixels,
+    Job (std::string _filename, int _width, int _height, FramePtr&& _pixels,
          std::atomic<int>& _task_count, std::atomic<long long>& _max_mem_in_queue):
 
         m_filename(std::move(_filename)),
@@ -42,7 +44,7 @@ protected:
     std::string                         m_filename;
     int                                 m_width;
     int                                 m_height;
-    std::unique_ptr<unsigned char[]>    m_pixels;
+    FramePtr                            m_pixels;
     std::atomic<int> *                  m_task_count;
     std::atomic<long long> *            m_max_mem_in_queue;
 
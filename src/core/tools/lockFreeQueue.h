@@ -1,44 +1,88 @@
 #pragma once
 
-#include <list>
-#include <iterator>
-
-using Pixels        = std::unique_ptr<unsigned char[]>;
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
 
+/** Bounded multiple producer / single consumer ring that never takes a lock (Vyukov's
+ *  sequenced cells). Producers claim a cell with a CAS on the tail and publish it through
+ *  the cell's sequence, the consumer only touches the head. A full ring makes push()
+ *  fail instead of waiting, so callers decide what to do with the value. **/
+template<typename T>
 class LockFreeQueue {
 public:
+    LockFreeQueue(size_t _capacity = 1024) : m_head(0), m_tail(0), m_dropped(0) {
+        // round up to a power of two so the index is a mask
+        size_t capacity = 2;
+        while (capacity < _capacity)
+            capacity <<= 1;
 
-    LockFreeQueue() {
-        // Add one to validate the iterators
-        m_list.push_back( Pixels() );
-        m_headIt = m_list.begin();
-        m_tailIt = m_list.end();
+        m_cells = std::vector<Cell>(capacity);
+        for (size_t i = 0; i < capacity; i++)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        m_mask = capacity - 1;
     }
 
-    void produce( std::unique_ptr<unsigned char[]>&& t ) {
-        m_list.push_back( std::move(t) );
-        m_tailIt = m_list.end();
-        m_list.erase( m_list.begin(), m_headIt );
+    // Any thread. Returns false (and counts it as dropped) when the ring is full
+    bool push(T&& _value) {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(_value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+                pos = m_tail.load(std::memory_order_relaxed);
+        }
     }
 
-    bool consume( std::unique_ptr<unsigned char[]>&& t ) {
-        typename PixelList::iterator nextIt = m_headIt;
-        ++nextIt;
-        if ( nextIt != m_tailIt ) {
-            m_headIt = nextIt;
-            t        = std::move( *m_headIt );
-            return true;
-        }
+    bool push(const T& _value) {
+        T copy = _value;
+        return push(std::move(copy));
+    }
 
-        return false;
+    // Consumer thread only. Returns false when there is nothing published yet
+    bool pop(T& _value) {
+        Cell& cell = m_cells[m_head & m_mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if ((intptr_t)sequence - (intptr_t)(m_head + 1) < 0)
+            return false;
+
+        _value = std::move(cell.value);
+        cell.sequence.store(m_head + m_mask + 1, std::memory_order_release);
+        m_head++;
+        return true;
     }
 
-    int size() const { return std::distance( m_headIt, m_tailIt ) - 1; }
-    typename std::list<Pixels>::iterator getHead() const { return m_headIt; }
-    typename std::list<Pixels>::iterator getTail() const { return m_tailIt; }
+    // Consumer side
+    bool    empty() const       { return m_tail.load(std::memory_order_relaxed) == m_head; }
+    size_t  size() const        { return m_tail.load(std::memory_order_relaxed) - m_head; }
+    size_t  getCapacity() const { return m_mask + 1; }
+    size_t  getDropped() const  { return m_dropped.load(std::memory_order_relaxed); }
 
 private:
-    using PixelList = std::list<Pixels>;
-    PixelList                       m_list;
-    typename PixelList::iterator    m_headIt, m_tailIt;
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T                   value;
+
+        Cell() : sequence(0) {}
+        Cell(const Cell&) : sequence(0) {}
+    };
+
+    std::vector<Cell>   m_cells;
+    size_t              m_mask;
+    size_t              m_head;             // only the consumer moves it
+    std::atomic<size_t> m_tail;
+    std::atomic<size_t> m_dropped;
 };
@@ -0,0 +1,143 @@
+#include "readback.h"
+
+#if defined(SUPPORT_ASYNC_READBACK)
+
+#include <iostream>
+
+PixelReadback::PixelReadback(): m_head(0), m_tail(0), m_pending(0), m_width(0), m_height(0), m_channels(0) {
+}
+
+PixelReadback::~PixelReadback() {
+    clear();
+}
+
+bool PixelReadback::allocate(int _width, int _height, int _channels, size_t _ringSize) {
+    if (_width <= 0 || _height <= 0 || _ringSize == 0)
+        return false;
+
+    if (isAllocated()) {
+        if (_width == m_width && _height == m_height && _channels == m_channels && _ringSize == m_slots.size())
+            return true;
+
+        // frames in flight belong to the old size, deliver them before reallocating
+        flush();
+        clear();
+    }
+
+    m_width = _width;
+    m_height = _height;
+    m_channels = _channels;
+    m_head = 0;
+    m_tail = 0;
+    m_pending = 0;
+
+    GLsizeiptr size = (GLsizeiptr)m_width * m_height * m_channels;
+    m_slots.resize(_ringSize);
+    for (size_t i = 0; i < m_slots.size(); i++) {
+        glGenBuffers(1, &m_slots[i].pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_slots[i].pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    return true;
+}
+
+void PixelReadback::clear() {
+    for (size_t i = 0; i < m_slots.size(); i++) {
+        if (m_slots[i].fence)
+            glDeleteSync(m_slots[i].fence);
+        if (m_slots[i].pbo)
+            glDeleteBuffers(1, &m_slots[i].pbo);
+    }
+    m_slots.clear();
+    m_head = 0;
+    m_tail = 0;
+    m_pending = 0;
+}
+
+void PixelReadback::read(const std::string& _file, ReadbackCallback _callback) {
+    if (!isAllocated())
+        return;
+
+    // Ring is full: frame k-N has to leave before frame k can take its place
+    if (m_pending == m_slots.size()) {
+        resolve(m_slots[m_tail], true);
+        m_tail = (m_tail + 1) % m_slots.size();
+        m_pending--;
+    }
+
+    Slot& slot = m_slots[m_head];
+    slot.file = _file;
+    slot.callback = _callback;
+
+    GLint alignment;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    glReadPixels(0, 0, m_width, m_height, (m_channels == 3)? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    m_head = (m_head + 1) % m_slots.size();
+    m_pending++;
+
+    update();
+}
+
+void PixelReadback::update() {
+    while (m_pending > 0 && resolve(m_slots[m_tail], false)) {
+        m_tail = (m_tail + 1) % m_slots.size();
+        m_pending--;
+    }
+}
+
+void PixelReadback::flush() {
+    while (m_pending > 0) {
+        resolve(m_slots[m_tail], true);
+        m_tail = (m_tail + 1) % m_slots.size();
+        m_pending--;
+    }
+}
+
+bool PixelReadback::resolve(Slot& _slot, bool _wait) {
+    if (_slot.fence) {
+        GLenum status = glClientWaitSync(_slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+
+        if (status == GL_TIMEOUT_EXPIRED) {
+            if (!_wait)
+                return false;
+
+            // block until the GPU is done with this frame (in 1ms steps so the driver gets flushed)
+            while (status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(_slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        }
+
+        if (status == GL_WAIT_FAILED)
+            std::cerr << "Error waiting for the readback of " << _slot.file << std::endl;
+
+        glDeleteSync(_slot.fence);
+        _slot.fence = 0;
+    }
+
+    size_t size = (size_t)m_width * m_height * m_channels;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _slot.pbo);
+    const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if (pixels) {
+        if (_slot.callback)
+            _slot.callback(_slot.file, pixels, m_width, m_height);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    else
+        std::cerr << "Fail to map the pixels of " << _slot.file << std::endl;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    _slot.callback = nullptr;
+    return true;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "vera/gl/gl.h"
+
+// Pixel pack buffers, fences and buffer mapping are needed for the asynchronous path.
+// WebGL can't map buffers and GLES2 lacks PBOs, those fall back to a blocking glReadPixels.
+#if !defined(__EMSCRIPTEN__) && !defined(PLATFORM_RPI) && defined(GL_PIXEL_PACK_BUFFER) && defined(GL_SYNC_GPU_COMMANDS_COMPLETE)
+#define SUPPORT_ASYNC_READBACK
+#endif
+
+/** Called on the GL thread with the mapped pixels of a frame once the GPU is done writing them.
+ *  The memory is only valid during the call. **/
+typedef std::function<void(const std::string& _file, const unsigned char* _pixels, int _width, int _height)> ReadbackCallback;
+
+#if defined(SUPPORT_ASYNC_READBACK)
+
+/** Reads the bound framebuffer into a ring of N pixel pack buffers. Frame k is mapped
+ *  and handed to its callback only after its fence signals, which is usually N frames later,
+ *  so the GPU copy overlaps with the rendering of the next frames instead of stalling them. **/
+class PixelReadback {
+public:
+    PixelReadback();
+    virtual ~PixelReadback();
+
+    bool    allocate(int _width, int _height, int _channels, size_t _ringSize);
+    bool    isAllocated() const { return !m_slots.empty(); }
+    void    clear();
+
+    // Starts reading the bound framebuffer. If the ring is full the oldest frame is resolved first
+    void    read(const std::string& _file, ReadbackCallback _callback);
+
+    // Hands over, in order, the frames whose fence already signalled
+    void    update();
+
+    // Waits for and hands over every frame still in flight
+    void    flush();
+
+    size_t  getPending() const { return m_pending; }
+    size_t  getRingSize() const { return m_slots.size(); }
+    int     getWidth() const { return m_width; }
+    int     getHeight() const { return m_height; }
+    int     getChannels() const { return m_channels; }
+
+protected:
+    struct Slot {
+        GLuint              pbo     = 0;
+        GLsync              fence   = 0;
+        std::string         file    = "";
+        ReadbackCallback    callback;
+    };
+
+    bool    resolve(Slot& _slot, bool _wait);
+
+    std::vector<Slot>   m_slots;
+    size_t              m_head;     // next slot to write
+    size_t              m_tail;     // oldest slot in flight
+    size_t              m_pending;
+
+    int                 m_width;
+    int                 m_height;
+    int                 m_channels;
+};
+
+#endif
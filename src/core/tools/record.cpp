@@ -7,13 +7,22 @@
 #include <atomic>
 #include <thread>
 #include <chrono>
+#include <vector>
 
 #include "vera/ops/fs.h"
 #include "vera/ops/string.h"
 
-#include "lockFreeQueue.h"
 #include "console.h"
 
+#if defined(SUPPORT_LIBAV) && !defined(PLATFORM_RPI)
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+#endif
+
 #if defined( _WIN32 )
 #define P_CLOSE( file ) _pclose( file )
 #define P_OPEN( cmd ) _popen( cmd, "wb" )  // write binary?
@@ -35,25 +44,328 @@ bool  sec = false;
 size_t frame_start = 0;
 size_t frame_head = 0;
 size_t frame_end = 0;
+size_t frame_origin = 0;    // first frame of the whole range, before sharding
+size_t frame_step = 1;
 bool   frame = false;
 
+// Slice of the frame range rendered by this process (see --shard)
+int    shard_index = 0;
+int    shard_count = 1;
+bool   shard_interleaved = false;
+
+// Offline rendering: frames go back to back, not paced by the wall clock
+bool   offline = false;
+std::chrono::steady_clock::time_point wall_start;
+double wall_secs = 0.0;
+size_t wall_frames = 0;
+
+void recordingWallStart() {
+    wall_start = std::chrono::steady_clock::now();
+    wall_secs = 0.0;
+    wall_frames = 0;
+}
+
 #if defined(SUPPORT_LIBAV) && !defined(PLATFORM_RPI)
 
 // Video by Seconds
-using Clock         = std::chrono::steady_clock;
-using TimePoint     = std::chrono::time_point<Clock>;
-using Seconds       = std::chrono::duration<float>;
-
 FILE*                       pipe = nullptr;
-std::atomic<bool>           pipe_isRecording;
+std::atomic<bool>           pipe_isRecording(false);
+std::atomic<bool>           pipe_isProcessing(false);
 std::thread                 pipe_thread;
 RecordingSettings           pipe_settings;
+FrameQueue                  pipe_frames;
+
+// In-process encoder (RECORDING_LIBAV)
+AVFormatContext*            enc_format = nullptr;
+AVCodecContext*             enc_codec = nullptr;
+AVStream*                   enc_stream = nullptr;
+AVFrame*                    enc_frame = nullptr;
+AVPacket*                   enc_packet = nullptr;
+SwsContext*                 enc_sws = nullptr;
+AVRational                  enc_src_timebase;
+int64_t                     enc_pts = 0;
+int64_t                     enc_count = 0;
+bool                        enc_header = false;
+std::atomic<bool>           enc_isOpen(false);
+
+bool recordingPipe() { return ((pipe != nullptr || enc_isOpen.load()) && pipe_isRecording.load()); }
+
+void processFrame();
+
+void encoderClose(bool _finish);
+
+// Splits the ffmpeg arguments on spaces, keeping the quoted ones (like -vf "...") in one piece
+std::vector<std::string> encoderSplitArgs(const std::string& _args) {
+    std::vector<std::string> tokens;
+    std::string token = "";
+    bool quoted = false;
+    for (size_t i = 0; i < _args.size(); i++) {
+        char c = _args[i];
+        if (c == '"' || c == '\'')
+            quoted = !quoted;
+        else if (c == ' ' && !quoted) {
+            if (token.size() > 0)
+                tokens.push_back(token);
+            token = "";
+        }
+        else
+            token += c;
+    }
+    if (token.size() > 0)
+        tokens.push_back(token);
+    return tokens;
+}
+
+// Applies the output options of trg_args to the encoder, so both backends honour the same
+// arguments: -crf, -preset, -tune, -g, -b:v... are set by name on the codec or its private
+// options. The ones the encoder setup already takes care of (frame rate, flip and scale,
+// pixel format) are skipped, the rest can't be done in-process and get a warning.
+void encoderArgs() {
+    std::vector<std::string> tokens = encoderSplitArgs(pipe_settings.trg_args);
+    for (size_t i = 0; i < tokens.size(); i++) {
+        if (tokens[i].size() < 2 || tokens[i][0] != '-')
+            continue;
+
+        std::string name = tokens[i].substr(1);
+        std::string value = "";
+        if (i + 1 < tokens.size() && (tokens[i+1][0] != '-' || vera::isNumber(tokens[i+1])))
+            value = tokens[++i];
+
+        // stream specifiers, like the :v of -b:v, all go to the only stream there is
+        size_t colon = name.find(':');
+        if (colon != std::string::npos)
+            name = name.substr(0, colon);
+
+        if (name == "r" || name == "vf" || name == "vsync")
+            continue;
+        // picked by encoderOpen()
+        else if (name == "c" || name == "vcodec")
+            continue;
+        else if (name == "pix_fmt") {
+            if (value != "yuv420p")
+                std::cerr << "libav only encodes yuv420p, use record_backend,ffmpeg for " << value << std::endl;
+        }
+        else if (value == "" || av_opt_set(enc_codec, name.c_str(), value.c_str(), AV_OPT_SEARCH_CHILDREN) < 0)
+            std::cerr << "libav ignores -" << name << ", use record_backend,ffmpeg for it" << std::endl;
+    }
+}
+
+// The encoder -c:v (or -vcodec) asks for in trg_args, empty for the default of the format
+std::string encoderCodecName() {
+    std::vector<std::string> tokens = encoderSplitArgs(pipe_settings.trg_args);
+    for (size_t i = 0; i + 1 < tokens.size(); i++)
+        if (tokens[i] == "-c:v" || tokens[i] == "-c" || tokens[i] == "-vcodec")
+            return tokens[i + 1];
+    return "";
+}
+
+// Whether the encoder takes yuv420p frames, the only ones the GPU conversion packs
+bool encoderTakesYUV420p(const AVCodec* _codec) {
+    const enum AVPixelFormat* formats = nullptr;
+    int count = 0;
+
+    #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(61, 13, 100)
+    const void* configs = nullptr;
+    if ( avcodec_get_supported_config(NULL, _codec, AV_CODEC_CONFIG_PIX_FORMAT, 0, &configs, &count) < 0 )
+        return false;
+    formats = (const enum AVPixelFormat*)configs;
+    #else
+    formats = _codec->pix_fmts;
+    if ( formats )
+        while (formats[count] != AV_PIX_FMT_NONE)
+            count++;
+    #endif
+
+    // encoders that don't say are left to the ffmpeg pipe
+    for (int i = 0; formats && i < count; i++)
+        if (formats[i] == AV_PIX_FMT_YUV420P)
+            return true;
+    return false;
+}
+
+bool encoderOpen() {
+    const char* path = pipe_settings.trg_path.c_str();
+
+    if ( avformat_alloc_output_context2(&enc_format, NULL, NULL, path) < 0 || !enc_format ) {
+        std::cerr << "libav can't guess the format of " << pipe_settings.trg_path << std::endl;
+        return false;
+    }
+
+    // The one -c:v names or the default of the format. Only encoders that take yuv420p, the
+    // others (like GIF palettes) are left to the ffmpeg pipe
+    std::string name = encoderCodecName();
+    const AVCodec* codec = nullptr;
+    if ( name.empty() )
+        codec = avcodec_find_encoder(enc_format->oformat->video_codec);
+    else if ( !(codec = avcodec_find_encoder_by_name(name.c_str())) )
+        std::cerr << "libav has no " << name << " encoder" << std::endl;
+
+    if ( !codec || !encoderTakesYUV420p(codec) ) {
+        encoderClose(false);
+        return false;
+    }
+
+    enc_stream = avformat_new_stream(enc_format, NULL);
+    enc_codec = avcodec_alloc_context3(codec);
+    if ( !enc_stream || !enc_codec ) {
+        encoderClose(false);
+        return false;
+    }
+
+    AVRational fps = av_d2q(pipe_settings.trg_fps, 100000);
+    enc_codec->width = pipe_settings.trg_width;
+    enc_codec->height = pipe_settings.trg_height;
+    enc_codec->framerate = fps;
+    enc_codec->time_base = av_inv_q(fps);
+    enc_codec->pix_fmt = AV_PIX_FMT_YUV420P;
+    av_opt_set(enc_codec->priv_data, "crf", vera::toString(pipe_settings.trg_crf).c_str(), 0);
+    encoderArgs();
+
+    if ( enc_format->oformat->flags & AVFMT_GLOBALHEADER )
+        enc_codec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    if ( avcodec_open2(enc_codec, codec, NULL) < 0 ||
+         avcodec_parameters_from_context(enc_stream->codecpar, enc_codec) < 0 ) {
+        std::cerr << "libav can't open the " << codec->name << " encoder" << std::endl;
+        encoderClose(false);
+        return false;
+    }
+    enc_stream->time_base = enc_codec->time_base;
+
+    if ( !(enc_format->oformat->flags & AVFMT_NOFILE) && avio_open(&enc_format->pb, path, AVIO_FLAG_WRITE) < 0 ) {
+        std::cerr << "libav can't open " << pipe_settings.trg_path << std::endl;
+        encoderClose(false);
+        return false;
+    }
+
+    if ( avformat_write_header(enc_format, NULL) < 0 ) {
+        encoderClose(false);
+        return false;
+    }
+    enc_header = true;
+
+    enc_frame = av_frame_alloc();
+    enc_frame->format = enc_codec->pix_fmt;
+    enc_frame->width = enc_codec->width;
+    enc_frame->height = enc_codec->height;
+    enc_packet = av_packet_alloc();
+    if ( av_frame_get_buffer(enc_frame, 0) < 0 || !enc_packet ) {
+        encoderClose(false);
+        return false;
+    }
+
+    AVPixelFormat src_fmt = AV_PIX_FMT_RGB24;
+    if (pipe_settings.src_pix_fmt == PIX_FMT_YUV420P)   src_fmt = AV_PIX_FMT_YUV420P;
+    else if (pipe_settings.src_pix_fmt == PIX_FMT_NV12) src_fmt = AV_PIX_FMT_NV12;
+
+    bool scale = pipe_settings.src_width != pipe_settings.trg_width || pipe_settings.src_height != pipe_settings.trg_height;
+    enc_sws = sws_getContext(   pipe_settings.src_width, pipe_settings.src_height, src_fmt,
+                                pipe_settings.trg_width, pipe_settings.trg_height, AV_PIX_FMT_YUV420P,
+                                scale ? SWS_LANCZOS : SWS_POINT, NULL, NULL, NULL);
+    if ( !enc_sws ) {
+        encoderClose(false);
+        return false;
+    }
+
+    enc_src_timebase = av_inv_q(av_d2q(pipe_settings.src_fps, 100000));
+    enc_pts = 0;
+    enc_count = 0;
+    enc_isOpen = true;
+    return true;
+}
+
+// Hands the encoded packets to the muxer
+bool encoderDrain() {
+    int ret;
+    while ( (ret = avcodec_receive_packet(enc_codec, enc_packet)) >= 0 ) {
+        av_packet_rescale_ts(enc_packet, enc_codec->time_base, enc_stream->time_base);
+        enc_packet->stream_index = enc_stream->index;
+        if ( av_interleaved_write_frame(enc_format, enc_packet) < 0 )
+            return false;
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+}
+
+bool encoderWrite(const unsigned char* _pixels) {
+    const int w = pipe_settings.src_width;
+    const int h = pipe_settings.src_height;
+
+    // Rows come bottom-up from glReadPixels, walk every plane backwards to flip them (the pipe uses vflip)
+    const uint8_t* src[4] = { NULL, NULL, NULL, NULL };
+    int stride[4] = { 0, 0, 0, 0 };
+    if (pipe_settings.src_pix_fmt == PIX_FMT_RGB24) {
+        src[0] = _pixels + (size_t)(h - 1) * w * 3;     stride[0] = -w * 3;
+    }
+    else {
+        const unsigned char* chroma = _pixels + (size_t)w * h;
+        src[0] = _pixels + (size_t)(h - 1) * w;         stride[0] = -w;
+        if (pipe_settings.src_pix_fmt == PIX_FMT_NV12) {
+            src[1] = chroma + (size_t)(h/2 - 1) * w;    stride[1] = -w;
+        }
+        else {
+            src[1] = chroma + (size_t)(h/2 - 1) * (w/2);                     stride[1] = -w/2;
+            src[2] = chroma + (size_t)w * h / 4 + (size_t)(h/2 - 1) * (w/2); stride[2] = -w/2;
+        }
+    }
+
+    if ( av_frame_make_writable(enc_frame) < 0 )
+        return false;
+
+    sws_scale(enc_sws, src, stride, 0, h, enc_frame->data, enc_frame->linesize);
+
+    // Resample src_fps into trg_fps like the fps filter does: drop or repeat frames
+    int64_t pts = av_rescale_q(enc_count++, enc_src_timebase, enc_codec->time_base);
+    while ( enc_pts <= pts ) {
+        enc_frame->pts = enc_pts++;
+        if ( avcodec_send_frame(enc_codec, enc_frame) < 0 || !encoderDrain() )
+            return false;
+    }
 
-TimePoint                   pipe_start;
-TimePoint                   pipe_lastFrame;
-LockFreeQueue               pipe_frames;
+    return true;
+}
+
+void encoderClose(bool _finish) {
+    enc_isOpen = false;
+
+    if ( _finish && enc_codec && enc_header ) {
+        avcodec_send_frame(enc_codec, NULL);
+        encoderDrain();
+        av_write_trailer(enc_format);
+    }
+
+    if ( enc_sws )      sws_freeContext(enc_sws);
+    if ( enc_frame )    av_frame_free(&enc_frame);
+    if ( enc_packet )   av_packet_free(&enc_packet);
+    if ( enc_codec )    avcodec_free_context(&enc_codec);
+    if ( enc_format ) {
+        if ( enc_format->pb && !(enc_format->oformat->flags & AVFMT_NOFILE) )
+            avio_closep(&enc_format->pb);
+        avformat_free_context(enc_format);
+    }
+
+    enc_format = nullptr;
+    enc_codec = nullptr;
+    enc_stream = nullptr;
+    enc_frame = nullptr;
+    enc_packet = nullptr;
+    enc_sws = nullptr;
+    enc_header = false;
+}
 
-bool recordingPipe() { return (pipe != nullptr && pipe_isRecording.load()); }
+// Starts the thread that feeds the pipe or the encoder from the frame queue
+bool recordingPipeStart() {
+    if ( !pipe_frames.setCapacity( pipe_settings.queue_capacity ) )
+        std::cerr << "Can't resize the frame queue to " << pipe_settings.queue_capacity << " frames, keeping " << pipe_frames.getCapacity() << std::endl;
+    // Offline every frame must reach the file, dropping or duplicating only makes sense in real time
+    pipe_frames.setPolicy( offline ? FRAME_BLOCK : pipe_settings.queue_policy );
+    pipe_frames.open();
+
+    // The consumer sleeps on the queue until frames arrive, it never spins
+    pipe_isProcessing = true;
+    pipe_thread = std::thread( &processFrame );
+
+    return pipe_isRecording = true;
+}
 
 // From https://github.com/tyhenry/ofxFFmpeg
 bool recordingPipeOpen(const RecordingSettings& _settings, float _start, float _end) {
@@ -62,11 +374,15 @@ bool recordingPipeOpen(const RecordingSettings& _settings, float _start, float _
         return false;
     }
 
-    if (pipe_frames.size() > 0) {
+    if (pipe_isProcessing.load()) {
         std::cerr << "Can't start recording - previous recording is still processing." << std::endl;
         return false;
     }
 
+    // the previous consumer is done, collect it
+    if ( pipe_thread.joinable() )
+        pipe_thread.join();
+
     pipe_settings = _settings;
     if ( pipe_settings.trg_path.empty() ) {
         std::cerr << "Can't start recording - output path is not set!" << std::endl;
@@ -92,13 +408,28 @@ bool recordingPipeOpen(const RecordingSettings& _settings, float _start, float _
     if ( pipe_settings.ffmpegPath.empty() )
         pipe_settings.ffmpegPath = "ffmpeg";
 
+    if ( pipe_settings.src_pix_fmt != PIX_FMT_RGB24 && 
+        (pipe_settings.src_width % 4 != 0 || pipe_settings.src_height % 2 != 0) ) {
+        std::cerr << "Can't record " << pix_fmt_options[pipe_settings.src_pix_fmt] << " frames of " << pipe_settings.src_width << "x" << pipe_settings.src_height << " (width must be a multiple of 4 and height even), using rgb24." << std::endl;
+        pipe_settings.src_pix_fmt = PIX_FMT_RGB24;
+    }
+
     fdelta = 1.0/pipe_settings.src_fps;
     counter = 0;
+    recordingWallStart();
 
     sec_start = _start;
     sec_head = _start;
     sec_end = _end;
 
+    if ( pipe_settings.backend == RECORDING_LIBAV ) {
+        if ( encoderOpen() )
+            return recordingPipeStart();
+
+        std::cerr << "libav can't encode " << pipe_settings.trg_path << ", falling back to " << pipe_settings.ffmpegPath << std::endl;
+        pipe_settings.backend = RECORDING_FFMPEG_PIPE;
+    }
+
     std::string cmd = pipe_settings.ffmpegPath;
     std::vector<std::string> args = {
         "-y",   // overwrite
@@ -114,7 +445,7 @@ bool recordingPipeOpen(const RecordingSettings& _settings, float _start, float _
         "-s " + std::to_string( pipe_settings.src_width ) +     // input resolution width
             "x" + std::to_string( pipe_settings.src_height ),   // input resolution height
         "-f rawvideo",                                          // input codec
-        "-pix_fmt rgb24",                                       // input pixel format
+        "-pix_fmt " + pix_fmt_options[pipe_settings.src_pix_fmt],   // input pixel format
         pipe_settings.src_args,                                 // custom input args
         "-i pipe:",                                             // input source (default pipe)
 
@@ -143,53 +474,59 @@ bool recordingPipeOpen(const RecordingSettings& _settings, float _start, float _
         return false;
     }
 
-    return pipe_isRecording = true;
+    return recordingPipeStart();
 }
 
-void processFrame() {
-    while ( pipe_isRecording.load() ) {
-
-        TimePoint lastFrameTime = Clock::now();
-        const float framedur    = 1.f / pipe_settings.src_fps;
-
-        while ( pipe_frames.size() ) {  // allows finish processing queue after we call stop()
-
-            // feed frames at constant fps
-            float delta = Seconds( Clock::now() - lastFrameTime ).count();
+size_t recordingFrameSize(const RecordingSettings& _settings) {
+    if (_settings.src_pix_fmt == PIX_FMT_RGB24)
+        return _settings.src_width * _settings.src_height * 3;
 
-            if ( delta >= framedur ) {
-                
-                if ( !pipe_isRecording.load() ) {
-                    console_clear();
-                    std::cout << "Don't close. Recording stopped, but still processing " << pipe_frames.size() << " frames" << std::endl;
-                }
+    // full resolution luma plus two quarter resolution chroma planes
+    return _settings.src_width * _settings.src_height * 3 / 2;
+}
 
-                Pixels pixels;
-                if ( pipe_frames.consume( std::move( pixels ) ) && pixels ) {
-                    std::unique_ptr<unsigned char[]> data = std::move( pixels );
-                    const size_t dataLength = pipe_settings.src_width * pipe_settings.src_height * pipe_settings.src_channels;
-                    const size_t written = pipe ? fwrite( data.get(), sizeof( char ), dataLength, pipe ) : 0;
+RecordingPixelFormat recordingPipePixelFormat() { return pipe_settings.src_pix_fmt; }
 
-                    if ( written <= 0 )
-                        std::cout << "Unable to write the frame." << std::endl;
+void processFrame() {
+    const size_t dataLength = recordingFrameSize( pipe_settings );
+
+    // Only FRAME_DUPLICATE paces the output against the wall clock, the other policies write
+    // as fast as ffmpeg takes the data, every frame is already a fixed time step
+    const float framedur    = 1.f / pipe_settings.src_fps;
+
+    Pixels pixels;
+    while ( pipe_frames.consume( pixels, framedur, dataLength ) ) {
+        if ( !pipe_isRecording.load() ) {
+            console_clear();
+            std::cout << "Don't close. Recording stopped, but still processing " << pipe_frames.size() << " frames" << std::endl;
+            console_refresh();
+        }
 
-                    lastFrameTime = Clock::now();
-                }
+        if ( pixels && enc_isOpen.load() ) {
+            if ( !encoderWrite( pixels.get() ) )
+                std::cout << "Unable to encode the frame." << std::endl;
+        }
+        else if ( pixels ) {
+            const size_t written = pipe ? fwrite( pixels.get(), sizeof( char ), dataLength, pipe ) : 0;
 
-                console_refresh();
-            }
+            if ( written <= 0 )
+                std::cout << "Unable to write the frame." << std::endl;
         }
+    }
 
+    // flush the encoder and close the file
+    if ( enc_isOpen.load() ) {
         console_clear();
         std::cout << "Don't close. Encoding data into " << pipe_settings.trg_path << std::endl;
+        encoderClose(true);
+        std::cout << "Finish saving " << pipe_settings.trg_path << std::endl;
         console_refresh();
-
     }
+
     // close ffmpeg pipe once stopped recording
-    
-    
     if ( pipe ) {
         console_clear();
+        std::cout << "Don't close. Encoding data into " << pipe_settings.trg_path << std::endl;
         if ( P_CLOSE( pipe ) < 0 ) {
             // // get error string from 'errno' code
             // char errmsg[500];
@@ -204,68 +541,45 @@ void processFrame() {
     
     pipe   = nullptr;
     counter = 0;
+    pipe_isProcessing = false;
 }
 
-size_t recordingPipeFrame( std::unique_ptr<unsigned char[]>&& _pixels ) {
+size_t recordingPipeFrame( FramePtr&& _pixels ) {
     if ( !pipe_isRecording ) {
         std::cerr << "Can't add new frame - not in recording mode." << std::endl;
         return 0;
     }
 
-    if ( !pipe ) {
+    if ( !pipe && !enc_isOpen.load() ) {
         std::cerr << "Can't add new frame - FFmpeg pipe is invalid!" << std::endl;
         return 0;
     }
 
-    if ( counter == 0 ) {
-        if ( pipe_thread.joinable() ) pipe_thread.join();  //detach();
-        pipe_thread     = std::thread( &processFrame );
-        pipe_start      = Clock::now();
-        pipe_lastFrame  = pipe_start;
-    }
-
-    pipe_frames.produce( std::move(_pixels) );
-    pipe_lastFrame = Clock::now();
-
-    size_t written              = 0;
-
-    // // add new frame(s) at specified frame rate
-    // float recordedDuration      = counter / pipe_settings.fps;
-    // const float delta           = Seconds( Clock::now() - pipe_start ).count() - recordedDuration;
-    // const size_t framesToWrite  = delta * pipe_settings.fps;
-    // Pixels pixels;
-    // // drop or duplicate frames to maintain constant framerate
-    // while ( counter == 0 || framesToWrite > written ) {
-    //     // copy pixel data
-    //     if ( !pixPtr )
-    //         pixPtr = new ofPixels( pixels );  
-
-    //     if ( written == framesToWrite - 1 )
-    //         // only the last frame we produce owns the pixel data
-    //         m_frames.produce( pixPtr );
-    //     else {
-    //         // otherwise, we reference the data
-    //         ofPixels *pixRef = new ofPixels();
-    //         pixRef->setFromExternalPixels( pixPtr->getData(), pixPtr->getWidth(), pixPtr->getHeight(), pixPtr->getPixelFormat() );  // re-use already copied pointer
-    //         m_frames.produce( pixRef );
-    //     }
-    //     ++counter;
-    //     ++written;
-    //     pipe_lastFrame = Clock::now();
-    // }
-
-    return written;
+    // Depending on the policy a full queue blocks the renderer or drops this frame
+    return pipe_frames.produce( std::move(_pixels) ) ? 1 : 0;
 }
 
 void recordingPipeClose() {
     frame = false;
     sec = false;
+    pipe_isRecording = false;
+    pipe_frames.close();
 
     if ( pipe_thread.joinable() ) 
         pipe_thread.join();
+}
 
-    if ( pipe != nullptr )
-        P_CLOSE( pipe );
+RecordingQueueStats getRecordingQueueStats() {
+    RecordingQueueStats stats;
+    stats.capacity      = pipe_frames.getCapacity();
+    stats.depth         = pipe_frames.size();
+    stats.maxDepth      = pipe_frames.getMaxDepth();
+    stats.stalls        = pipe_frames.getStalls();
+    stats.stallSecs     = pipe_frames.getStallSecs();
+    stats.dropped       = pipe_frames.getDropped();
+    stats.duplicated    = pipe_frames.getDuplicated();
+    stats.written       = pipe_frames.getConsumed();
+    return stats;
 }
 
 #else
@@ -278,6 +592,7 @@ bool    recordingPipe() { return false; };
 void recordingStartSecs(float _start, float _end, float _fps) {
     fdelta = 1.0/_fps;
     counter = 0;
+    recordingWallStart();
 
     sec_start = _start;
     sec_head = _start;
@@ -285,14 +600,44 @@ void recordingStartSecs(float _start, float _end, float _fps) {
     sec = true;
 }
 
+bool recordingShard(int _index, int _count, bool _interleaved) {
+    if (_count < 1 || _index < 0 || _index >= _count) {
+        std::cerr << "Invalid shard " << _index << "/" << _count << std::endl;
+        return false;
+    }
+
+    shard_index = _index;
+    shard_count = _count;
+    shard_interleaved = _interleaved;
+    return true;
+}
+
 void recordingStartFrames(int _start, int _end, float _fps) {
     fdelta = 1.0/_fps;
     counter = 0;
+    recordingWallStart();
+
+    frame_origin = _start;
+    frame_step = 1;
+
+    // Every shard works out its own slice from the same range, no coordination needed
+    if (shard_count > 1) {
+        if (shard_interleaved) {
+            _start += shard_index;
+            frame_step = shard_count;
+        }
+        else {
+            int total = _end - _start;
+            int begin = _start + (total * shard_index) / shard_count;
+            _end = _start + (total * (shard_index + 1)) / shard_count;
+            _start = begin;
+        }
+    }
 
     frame_start = _start;
     frame_head = _start;
     frame_end = _end;
-    frame = true;
+    frame = _start < _end;
 }
 
 void recordingFrameAdded() {
@@ -306,20 +651,61 @@ void recordingFrameAdded() {
     #if defined(SUPPORT_LIBAV) && !defined(PLATFORM_RPI)
     else if (recordingPipe()) {
         sec_head += fdelta;
-        if (sec_head >= sec_end)
+        if (sec_head >= sec_end) {
             pipe_isRecording = false;
+            pipe_frames.close();
+        }
     }
     #endif
     else if (frame) {
-        frame_head++;
+        frame_head += frame_step;
         if (frame_head >= frame_end)
             frame = false;
     }
+
+    if (!isRecording()) {
+        wall_frames = counter;
+        wall_secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+        if (offline) {
+            console_clear();
+            std::cout << "Rendered " << wall_frames << " frames in " << wall_secs << " secs (" << getRecordingFps() << " fps)" << std::endl;
+            console_refresh();
+        }
+    }
+}
+
+// True when the next recordingFrameAdded() will end the sequence
+bool recordingLastFrame() {
+    if (sec || recordingPipe())
+        return sec_head + fdelta >= sec_end;
+    else if (frame)
+        return frame_head + frame_step >= frame_end;
+    return false;
 }
 
 bool isRecording() { return sec || frame || recordingPipe(); }
 
+void recordingOffline(bool _offline) { offline = _offline; }
+bool isRecordingOffline() { return offline; }
+
+float getRecordingFps() {
+    // while recording measure up to now, once done report the whole sequence
+    if (isRecording()) {
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+        return secs > 0.0 ? counter / secs : 0.0f;
+    }
+    return wall_secs > 0.0 ? wall_frames / wall_secs : 0.0f;
+}
+
 int getRecordingCount() { return counter; }
+
+int getRecordingIndex() {
+    // frames are numbered from the start of the whole range so shards don't overwrite each other
+    if (frame && !sec && !recordingPipe())
+        return frame_head - frame_origin;
+    return counter;
+}
 float getRecordingDelta() { return fdelta; }
 
 float getRecordingPercentage() {
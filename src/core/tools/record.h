@@ -4,37 +4,88 @@
 #include <memory>
 
 #if defined(SUPPORT_LIBAV) && !defined(PLATFORM_RPI)
+#include "frameQueue.h"
+
+// Layout of the frames sent to ffmpeg. The YUV ones are converted on the GPU (BT.601, limited range)
+// and need a width multiple of 4 and an even height
+enum RecordingPixelFormat {
+    PIX_FMT_RGB24 = 0,
+    PIX_FMT_YUV420P,
+    PIX_FMT_NV12
+};
+
+const std::string pix_fmt_options[] = { "rgb24", "yuv420p", "nv12" };
+
+// Who encodes the frames: libav inside glslViewer, or an ffmpeg process fed through a pipe
+enum RecordingBackend {
+    RECORDING_LIBAV = 0,
+    RECORDING_FFMPEG_PIPE
+};
+
+const std::string recording_backend_options[] = { "libav", "ffmpeg" };
+
 struct RecordingSettings {
+    RecordingBackend backend    = RECORDING_FFMPEG_PIPE; // libav is opt-in, and falls back to the pipe if it can't encode the target
     std::string ffmpegPath      = "ffmpeg";
     std::string src_args        = "";
     size_t      src_width       = 512;
     size_t      src_height      = 512;
-    size_t      src_channels    = 3;
+    RecordingPixelFormat src_pix_fmt = PIX_FMT_RGB24;
     float       src_fps         = 24.0f;
 
     size_t      trg_width       = 512;
     size_t      trg_height      = 512;
     float       trg_fps         = 24.0f;
 
+    int         trg_crf         = 10;                   // libav only, when trg_args has no -crf
     std::string trg_args        = "-pix_fmt yuv420p -vsync 1 -g 1";  // -crf 0 -preset ultrafast -tune zerolatency setpts='(RTCTIME - RTCSTART) / (TB * 1000000)'
     std::string trg_path        = "output.mp4";
+
+    // Frames waiting for ffmpeg and what to do when they pile up
+    size_t      queue_capacity  = 8;
+    FramePolicy queue_policy    = FRAME_BLOCK;
+};
+
+struct RecordingQueueStats {
+    size_t      capacity        = 0;
+    size_t      depth           = 0;
+    size_t      maxDepth        = 0;
+    size_t      stalls          = 0;
+    double      stallSecs       = 0.0;
+    size_t      dropped         = 0;
+    size_t      duplicated      = 0;
+    size_t      written         = 0;
 };
 
 bool    recordingPipeOpen(const RecordingSettings& _settings, float _start, float _end);
-size_t  recordingPipeFrame( std::unique_ptr<unsigned char[]>&& _pixels );
+size_t  recordingFrameSize(const RecordingSettings& _settings);
+RecordingPixelFormat recordingPipePixelFormat();
+size_t  recordingPipeFrame( FramePtr&& _pixels );
 void    recordingPipeClose();
+RecordingQueueStats getRecordingQueueStats();
 #endif
 bool    recordingPipe();
 
 void    recordingStartSecs(float _start, float _end, float _fps);
 void    recordingStartFrames(int _start, int _end, float _fps);
 
+// Split the next recordingStartFrames() range in _count slices and render only the _index one,
+// either a contiguous block or every _count frame starting at _index (interleaved)
+bool    recordingShard(int _index, int _count, bool _interleaved = false);
+
 void    recordingFrameAdded();
+bool    recordingLastFrame();
 
 bool    isRecording();
 
+// Offline mode renders the sequence as fast as the GPU and the encoder allow (no vsync, swap or UI)
+void    recordingOffline(bool _offline);
+bool    isRecordingOffline();
+
 float   getRecordingPercentage();
 int     getRecordingCount();
+int     getRecordingIndex();    // index of the output file, global across shards
 float   getRecordingDelta();
 int     getRecordingFrame();
-float   getRecordingTime();
\ No newline at end of file
+float   getRecordingTime();
+float   getRecordingFps();      // frames per second achieved (wall clock) by the current or last sequence
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "renderGraph.h"
+
+#include <iostream>
+#include <algorithm>
+
+void RenderGraph::clear() {
+    m_passes.clear();
+    m_order.clear();
+    m_valid = false;
+}
+
+size_t RenderGraph::add(PassType _type, size_t _index) {
+    RenderPass pass;
+    pass.type = _type;
+    pass.index = _index;
+    m_passes.push_back(pass);
+    return m_passes.size() - 1;
+}
+
+void RenderGraph::connect(size_t _from, size_t _to) {
+    std::vector<size_t>& inputs = m_passes[_to].inputs;
+    if (std::find(inputs.begin(), inputs.end(), _from) == inputs.end())
+        inputs.push_back(_from);
+}
+
+size_t RenderGraph::find(PassType _type, size_t _index) const {
+    for (size_t i = 0; i < m_passes.size(); i++)
+        if (m_passes[i].type == _type && m_passes[i].index == _index)
+            return i;
+    return m_passes.size();
+}
+
+// Kahn's algorithm, always taking the first ready pass in declaration order. When a cycle
+// leaves none ready the first one left goes, as it would have without the graph
+void RenderGraph::sort() {
+    size_t total = m_passes.size();
+    std::vector<size_t> pending(total, 0);
+    for (size_t i = 0; i < total; i++)
+        for (size_t j = 0; j < m_passes[i].inputs.size(); j++)
+            if (m_passes[i].inputs[j] != i)
+                pending[i]++;
+
+    std::vector<bool> done(total, false);
+    m_order.clear();
+    while (m_order.size() < total) {
+        size_t next = total;
+        for (size_t i = 0; i < total && next == total; i++)
+            if (!done[i] && pending[i] == 0)
+                next = i;
+        for (size_t i = 0; i < total && next == total; i++)
+            if (!done[i])
+                next = i;
+
+        done[next] = true;
+        m_order.push_back(next);
+        for (size_t i = 0; i < total; i++)
+            if (!done[i] && i != next && std::find(m_passes[i].inputs.begin(), m_passes[i].inputs.end(), next) != m_passes[i].inputs.end())
+                pending[i]--;
+    }
+
+    for (size_t i = 0; i < total; i++) {
+        m_passes[i].seenInputs.assign(m_passes[i].inputs.size(), 0);
+        m_passes[i].seenVersions.assign(m_passes[i].versions.size(), 0);
+        m_passes[i].forced = true;
+    }
+}
+
+bool RenderGraph::isDirty(size_t _pass, bool _sceneChanged) const {
+    const RenderPass& pass = m_passes[_pass];
+    if (pass.forced || (pass.reads & PASS_READS_TIME))
+        return true;
+
+    if ((pass.reads & PASS_READS_SCENE) && _sceneChanged)
+        return true;
+
+    for (size_t i = 0; i < pass.inputs.size(); i++)
+        if (m_passes[ pass.inputs[i] ].version != pass.seenInputs[i])
+            return true;
+
+    for (size_t i = 0; i < pass.versions.size(); i++)
+        if (*pass.versions[i] != pass.seenVersions[i])
+            return true;
+
+    return false;
+}
+
+void RenderGraph::ran(size_t _pass) {
+    RenderPass& pass = m_passes[_pass];
+    for (size_t i = 0; i < pass.inputs.size(); i++)
+        pass.seenInputs[i] = m_passes[ pass.inputs[i] ].version;
+    for (size_t i = 0; i < pass.versions.size(); i++)
+        pass.seenVersions[i] = *pass.versions[i];
+
+    // after what it saw, so a pass that samples itself stays dirty
+    pass.version++;
+    pass.forced = false;
+    pass.runs++;
+}
+
+void RenderGraph::force() {
+    for (size_t i = 0; i < m_passes.size(); i++)
+        m_passes[i].forced = true;
+}
+
+void RenderGraph::resetStats() {
+    for (size_t i = 0; i < m_passes.size(); i++) {
+        m_passes[i].runs = 0;
+        m_passes[i].skips = 0;
+    }
+}
+
+std::string RenderGraph::getName(size_t _pass) const {
+    return pass_type_names[ m_passes[_pass].type ] + std::to_string(m_passes[_pass].index);
+}
+
+void RenderGraph::print() const {
+    std::cout << "// order, pass, reads, inputs, runs, skips, skip rate" << std::endl;
+    for (size_t i = 0; i < m_order.size(); i++) {
+        const RenderPass& pass = m_passes[ m_order[i] ];
+
+        std::string reads = "";
+        if (pass.reads & PASS_READS_TIME)
+            reads += "time ";
+        if (pass.reads & PASS_READS_SCENE)
+            reads += "scene ";
+        if (!pass.versions.empty())
+            reads += "data ";
+        if (!reads.empty())
+            reads.pop_back();
+
+        std::string inputs = "";
+        for (size_t j = 0; j < pass.inputs.size(); j++)
+            inputs += (j > 0 ? " " : "") + getName(pass.inputs[j]);
+
+        size_t total = pass.runs + pass.skips;
+        std::cout << i << "," << getName(m_order[i]) << "," << reads << "," << inputs << "," << pass.runs << "," << pass.skips << ",";
+        std::cout << ( (total > 0) ? (100.0 * double(pass.skips) / double(total)) : 0.0 ) << "%" << std::endl;
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+enum PassType {
+    PASS_BUFFER = 0,
+    PASS_DOUBLE_BUFFER,
+    PASS_PYRAMID,
+    PASS_FLOOD
+};
+
+const std::string pass_type_names[] = { "u_buffer", "u_doubleBuffer", "u_pyramid", "u_flood" };
+
+// What a pass reads besides other passes and user uniforms
+#define PASS_READS_TIME     1   // time, delta, date, frame, mouse, streams, the scene render: new every frame
+#define PASS_READS_SCENE    2   // the other built-ins, textures, cubemap and lights: new when the scene changes
+
+struct RenderPass {
+    PassType                    type;
+    size_t                      index;
+    unsigned                    reads       = 0;
+    std::vector<size_t>         inputs;                 // passes it samples (positions in the graph)
+    std::vector<const size_t*>  versions;               // of the user uniforms and sequences it reads
+
+    // State since it last ran
+    size_t                      version     = 0;        // goes up every time it renders
+    std::vector<size_t>         seenInputs;
+    std::vector<size_t>         seenVersions;
+    bool                        forced      = true;
+
+    size_t                      runs        = 0;
+    size_t                      skips       = 0;
+};
+
+/** The buffer, double buffer, pyramid and flood passes as a dependency graph: which passes each
+ *  one samples, out of the uniforms its program declares. They render in topological order
+ *  (ties and cycles keep the declaration order, a pass in a cycle reads the previous frame of
+ *  the ones after it), and a pass is skipped when nothing it reads changed since it last ran:
+ *  no time uniform, no scene change, same user uniform versions and none of its inputs rendered
+ *  again. A double buffer that samples itself is dirty again every time it runs. **/
+class RenderGraph {
+public:
+    RenderGraph() : m_stamp(0), m_valid(false) {}
+
+    void                clear();
+    size_t              add(PassType _type, size_t _index);
+    void                connect(size_t _from, size_t _to);      // _to samples _from
+    void                sort();
+
+    bool                isValid(size_t _stamp) const { return m_valid && m_stamp == _stamp; }
+    void                setStamp(size_t _stamp) { m_stamp = _stamp; m_valid = true; }
+    void                invalidate() { m_valid = false; }
+
+    size_t              size() const { return m_passes.size(); }
+    size_t              find(PassType _type, size_t _index) const;
+    RenderPass&         operator[](size_t _pass) { return m_passes[_pass]; }
+    const std::vector<size_t>& getOrder() const { return m_order; }
+
+    bool                isDirty(size_t _pass, bool _sceneChanged) const;
+    void                ran(size_t _pass);
+    void                skipped(size_t _pass) { m_passes[_pass].skips++; }
+    void                force();                                // everything renders once more
+
+    void                resetStats();
+    std::string         getName(size_t _pass) const;
+    void                print() const;
+
+private:
+    std::vector<RenderPass> m_passes;
+    std::vector<size_t>     m_order;
+    size_t                  m_stamp;
+    bool                    m_valid;
+};
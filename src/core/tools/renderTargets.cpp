@@ -0,0 +1,60 @@
+#include "renderTargets.h"
+
+#include <algorithm>
+
+vera::Fbo* RenderTargets::acquire(int _width, int _height, vera::FboType _type) {
+    for (size_t i = 0; i < m_targets.size(); i++) {
+        Target& target = m_targets[i];
+        if (!target.used && target.fbo->getWidth() == _width && target.fbo->getHeight() == _height && target.fbo->getType() == _type) {
+            target.used = true;
+            return target.fbo;
+        }
+    }
+
+    Target target;
+    target.fbo = new vera::Fbo();
+    target.fbo->allocate(_width, _height, _type);
+    target.used = true;
+    m_targets.push_back(target);
+    return target.fbo;
+}
+
+void RenderTargets::release(vera::Fbo* _fbo) {
+    for (size_t i = 0; i < m_targets.size(); i++)
+        if (m_targets[i].fbo == _fbo) {
+            m_targets[i].used = false;
+            return;
+        }
+}
+
+void RenderTargets::clear() {
+    for (size_t i = 0; i < m_targets.size(); i++)
+        delete m_targets[i].fbo;
+    m_targets.clear();
+}
+
+size_t RenderTargets::getBytes() const {
+    size_t bytes = 0;
+    for (size_t i = 0; i < m_targets.size(); i++)
+        bytes += bytesOf(m_targets[i].fbo);
+    return bytes;
+}
+
+size_t RenderTargets::bytesOf(const vera::Fbo* _fbo) {
+    if (_fbo == nullptr || !_fbo->isAllocated())
+        return 0;
+    return bytesOf(_fbo->getWidth(), _fbo->getHeight(), _fbo->getType());
+}
+
+size_t RenderTargets::bytesOf(int _width, int _height, vera::FboType _type) {
+    size_t pixel = 4;
+    switch (_type) {
+        case vera::COLOR_TEXTURE:               pixel = 4; break;       // RGBA8
+        case vera::COLOR_FLOAT_TEXTURE:         pixel = 16; break;      // RGBA32F
+        case vera::COLOR_TEXTURE_DEPTH_BUFFER:  pixel = 4 + 4; break;   // plus a depth renderbuffer
+        case vera::COLOR_DEPTH_TEXTURES:        pixel = 4 + 4; break;
+        case vera::GBUFFER_TEXTURE:             pixel = 16 + 4; break;
+        default: break;
+    }
+    return size_t(std::max(_width, 0)) * size_t(std::max(_height, 0)) * pixel;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "vera/gl/fbo.h"
+
+/** Hands out render targets by size and format. A target released goes back to the pool and
+ *  the next acquire() of the same size and format gets it again, so passes whose targets are
+ *  not alive at the same time end up sharing the memory. **/
+class RenderTargets {
+public:
+    RenderTargets() {}
+    virtual ~RenderTargets() { clear(); }
+
+    vera::Fbo*      acquire(int _width, int _height, vera::FboType _type);
+    void            release(vera::Fbo* _fbo);
+    void            clear();
+
+    size_t          size() const { return m_targets.size(); }
+    size_t          getBytes() const;
+
+    // Rough GPU memory of an allocated fbo, out of its size and format
+    static size_t   bytesOf(const vera::Fbo* _fbo);
+    static size_t   bytesOf(int _width, int _height, vera::FboType _type);
+
+private:
+    struct Target {
+        vera::Fbo*      fbo     = nullptr;
+        bool            used    = false;
+    };
+
+    std::vector<Target> m_targets;
+};
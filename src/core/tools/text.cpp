@@ -233,6 +233,31 @@ int countDevLookBillboards(const std::string& _source) {
     return generic_search_count(_source, regex_count_t::DevLook_Billboards);
 }
 
+std::string addTileOffset(const std::string& _source) {
+    if (!findId(_source, "gl_FragCoord"))
+        return _source;
+
+    std::string source = std::regex_replace(_source, std::regex("\\bgl_FragCoord\\b"), "(gl_FragCoord + vec4(u_tileOffset, 0.0, 0.0))");
+
+    // The uniform goes after #version and #extension, which have to come before any declaration
+    std::vector<std::string> lines = vera::split(source, '\n', true);
+    size_t at = 0;
+    for (size_t i = 0; i < lines.size(); i++) {
+        std::string line = lines[i];
+        line.erase(0, line.find_first_not_of(" \t"));
+        if (line.rfind("#version", 0) == 0 || line.rfind("#extension", 0) == 0)
+            at = i + 1;
+    }
+
+    std::string rta = "";
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (i == at)
+            rta += "#ifdef GL_ES\nuniform highp vec2 u_tileOffset;\n#else\nuniform vec2 u_tileOffset;\n#endif\n";
+        rta += lines[i] + "\n";
+    }
+    return rta;
+}
+
 std::string getUniformName(const std::string& _str) {
     std::vector<std::string> values = vera::split(_str, '.');
     return "u_" + vera::toLower( vera::toUnderscore( vera::purifyString( values[0] ) ) );
@@ -27,4 +27,7 @@ bool checkNormalBuffer(const std::string& _source);
 int  countSceneBuffers(const std::string& _source);
 
 int  countDevLookBillboards(const std::string& _source);
-int  countDevLookSpheres(const std::string& _source);
\ No newline at end of file
+int  countDevLookSpheres(const std::string& _source);
+
+// Shifts every gl_FragCoord by a vec2 u_tileOffset uniform, to render one piece of a bigger image
+std::string addTileOffset(const std::string& _source);
\ No newline at end of file
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+#include "vera/gl/gl.h"
+
+/** Mirror of what is bound to each GL texture unit (and which unit is active), so binding the
+ *  same texture to the same unit again doesn't reach the driver. It only knows about the binds
+ *  that go through it: whoever binds textures behind its back has to forget() those units, or
+ *  invalidate() everything. Counts the binds issued and skipped until resetStats(). **/
+class TextureUnits {
+public:
+    TextureUnits() : m_active(-1) {
+        resetStats();
+    }
+
+    // Makes sure _id is bound to _target on _unit. True if it had to bind it
+    bool bind(GLenum _target, GLuint _id, GLint _unit) {
+        if (_unit < 0)
+            return false;
+
+        if ((size_t)_unit >= m_units.size())
+            m_units.resize(_unit + 1);
+
+        Unit& unit = m_units[_unit];
+        if (unit.known && unit.target == _target && unit.id == _id) {
+            m_skipped++;
+            return false;
+        }
+
+        if (m_active != _unit) {
+            glActiveTexture(GL_TEXTURE0 + _unit);
+            m_active = _unit;
+            m_switches++;
+        }
+        glBindTexture(_target, _id);
+
+        unit.known = true;
+        unit.target = _target;
+        unit.id = _id;
+        m_binds++;
+        return true;
+    }
+
+    // Units [_from, _to) got bound by someone else (which also moved the active unit)
+    void forget(GLint _from, GLint _to) {
+        if (_from >= _to)
+            return;
+
+        for (GLint i = std::max(_from, 0); i < _to && (size_t)i < m_units.size(); i++)
+            m_units[i].known = false;
+        m_active = -1;
+    }
+
+    void invalidate() {
+        m_units.clear();
+        m_active = -1;
+    }
+
+    // Binds done elsewhere (e.g. by name) that should show up in the counts
+    void count(size_t _binds) { m_binds += _binds; }
+
+    void    resetStats() {
+        m_binds = 0;
+        m_skipped = 0;
+        m_switches = 0;
+    }
+
+    size_t  getBinds() const { return m_binds; }        // glBindTexture calls
+    size_t  getSkipped() const { return m_skipped; }    // already bound on that unit
+    size_t  getSwitches() const { return m_switches; }  // glActiveTexture calls
+
+private:
+    struct Unit {
+        bool    known   = false;
+        GLenum  target  = 0;
+        GLuint  id      = 0;
+    };
+
+    std::vector<Unit>   m_units;
+    GLint               m_active;
+
+    size_t              m_binds;
+    size_t              m_skipped;
+    size_t              m_switches;
+};
@@ -0,0 +1,281 @@
+#include "tiledImage.h"
+
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include "vera/ops/fs.h"
+
+namespace {
+
+const size_t TGA_HEADER_SIZE    = 18;
+const size_t DEFLATE_STORED_MAX = 65535;
+const uint32_t ADLER_MOD        = 65521;
+
+void putBE32(std::vector<unsigned char>& _data, uint32_t _value) {
+    _data.push_back( (_value >> 24) & 0xFF );
+    _data.push_back( (_value >> 16) & 0xFF );
+    _data.push_back( (_value >> 8) & 0xFF );
+    _data.push_back( _value & 0xFF );
+}
+
+uint32_t crc32(uint32_t _crc, const unsigned char* _data, size_t _size) {
+    static uint32_t table[256];
+    static bool init = false;
+    if (!init) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        init = true;
+    }
+
+    for (size_t i = 0; i < _size; i++)
+        _crc = table[(_crc ^ _data[i]) & 0xFF] ^ (_crc >> 8);
+    return _crc;
+}
+
+}
+
+TiledImageWriter::TiledImageWriter() :
+    m_file(nullptr), m_png(false), m_width(0), m_height(0),
+    m_band_y(0), m_band_height(0), m_band_top(0),
+    m_adler_a(1), m_adler_b(0), m_zlib_header(false) {
+}
+
+TiledImageWriter::~TiledImageWriter() {
+    if (m_file)
+        close();
+}
+
+bool TiledImageWriter::isSupported(const std::string& _file) {
+    std::string ext = vera::getExt(_file);
+    return ext == "png" || ext == "PNG" || ext == "tga" || ext == "TGA";
+}
+
+bool TiledImageWriter::open(const std::string& _file, int _width, int _height) {
+    if (m_file)
+        close();
+
+    if (!isSupported(_file)) {
+        std::cerr << "Can't write " << _file << " in tiles, only PNG and TGA are supported" << std::endl;
+        return false;
+    }
+
+    m_png = (vera::getExt(_file) == "png" || vera::getExt(_file) == "PNG");
+    if (_width <= 0 || _height <= 0 || (!m_png && (_width > 65535 || _height > 65535))) {
+        std::cerr << "Can't write a " << _width << "x" << _height << " image to " << _file << std::endl;
+        return false;
+    }
+
+    m_file = fopen(_file.c_str(), "wb");
+    if (!m_file) {
+        std::cerr << "Can't open " << _file << " for writing" << std::endl;
+        return false;
+    }
+
+    m_width = _width;
+    m_height = _height;
+    m_band_height = 0;
+    m_band_top = _height;
+    m_adler_a = 1;
+    m_adler_b = 0;
+    m_zlib_header = false;
+
+    if (m_png) {
+        static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+        fwrite(signature, 1, 8, m_file);
+
+        std::vector<unsigned char> ihdr;
+        putBE32(ihdr, _width);
+        putBE32(ihdr, _height);
+        ihdr.push_back(8);      // bit depth
+        ihdr.push_back(6);      // RGBA
+        ihdr.push_back(0);      // deflate
+        ihdr.push_back(0);      // adaptive filtering (we always use none)
+        ihdr.push_back(0);      // no interlace
+        _writeChunk("IHDR", ihdr);
+    }
+    else {
+        unsigned char header[TGA_HEADER_SIZE];
+        memset(header, 0, TGA_HEADER_SIZE);
+        header[2] = 2;          // uncompressed true color
+        header[12] = _width & 0xFF;
+        header[13] = (_width >> 8) & 0xFF;
+        header[14] = _height & 0xFF;
+        header[15] = (_height >> 8) & 0xFF;
+        header[16] = 32;        // BGRA
+        header[17] = 8;         // 8 alpha bits, origin at the bottom-left
+        fwrite(header, 1, TGA_HEADER_SIZE, m_file);
+        m_row.resize((size_t)_width * 4);
+    }
+
+    return true;
+}
+
+bool TiledImageWriter::addTile(int _x, int _y, int _width, int _height, const unsigned char* _pixels) {
+    if (!m_file)
+        return false;
+
+    if (_x < 0 || _y < 0 || _x + _width > m_width || _y + _height > m_height) {
+        std::cerr << "Tile " << _x << "," << _y << " " << _width << "x" << _height << " falls outside the image" << std::endl;
+        return false;
+    }
+
+    const size_t tileStride = (size_t)_width * 4;
+
+    if (!m_png) {
+        for (int r = 0; r < _height; r++) {
+            const unsigned char* src = _pixels + r * tileStride;
+            for (int i = 0; i < _width; i++) {
+                m_row[i * 4 + 0] = src[i * 4 + 2];
+                m_row[i * 4 + 1] = src[i * 4 + 1];
+                m_row[i * 4 + 2] = src[i * 4 + 0];
+                m_row[i * 4 + 3] = src[i * 4 + 3];
+            }
+
+            if (!_seek(TGA_HEADER_SIZE + ((uint64_t)(_y + r) * m_width + _x) * 4))
+                return false;
+            fwrite(m_row.data(), 1, tileStride, m_file);
+        }
+        return true;
+    }
+
+    // A new row of tiles, the previous one is complete
+    if (m_band_height > 0 && _y != m_band_y)
+        _flushBand();
+
+    if (m_band_height == 0) {
+        if (_y + _height != m_band_top) {
+            std::cerr << "PNG tiles have to come in rows from the top of the image down" << std::endl;
+            return false;
+        }
+        m_band_y = _y;
+        m_band_height = _height;
+        m_band.assign((size_t)_height * (1 + (size_t)m_width * 4), 0);
+    }
+    else if (_height != m_band_height) {
+        std::cerr << "All the tiles in a row need the same height" << std::endl;
+        return false;
+    }
+
+    const size_t bandStride = 1 + (size_t)m_width * 4;
+    for (int r = 0; r < _height; r++) {
+        // the band goes top-down, the tile bottom-up
+        unsigned char* dst = &m_band[(m_band_height - 1 - r) * bandStride + 1 + (size_t)_x * 4];
+        memcpy(dst, _pixels + r * tileStride, tileStride);
+    }
+
+    return true;
+}
+
+bool TiledImageWriter::close() {
+    if (!m_file)
+        return false;
+
+    bool complete = true;
+    if (m_png) {
+        if (m_band_height > 0)
+            _flushBand();
+
+        // Missing rows at the bottom are left transparent, but the zlib stream still needs its end
+        if (m_band_top > 0) {
+            complete = false;
+            m_band_y = 0;
+            m_band_height = m_band_top;
+            m_band.assign((size_t)m_band_height * (1 + (size_t)m_width * 4), 0);
+            _flushBand();
+        }
+
+        _writeChunk("IEND", std::vector<unsigned char>());
+    }
+
+    bool ok = (ferror(m_file) == 0);
+    fclose(m_file);
+    m_file = nullptr;
+    m_band.clear();
+    m_row.clear();
+
+    if (!complete)
+        std::cerr << "Some tiles never arrived, the image is incomplete" << std::endl;
+
+    return ok && complete;
+}
+
+bool TiledImageWriter::_seek(uint64_t _offset) {
+    #if defined(_WIN32)
+    return _fseeki64(m_file, (__int64)_offset, SEEK_SET) == 0;
+    #else
+    return fseeko(m_file, (off_t)_offset, SEEK_SET) == 0;
+    #endif
+}
+
+// Wraps the scanlines of the current band in uncompressed deflate blocks, part of a single zlib
+// stream that spans all the IDAT chunks
+bool TiledImageWriter::_flushBand() {
+    if (m_band_height == 0)
+        return false;
+
+    bool last = (m_band_y == 0);
+    const size_t size = m_band.size();
+
+    std::vector<unsigned char> idat;
+    idat.reserve(size + (size / DEFLATE_STORED_MAX + 1) * 5 + 6);
+
+    if (!m_zlib_header) {
+        idat.push_back(0x78);
+        idat.push_back(0x01);
+        m_zlib_header = true;
+    }
+
+    size_t offset = 0;
+    while (offset < size) {
+        size_t block = std::min(DEFLATE_STORED_MAX, size - offset);
+        bool bfinal = last && (offset + block == size);
+        idat.push_back(bfinal ? 1 : 0);
+        idat.push_back(block & 0xFF);
+        idat.push_back((block >> 8) & 0xFF);
+        idat.push_back(~block & 0xFF);
+        idat.push_back((~block >> 8) & 0xFF);
+        idat.insert(idat.end(), m_band.begin() + offset, m_band.begin() + offset + block);
+        offset += block;
+    }
+
+    // Adler-32 of the uncompressed data, in chunks small enough not to overflow before the modulo
+    for (size_t i = 0; i < size; ) {
+        size_t end = std::min(size, i + 5552);
+        for (; i < end; i++) {
+            m_adler_a += m_band[i];
+            m_adler_b += m_adler_a;
+        }
+        m_adler_a %= ADLER_MOD;
+        m_adler_b %= ADLER_MOD;
+    }
+
+    if (last)
+        putBE32(idat, (m_adler_b << 16) | m_adler_a);
+
+    _writeChunk("IDAT", idat);
+
+    m_band_top = m_band_y;
+    m_band_height = 0;
+    return true;
+}
+
+void TiledImageWriter::_writeChunk(const char* _type, const std::vector<unsigned char>& _data) {
+    std::vector<unsigned char> length;
+    putBE32(length, (uint32_t)_data.size());
+    fwrite(length.data(), 1, 4, m_file);
+    fwrite(_type, 1, 4, m_file);
+    if (!_data.empty())
+        fwrite(_data.data(), 1, _data.size(), m_file);
+
+    uint32_t crc = crc32(0xFFFFFFFFu, (const unsigned char*)_type, 4);
+    crc = crc32(crc, _data.data(), _data.size()) ^ 0xFFFFFFFFu;
+
+    std::vector<unsigned char> footer;
+    putBE32(footer, crc);
+    fwrite(footer.data(), 1, 4, m_file);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+/** Writes an image bigger than anything we can render at once, one tile at a time, so only
+ *  a tile (TGA) or a row of tiles (PNG) is ever held in memory.
+ *  - TGA is stored bottom-up like glReadPixels, each tile row is written in place.
+ *  - PNG is stored top-down and uncompressed, tiles must come in rows from the top one down. **/
+class TiledImageWriter {
+public:
+    TiledImageWriter();
+    virtual ~TiledImageWriter();
+
+    static bool isSupported(const std::string& _file);
+
+    bool    open(const std::string& _file, int _width, int _height);
+
+    // RGBA pixels, rows bottom-up (as glReadPixels gives them). _x,_y is the bottom-left corner of the tile
+    bool    addTile(int _x, int _y, int _width, int _height, const unsigned char* _pixels);
+
+    bool    close();
+
+    bool    isOpen() const { return m_file != nullptr; }
+
+private:
+    bool    _seek(uint64_t _offset);
+    bool    _flushBand();
+    void    _writeChunk(const char* _type, const std::vector<unsigned char>& _data);
+
+    std::vector<unsigned char>  m_band;         // PNG: scanlines (with their filter byte) of the current row of tiles
+    std::vector<unsigned char>  m_row;          // TGA: one row converted to BGRA
+
+    FILE*       m_file;
+    bool        m_png;
+    int         m_width;
+    int         m_height;
+
+    int         m_band_y;
+    int         m_band_height;
+    int         m_band_top;                     // PNG: rows above this one are already on disk
+    uint32_t    m_adler_a;
+    uint32_t    m_adler_b;
+    bool        m_zlib_header;
+};
@@ -12,6 +12,8 @@ Tracker::~Tracker() {
 
 void Tracker::start() {
     m_data.clear();
+    m_counters.clear();
+    m_counters_data.clear();
 
     auto start = std::chrono::high_resolution_clock::now();
     m_trackerStart = std::chrono::time_point_cast<std::chrono::microseconds>(start).time_since_epoch().count() * 0.001;
@@ -134,3 +136,34 @@ std::string Tracker::logAverage(const std::string& _track) {
 
     return log;
 }
+
+void Tracker::setCounter(const std::string& _counter, double _value) {
+    if (!m_running)
+        return;
+
+    if ( m_counters_data.find(_counter) == m_counters_data.end() )
+        m_counters.push_back(_counter);
+
+    m_counters_data[_counter] = _value;
+}
+
+void Tracker::addCounter(const std::string& _counter, double _value) {
+    if (!m_running)
+        return;
+
+    if ( m_counters_data.find(_counter) == m_counters_data.end() ) {
+        m_counters.push_back(_counter);
+        m_counters_data[_counter] = 0.0;
+    }
+
+    m_counters_data[_counter] += _value;
+}
+
+std::string Tracker::logCounters() {
+    std::string log = "";
+
+    for (size_t i = 0; i < m_counters.size(); i++)
+        log += m_counters[i] + "," + vera::toString(m_counters_data[m_counters[i]]) + "\n";
+
+    return log;
+}
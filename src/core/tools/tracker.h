@@ -40,6 +40,11 @@ public:
     std::string logAverage(const std::string& _track);
     std::string logFramerate();
 
+    // Counters are plain named values (allocations, draw calls, ...) published while tracking
+    void    setCounter(const std::string& _counter, double _value);
+    void    addCounter(const std::string& _counter, double _value = 1.0);
+    std::string logCounters();
+
     bool    isRunning() const { return m_running; }
 
 protected:
@@ -49,6 +54,9 @@ protected:
     std::vector<std::string>            m_tracks;
     std::map<std::string, StatTrack>    m_data;
 
+    std::vector<std::string>            m_counters;
+    std::map<std::string, double>       m_counters_data;
+
     bool                    m_running = false;
 
 };
\ No newline at end of file
@@ -0,0 +1,261 @@
+#include "uniformSequence.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#define SUPPORT_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "vera/ops/fs.h"
+#include "vera/ops/string.h"
+
+UniformSequence::UniformSequence() : m_rows(nullptr), m_map(nullptr), m_mapBytes(0), m_components(0), m_count(0), m_fps(0.0f), m_interpolation(SEQUENCE_LINEAR), m_position(-1.0) {
+    std::fill(m_value, m_value + SEQUENCE_MAX_COMPONENTS, 0.0f);
+}
+
+UniformSequence::~UniformSequence() {
+    clear();
+}
+
+void UniformSequence::clear() {
+    #if defined(SUPPORT_MMAP)
+    if (m_map)
+        munmap(m_map, m_mapBytes);
+    #endif
+    m_map = nullptr;
+    m_mapBytes = 0;
+    m_buffer.clear();
+    m_buffer.shrink_to_fit();
+    m_rows = nullptr;
+    m_components = 0;
+    m_count = 0;
+    m_fps = 0.0f;
+    m_position = -1.0;
+}
+
+bool UniformSequence::load(const std::string& _filename) {
+    clear();
+    bool loaded = vera::haveExt(_filename, SEQUENCE_EXT) ? _loadBinary(_filename) : _loadCSV(_filename);
+    if (loaded && !isSupported(m_components)) {
+        std::cerr << _filename << " has rows of " << m_components << " values, a sequence takes 1 to 4 (float, vec2, vec3, vec4), 9 (mat3) or 16 (mat4)" << std::endl;
+        clear();
+        return false;
+    }
+    return loaded;
+}
+
+bool UniformSequence::_loadBinary(const std::string& _filename) {
+    SequenceHeader header;
+    const unsigned char* bytes = nullptr;
+    size_t total = 0;
+
+    #if defined(SUPPORT_MMAP)
+    int fd = open(_filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Can't open " << _filename << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(SequenceHeader)) {
+        total = (size_t)st.st_size;
+        void* map = mmap(nullptr, total, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            m_map = map;
+            m_mapBytes = total;
+            bytes = (const unsigned char*)map;
+            // rows get read (mostly) in order, let the kernel read ahead
+            madvise(map, total, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+    #else
+    std::ifstream file(_filename, std::ios::binary | std::ios::ate);
+    if (file.is_open()) {
+        total = (size_t)file.tellg();
+        m_buffer.resize( (total + sizeof(float) - 1) / sizeof(float) );
+        file.seekg(0);
+        if (file.read((char*)m_buffer.data(), total))
+            bytes = (const unsigned char*)m_buffer.data();
+    }
+    #endif
+
+    if (bytes == nullptr || total < sizeof(SequenceHeader)) {
+        std::cerr << "Can't read " << _filename << std::endl;
+        clear();
+        return false;
+    }
+
+    memcpy(&header, bytes, sizeof(SequenceHeader));
+    size_t rows = (total - sizeof(SequenceHeader)) / sizeof(float);
+    if (memcmp(header.magic, SEQUENCE_MAGIC, 4) != 0 || header.version != SEQUENCE_VERSION ||
+        header.components == 0 || header.components > SEQUENCE_MAX_COMPONENTS ||
+        (size_t)header.count * header.components > rows) {
+        std::cerr << _filename << " is not a valid ." << SEQUENCE_EXT << " sequence" << std::endl;
+        clear();
+        return false;
+    }
+
+    m_rows = (const float*)(bytes + sizeof(SequenceHeader));
+    m_components = header.components;
+    m_count = header.count;
+    m_fps = std::max(0.0f, header.fps);
+    return m_count > 0;
+}
+
+bool UniformSequence::_loadCSV(const std::string& _filename) {
+    std::ifstream infile(_filename);
+    if (!infile.is_open())
+        return false;
+
+    // Read straight into packed rows. They can have different lengths, the widest one sets
+    // the components and the shorter ones get padded with zeros at the end
+    std::vector<float> values;
+    std::vector<uint8_t> widths;
+    std::string line;
+    size_t components = 0;
+    while (std::getline(infile, line)) {
+        if (line.empty())
+            continue;
+
+        size_t width = 0;
+        const char* ptr = line.c_str();
+        for (;;) {
+            char* end = nullptr;
+            float value = strtof(ptr, &end);
+            // anything that is not a number is a 0, like vera::toFloat()
+            values.push_back( (end == ptr) ? 0.0f : value );
+            width++;
+
+            const char* comma = strchr(ptr, ',');
+            if (comma == nullptr || width == SEQUENCE_MAX_COMPONENTS)
+                break;
+            ptr = comma + 1;
+        }
+        components = std::max(components, width);
+        widths.push_back( (uint8_t)width );
+    }
+
+    if (widths.empty())
+        return false;
+
+    m_count = widths.size();
+    m_components = components;
+    if (values.size() == m_count * m_components)
+        m_buffer.swap(values);
+    else {
+        m_buffer.assign(m_count * m_components, 0.0f);
+        size_t from = 0;
+        for (size_t i = 0; i < m_count; i++) {
+            std::copy(values.begin() + from, values.begin() + from + widths[i], m_buffer.begin() + i * m_components);
+            from += widths[i];
+        }
+    }
+    m_rows = m_buffer.data();
+    return true;
+}
+
+bool UniformSequence::save(const std::string& _filename) const {
+    if (m_count == 0)
+        return false;
+
+    SequenceHeader header;
+    memset(&header, 0, sizeof(SequenceHeader));
+    memcpy(header.magic, SEQUENCE_MAGIC, 4);
+    header.version = SEQUENCE_VERSION;
+    header.components = (uint32_t)m_components;
+    header.count = (uint32_t)m_count;
+    header.fps = m_fps;
+
+    FILE* file = fopen(_filename.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Can't write " << _filename << std::endl;
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(SequenceHeader), 1, file) == 1;
+    ok = ok && fwrite(m_rows, sizeof(float) * m_components, m_count, file) == m_count;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok)
+        std::cerr << "Couldn't finish writing " << _filename << std::endl;
+    return ok;
+}
+
+// Loops around both ends
+const float* UniformSequence::_row(int64_t _index) const {
+    int64_t count = (int64_t)m_count;
+    _index %= count;
+    if (_index < 0)
+        _index += count;
+    return m_rows + _index * m_components;
+}
+
+bool UniformSequence::update(size_t _frame, double _time) {
+    if (m_count == 0)
+        return false;
+
+    double position = (m_fps > 0.0f) ? std::max(0.0, _time) * m_fps : double(_frame % m_count);
+    if (m_interpolation == SEQUENCE_NEAREST || m_fps <= 0.0f)
+        position = std::floor(position);
+    if (position == m_position)
+        return false;
+    m_position = position;
+
+    int64_t index = (int64_t)std::floor(position);
+    float t = float(position - double(index));
+    const float* p1 = _row(index);
+
+    if (t == 0.0f || m_interpolation == SEQUENCE_NEAREST) {
+        std::copy(p1, p1 + m_components, m_value);
+        return true;
+    }
+
+    const float* p2 = _row(index + 1);
+    if (m_interpolation == SEQUENCE_LINEAR) {
+        for (size_t i = 0; i < m_components; i++)
+            m_value[i] = p1[i] + (p2[i] - p1[i]) * t;
+        return true;
+    }
+
+    const float* p0 = _row(index - 1);
+    const float* p3 = _row(index + 2);
+    float t2 = t * t;
+    float t3 = t2 * t;
+    for (size_t i = 0; i < m_components; i++)
+        m_value[i] = 0.5f * (  (2.0f * p1[i]) +
+                               (p2[i] - p0[i]) * t +
+                               (2.0f * p0[i] - 5.0f * p1[i] + 4.0f * p2[i] - p3[i]) * t2 +
+                               (3.0f * p1[i] - p0[i] - 3.0f * p2[i] + p3[i]) * t3 );
+    return true;
+}
+
+bool UniformSequence::isSupported(size_t _components) {
+    return (_components >= 1 && _components <= 4) || _components == 9 || _components == 16;
+}
+
+std::string UniformSequence::getType() const {
+    if (m_components == 1)  return "float";
+    if (m_components == 9)  return "mat3";
+    if (m_components == 16) return "mat4";
+    return "vec" + vera::toString((int)m_components);
+}
+
+std::string UniformSequence::print() const {
+    std::string rta = "";
+    for (size_t i = 0; i < m_components; i++) {
+        rta += vera::toString(m_value[i]);
+        if (i < m_components - 1)
+            rta += ",";
+    }
+    return rta;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// How a sequence with a frame rate gets sampled between two of its rows
+enum SequenceInterpolation {
+    SEQUENCE_NEAREST = 0,
+    SEQUENCE_LINEAR,
+    SEQUENCE_CUBIC          // Catmull-Rom, goes through every row
+};
+
+const std::string sequence_interpolation_options[] = { "nearest", "linear", "cubic" };
+
+#define SEQUENCE_EXT        "useq"
+#define SEQUENCE_MAGIC      "GVSQ"
+#define SEQUENCE_VERSION    1
+#define SEQUENCE_MAX_COMPONENTS 16
+
+// Header of a .useq file, followed by count * components little endian floats (row after row).
+// 32 bytes, so the rows stay aligned when the file gets mapped
+struct SequenceHeader {
+    char        magic[4];           // "GVSQ"
+    uint32_t    version;
+    uint32_t    components;         // floats per row, 1 to 16
+    uint32_t    count;              // rows
+    float       fps;                // rows per second, 0 plays one row per frame
+    uint32_t    flags;              // reserved
+    uint32_t    reserved[2];
+};
+
+/** The values of a u_<name> sequence uniform. A .useq file is mapped in memory and its rows
+ *  read straight from it, a CSV (one row per line) is parsed once into packed floats. Without a
+ *  frame rate it plays one row per rendered frame, with one it follows the time and samples
+ *  between rows (nearest, linear or cubic) when the playback doesn't land on them. **/
+class UniformSequence {
+public:
+    UniformSequence();
+    virtual ~UniformSequence();
+
+    // Owns the mapping of its file, a copy would unmap it twice
+    UniformSequence(const UniformSequence&) = delete;
+    UniformSequence& operator=(const UniformSequence&) = delete;
+
+    bool            load(const std::string& _filename);
+    bool            save(const std::string& _filename) const;
+    void            clear();
+
+    // Moves to the row of _frame (no frame rate) or _time (seconds). True if the value changed
+    bool            update(size_t _frame, double _time);
+
+    const float*    getValue() const { return m_value; }
+    size_t          getComponents() const { return m_components; }
+    size_t          size() const { return m_count; }
+    bool            empty() const { return m_count == 0; }
+
+    void            setFps(float _fps) { m_fps = (_fps > 0.0f) ? _fps : 0.0f; m_position = -1.0; }
+    float           getFps() const { return m_fps; }
+
+    void            setInterpolation(SequenceInterpolation _interpolation) { m_interpolation = _interpolation; m_position = -1.0; }
+    SequenceInterpolation getInterpolation() const { return m_interpolation; }
+
+    bool            isMapped() const { return m_map != nullptr; }
+    size_t          getBytes() const { return m_count * m_components * sizeof(float); }
+
+    // GLSL type of the rows: float, vec2, vec3, vec4, mat3 or mat4. Other widths don't load
+    std::string     getType() const;
+    static bool     isSupported(size_t _components);
+    std::string     print() const;
+
+    size_t          version = 0;    // unique and increasing every time the value changes (see UniformData)
+
+private:
+    bool            _loadBinary(const std::string& _filename);
+    bool            _loadCSV(const std::string& _filename);
+    const float*    _row(int64_t _index) const;
+
+    std::vector<float>      m_buffer;           // CSV rows, or the whole file where it can't be mapped
+    const float*            m_rows;
+    void*                   m_map;
+    size_t                  m_mapBytes;
+
+    size_t                  m_components;
+    size_t                  m_count;
+    float                   m_fps;
+    SequenceInterpolation   m_interpolation;
+
+    float                   m_value[SEQUENCE_MAX_COMPONENTS];
+    double                  m_position;         // in rows, of m_value
+};
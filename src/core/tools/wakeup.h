@@ -0,0 +1,99 @@
+#pragma once
+
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
+
+/** Lets an idle render loop sleep until something happens instead of polling. Any thread
+ *  can signal() an event (a command, an OSC message, a file change...), the loop blocks on
+ *  wait(). It also measures the event-to-present latency: the oldest event pending when a
+ *  frame starts is timed until that frame gets presented. **/
+class Wakeup {
+public:
+    Wakeup() : m_signaled(false), m_pending(false), m_inflight(false) {
+        resetStats();
+    }
+
+    // Any thread
+    void signal() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_pending) {
+                m_pending = true;
+                m_since = std::chrono::steady_clock::now();
+            }
+            m_signaled = true;
+        }
+        m_cv.notify_one();
+    }
+
+    // Render thread. Blocks until signaled or _timeoutMs passes (forever if negative).
+    // Returns true if it was signaled
+    bool wait(double _timeoutMs) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (_timeoutMs < 0.0)
+            m_cv.wait(lock, [this]{ return m_signaled; });
+        else
+            m_cv.wait_for(lock, std::chrono::duration<double, std::milli>(_timeoutMs), [this]{ return m_signaled; });
+
+        bool signaled = m_signaled;
+        m_signaled = false;
+        m_wakeups++;
+        return signaled;
+    }
+
+    // Render thread, when a frame starts: the events pending so far will show up on it
+    void frameStart() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_signaled = false;
+        if (m_pending && !m_inflight) {
+            m_inflight = true;
+            m_inflightSince = m_since;
+            m_pending = false;
+        }
+    }
+
+    // Render thread, once the frame is on screen. Returns true if it carried an event
+    bool framePresented() {
+        if (!m_inflight)
+            return false;
+
+        m_inflight = false;
+        m_latencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_inflightSince).count();
+        m_latencyMaxMs = std::max(m_latencyMaxMs, m_latencyMs);
+        m_latencySumMs += m_latencyMs;
+        m_events++;
+        return true;
+    }
+
+    void    resetStats() {
+        m_wakeups = 0;
+        m_events = 0;
+        m_latencyMs = 0.0;
+        m_latencySumMs = 0.0;
+        m_latencyMaxMs = 0.0;
+    }
+
+    size_t  getWakeups() const { return m_wakeups; }            // times the idle loop woke up
+    size_t  getEvents() const { return m_events; }              // frames presented because of an event
+    double  getLatencyMs() const { return m_latencyMs; }        // of the last one
+    double  getLatencyMaxMs() const { return m_latencyMaxMs; }
+    double  getLatencyAverageMs() const { return (m_events > 0) ? m_latencySumMs / m_events : 0.0; }
+
+private:
+    std::mutex                              m_mutex;
+    std::condition_variable                 m_cv;
+    bool                                    m_signaled;
+    bool                                    m_pending;
+    std::chrono::steady_clock::time_point   m_since;
+
+    // Only touched by the render thread
+    bool                                    m_inflight;
+    std::chrono::steady_clock::time_point   m_inflightSince;
+    size_t                                  m_wakeups;
+    size_t                                  m_events;
+    double                                  m_latencyMs;
+    double                                  m_latencySumMs;
+    double                                  m_latencyMaxMs;
+};
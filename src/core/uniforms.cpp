@@ -1,7 +1,12 @@
 #include "uniforms.h"
 
 #include <regex>
+#include <chrono>
+#include <algorithm>
+#include <functional>
 #include <limits>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <sys/stat.h>
@@ -13,9 +18,12 @@
 #include "vera/ops/fs.h"
 #include "vera/ops/draw.h"
 #include "vera/ops/string.h"
+#include "vera/window.h"
 #include "vera/xr/xr.h"
 #include "vera/types/gsplat.h"
 
+// Shared by all the UniformData, so a version never repeats even when a uniform gets replaced
+static std::atomic<size_t> s_data_version(0);
 
 std::string UniformData::getType() {
     if (size == 1) return (bInt ? "int" : "float");
@@ -24,19 +32,46 @@ std::string UniformData::getType() {
 
 void UniformData::set(const UniformValue &_value, size_t _size, bool _int, bool _queue) {
     bInt = _int;
-    size = _size;
+    size = std::min(_size, _value.size());
+    _size = size;
+
+    // A value is still waiting for the next frame
+    if (_queue && pending) {
+        if (policy == UNIFORM_FIFO) {
+            queue.push( _value );
+            while (queue.size() > capacity) {
+                queue.pop();
+                dropped++;
+            }
+            return;
+        }
 
-    if (_queue && change)
-        queue.push( _value );
-    else
-        value = _value;
-    
+        if (policy == UNIFORM_AVERAGE) {
+            samples++;
+            for (size_t i = 0; i < _size; i++) {
+                sum[i] += _value[i];
+                value[i] = sum[i] / float(samples);
+            }
+        }
+        else
+            value = _value;
+
+        version = ++s_data_version;
+        coalesced++;
+        return;
+    }
+
+    value = _value;
+    sum = _value;
+    samples = 1;
+    version = ++s_data_version;
+    pending = true;
     change = true;
 }
 
 void UniformData::parse(const std::vector<std::string>& _command, size_t _start, bool _queue) {;
     UniformValue candidate;
-    for (size_t i = _start; i < _command.size() && i < 5; i++) 
+    for (size_t i = _start; i < _command.size() && i - _start < candidate.size(); i++) 
         candidate[i-_start] = vera::toFloat(_command[i]);
 
     set(candidate, _command.size() - _start, false, _queue);
@@ -53,12 +88,17 @@ std::string UniformData::print() {
 }
 
 bool UniformData::check() {
-    if (queue.empty())
+    if (queue.empty()) {
         change = false;
+        pending = false;
+    }
     else {
+        // the next one of the FIFO is this frame's, the ones arriving keep queueing after it
         value = queue.front();
+        version = ++s_data_version;
         queue.pop();
         change = true;
+        pending = true;
     }
     return change;
 }
@@ -83,9 +123,16 @@ UniformFunction::UniformFunction(const std::string &_type, std::function<void(ve
 }
 
 
-Uniforms::Uniforms() : m_frame(0), m_play(true) {
+Uniforms::Uniforms() : bindingTables(true), m_bindings_version(0), m_bindings_built(0), m_data_uploads(0), m_data_redundant(0), m_units_held(false), m_feed_target(nullptr), m_block_buffer(0), m_block_used(false), m_block_uploaded(false), m_block_override_view(false), m_block_override_resolution(false), m_bench_iterations(0), m_bench_recording(false), m_frame(0), m_play(true) {
 
     activeCubemap = nullptr;
+    memset(&m_block, 0, sizeof(UniformBlock));
+    memset(&m_block_override, 0, sizeof(UniformBlock));
+    memset(&m_block_gpu, 0, sizeof(UniformBlock));
+
+    // Entries for the built-in ids, their functions get assigned later (GlslViewer, SceneRender)
+    for (size_t i = 0; i < UNIFORM_ID_TOTAL; i++)
+        m_functionIds[i] = &functions[ uniform_id_names[i] ];
 
     // IBL
     //
@@ -249,6 +296,11 @@ Uniforms::Uniforms() : m_frame(0), m_play(true) {
 
 Uniforms::~Uniforms(){
     clearUniforms();
+
+    #if defined(SUPPORT_UNIFORM_BLOCK)
+    if (m_block_buffer)
+        glDeleteBuffers(1, &m_block_buffer);
+    #endif
 }
 
 void Uniforms::clear() {
@@ -256,38 +308,287 @@ void Uniforms::clear() {
     vera::Scene::clear();
 }
 
+namespace {
+
+bool isInteger(GLenum _type) {
+    return  _type == GL_INT || _type == GL_INT_VEC2 || _type == GL_INT_VEC3 || _type == GL_INT_VEC4 ||
+            _type == GL_BOOL || _type == GL_BOOL_VEC2 || _type == GL_BOOL_VEC3 || _type == GL_BOOL_VEC4;
+}
+
+// Every sampler type the headers of the platform know about
+bool isSampler(GLenum _type) {
+    switch (_type) {
+        case GL_SAMPLER_2D:
+        case GL_SAMPLER_CUBE:
+        #if defined(GL_SAMPLER_1D)
+        case GL_SAMPLER_1D:
+        #endif
+        #if defined(GL_SAMPLER_3D)
+        case GL_SAMPLER_3D:
+        #endif
+        #if defined(GL_SAMPLER_1D_SHADOW)
+        case GL_SAMPLER_1D_SHADOW:
+        #endif
+        #if defined(GL_SAMPLER_2D_SHADOW)
+        case GL_SAMPLER_2D_SHADOW:
+        #endif
+        #if defined(GL_SAMPLER_CUBE_SHADOW)
+        case GL_SAMPLER_CUBE_SHADOW:
+        #endif
+        #if defined(GL_SAMPLER_1D_ARRAY)
+        case GL_SAMPLER_1D_ARRAY:
+        #endif
+        #if defined(GL_SAMPLER_2D_ARRAY)
+        case GL_SAMPLER_2D_ARRAY:
+        #endif
+        #if defined(GL_SAMPLER_1D_ARRAY_SHADOW)
+        case GL_SAMPLER_1D_ARRAY_SHADOW:
+        #endif
+        #if defined(GL_SAMPLER_2D_ARRAY_SHADOW)
+        case GL_SAMPLER_2D_ARRAY_SHADOW:
+        #endif
+        #if defined(GL_SAMPLER_CUBE_MAP_ARRAY)
+        case GL_SAMPLER_CUBE_MAP_ARRAY:
+        #endif
+        #if defined(GL_SAMPLER_CUBE_MAP_ARRAY_SHADOW)
+        case GL_SAMPLER_CUBE_MAP_ARRAY_SHADOW:
+        #endif
+        #if defined(GL_SAMPLER_2D_RECT)
+        case GL_SAMPLER_2D_RECT:
+        #endif
+        #if defined(GL_SAMPLER_2D_RECT_SHADOW)
+        case GL_SAMPLER_2D_RECT_SHADOW:
+        #endif
+        #if defined(GL_SAMPLER_2D_MULTISAMPLE)
+        case GL_SAMPLER_2D_MULTISAMPLE:
+        #endif
+        #if defined(GL_SAMPLER_2D_MULTISAMPLE_ARRAY)
+        case GL_SAMPLER_2D_MULTISAMPLE_ARRAY:
+        #endif
+        #if defined(GL_SAMPLER_BUFFER)
+        case GL_SAMPLER_BUFFER:
+        #endif
+        #if defined(GL_SAMPLER_EXTERNAL_OES)
+        case GL_SAMPLER_EXTERNAL_OES:
+        #endif
+        #if defined(GL_INT_SAMPLER_1D)
+        case GL_INT_SAMPLER_1D:
+        #endif
+        #if defined(GL_INT_SAMPLER_2D)
+        case GL_INT_SAMPLER_2D:
+        #endif
+        #if defined(GL_INT_SAMPLER_3D)
+        case GL_INT_SAMPLER_3D:
+        #endif
+        #if defined(GL_INT_SAMPLER_CUBE)
+        case GL_INT_SAMPLER_CUBE:
+        #endif
+        #if defined(GL_INT_SAMPLER_1D_ARRAY)
+        case GL_INT_SAMPLER_1D_ARRAY:
+        #endif
+        #if defined(GL_INT_SAMPLER_2D_ARRAY)
+        case GL_INT_SAMPLER_2D_ARRAY:
+        #endif
+        #if defined(GL_INT_SAMPLER_CUBE_MAP_ARRAY)
+        case GL_INT_SAMPLER_CUBE_MAP_ARRAY:
+        #endif
+        #if defined(GL_INT_SAMPLER_2D_RECT)
+        case GL_INT_SAMPLER_2D_RECT:
+        #endif
+        #if defined(GL_INT_SAMPLER_2D_MULTISAMPLE)
+        case GL_INT_SAMPLER_2D_MULTISAMPLE:
+        #endif
+        #if defined(GL_INT_SAMPLER_2D_MULTISAMPLE_ARRAY)
+        case GL_INT_SAMPLER_2D_MULTISAMPLE_ARRAY:
+        #endif
+        #if defined(GL_INT_SAMPLER_BUFFER)
+        case GL_INT_SAMPLER_BUFFER:
+        #endif
+        #if defined(GL_UNSIGNED_INT_SAMPLER_1D)
+        case GL_UNSIGNED_INT_SAMPLER_1D:
+        #endif
+        #if defined(GL_UNSIGNED_INT_SAMPLER_2D)
+        case GL_UNSIGNED_INT_SAMPLER_2D:
+        #endif
+        #if defined(GL_UNSIGNED_INT_SAMPLER_3D)
+        case GL_UNSIGNED_INT_SAMPLER_3D:
+        #endif
+        #if defined(GL_UNSIGNED_INT_SAMPLER_CUBE)
+        case GL_UNSIGNED_INT_SAMPLER_CUBE:
+        #endif
+        #if defined(GL_UNSIGNED_INT_SAMPLER_1D_ARRAY)
+        case GL_UNSIGNED_INT_SAMPLER_1D_ARRAY:
+        #endif
+        #if defined(GL_UNSIGNED_INT_SAMPLER_2D_ARRAY)
+        case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+        #endif
+        #if defined(GL_UNSIGNED_INT_SAMPLER_CUBE_MAP_ARRAY)
+        case GL_UNSIGNED_INT_SAMPLER_CUBE_MAP_ARRAY:
+        #endif
+        #if defined(GL_UNSIGNED_INT_SAMPLER_2D_RECT)
+        case GL_UNSIGNED_INT_SAMPLER_2D_RECT:
+        #endif
+        #if defined(GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE)
+        case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE:
+        #endif
+        #if defined(GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE_ARRAY)
+        case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE_ARRAY:
+        #endif
+        #if defined(GL_UNSIGNED_INT_SAMPLER_BUFFER)
+        case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+        #endif
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Sources that bind a texture, their uniforms take a unit whatever sampler type the shader declares
+bool isTextureSource(UniformSource _source) {
+    return  _source == UNIFORM_TEXTURE || _source == UNIFORM_STREAM_PREV ||
+            _source == UNIFORM_BUFFER || _source == UNIFORM_DOUBLE_BUFFER || _source == UNIFORM_FLOOD || _source == UNIFORM_PYRAMID ||
+            _source == UNIFORM_LIGHT_SHADOWMAP || _source == UNIFORM_CUBEMAP;
+}
+
+// "u_buffer12" with the prefix "u_buffer" gives 12
+bool indexAfter(const std::string& _name, const std::string& _prefix, size_t& _index) {
+    if (_name.size() <= _prefix.size() || _name.compare(0, _prefix.size(), _prefix) != 0)
+        return false;
+
+    for (size_t i = _prefix.size(); i < _name.size(); i++)
+        if (!isdigit(_name[i]))
+            return false;
+
+    _index = std::stoul(_name.substr(_prefix.size()));
+    return true;
+}
+
+// "u_tex0Resolution" with the suffix "Resolution" gives "u_tex0"
+bool prefixBefore(const std::string& _name, const std::string& _suffix, std::string& _prefix) {
+    if (_name.size() <= _suffix.size() || _name.compare(_name.size() - _suffix.size(), _suffix.size(), _suffix) != 0)
+        return false;
+
+    _prefix = _name.substr(0, _name.size() - _suffix.size());
+    return true;
+}
+
+void uploadValues(const UniformBinding& _binding, const float* _values, size_t _size) {
+    if (_binding.integer && _size <= 4) {
+        GLint values[4];
+        for (size_t i = 0; i < _size; i++)
+            values[i] = GLint(_values[i]);
+
+        switch (_size) {
+            case 1: glUniform1iv(_binding.location, 1, values); break;
+            case 2: glUniform2iv(_binding.location, 1, values); break;
+            case 3: glUniform3iv(_binding.location, 1, values); break;
+            case 4: glUniform4iv(_binding.location, 1, values); break;
+        }
+        return;
+    }
+
+    switch (_size) {
+        case 1: glUniform1fv(_binding.location, 1, _values); break;
+        case 2: glUniform2fv(_binding.location, 1, _values); break;
+        case 3: glUniform3fv(_binding.location, 1, _values); break;
+        case 4: glUniform4fv(_binding.location, 1, _values); break;
+        case 9: glUniformMatrix3fv(_binding.location, 1, GL_FALSE, _values); break;
+        case 16: glUniformMatrix4fv(_binding.location, 1, GL_FALSE, _values); break;
+    }
+}
+
+void uploadValue(GLint _location, float _value) { glUniform1f(_location, _value); }
+void uploadValue(GLint _location, const glm::vec3& _value) { glUniform3fv(_location, 1, glm::value_ptr(_value)); }
+void uploadValue(GLint _location, const glm::vec4& _value) { glUniform4fv(_location, 1, glm::value_ptr(_value)); }
+void uploadValue(GLint _location, const glm::mat4& _value) { glUniformMatrix4fv(_location, 1, GL_FALSE, glm::value_ptr(_value)); }
+
+}
+
+void Uniforms::_bindUnit(UniformBinding& _binding, GLenum _target, GLuint _id, GLint _base) {
+    if (_binding.unit < 0)
+        return;
+
+    GLint unit = _base + _binding.unit;
+    m_units.bind(_target, _id, unit);
+
+    // the sampler is program state, it keeps pointing to the same unit until told otherwise
+    if (_binding.sampler != unit) {
+        glUniform1i(_binding.location, unit);
+        _binding.sampler = unit;
+    }
+}
+
 bool Uniforms::feedTo(vera::Shader *_shader, bool _lights, bool _buffers ) {
+    if (m_bench_recording && std::find(m_bench_shaders.begin(), m_bench_shaders.end(), _shader) == m_bench_shaders.end())
+        m_bench_shaders.push_back(_shader);
+
+    bool inUse = _shader->isInUse();
+
+    // The block is built and uploaded by update(), programs that declare it only need it bound
+    #if defined(SUPPORT_UNIFORM_BLOCK)
+    if (inUse && _getBindings(_shader).block) {
+        if (!m_block_used) {
+            m_block_used = true;
+            _updateBlock();
+        }
+        glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_BINDING, m_block_buffer);
+    }
+    #endif
+
+    // Tables upload straight to the locations of the program in use
+    if (bindingTables && inUse)
+        _feedBindings(_shader, _lights, _buffers);
+    else
+        _feedNames(_shader, _lights, _buffers);
+
     bool update = false;
+    for (size_t i = 0; i < m_dataTable.size() && !update; i++)
+        update = m_dataTable[i]->change;
 
+    for (UniformSequenceMap::iterator it = sequences.begin(); it != sequences.end(); ++it)
+        if (!it->second->empty())
+            update = true;
+
+    return update;
+}
+
+void Uniforms::_feedNames(vera::Shader *_shader, bool _lights, bool _buffers ) {
+    GLint base = _shader->textureIndex;
     // Pass native uniforms functions (u_time, u_data, etc...)
     for (UniformFunctionsMap::iterator it = functions.begin(); it != functions.end(); ++it) {
-        if (!_lights && ( it->first == "u_scene" || it->first == "u_sceneDepth" || it->first == "u_sceneNormal" || it->first == "u_scenePosition") )
+        if (!it->second.present || !it->second.assign)
             continue;
 
-        if (it->second.present)
-            if (it->second.assign)
-                it->second.assign( *_shader );
+        // the scene buffers only go to the passes that take lights
+        if (!_lights && (   &it->second == m_functionIds[UNIFORM_ID_SCENE] || &it->second == m_functionIds[UNIFORM_ID_SCENE_DEPTH] ||
+                            &it->second == m_functionIds[UNIFORM_ID_SCENE_NORMAL] || &it->second == m_functionIds[UNIFORM_ID_SCENE_POSITION]) )
+            continue;
+
+        it->second.assign( *_shader );
     }
 
-    // Pass user defined uniforms (only if the shader code or scene had changed)
-    // if (m_changed) 
-    {
-        for (UniformDataMap::iterator it = data.begin(); it != data.end(); ++it) {
-            _shader->setUniform(it->first, it->second.value.data(), it->second.size);
-            if (it->second.change) {
-                update += true;
+    // Pass user defined uniforms the program doesn't have yet
+    std::vector<size_t>* versions = _shader->isInUse() ? &_getBindings(_shader).versions : nullptr;
+    if (versions && versions->size() < m_dataTable.size())
+        versions->resize(m_dataTable.size(), 0);
+    for (UniformDataMap::iterator it = data.begin(); it != data.end(); ++it) {
+        if (versions) {
+            size_t& version = (*versions)[it->second.id];
+            if (version == it->second.version) {
+                m_data_redundant++;
+                continue;
             }
+            version = it->second.version;
         }
+
+        _shader->setUniform(it->first, it->second.value.data(), it->second.size);
+        m_data_uploads++;
     }
 
     // Pass sequence uniforms (the change every frame)
-    for (UniformSequenceMap::iterator it = sequences.begin(); it != sequences.end(); ++it) {
-        if (it->second.size() > 0) {
-            size_t frame = m_frame % it->second.size();
-            _shader->setUniform(it->first, it->second[frame].value.data(), it->second[frame].size);
-            update += true;
-        }
-    }
+    for (UniformSequenceMap::iterator it = sequences.begin(); it != sequences.end(); ++it)
+        if (!it->second->empty())
+            _shader->setUniform(it->first, it->second->getValue(), it->second->getComponents());
 
     // Pass Textures Uniforms
     for (vera::TexturesMap::iterator it = textures.begin(); it != textures.end(); ++it) {
@@ -315,16 +616,18 @@ bool Uniforms::feedTo(vera::Shader *_shader, bool _lights, bool _buffers ) {
         _shader->setUniform(it->first+"TotalFrames", float(it->second->getTotalFrames()));
     }
 
-    // Pass Buffers Texture
+    // Pass Buffers Texture (but the one the pass renders into)
     if (_buffers) {
         for (size_t i = 0; i < buffers.size(); i++)
-            _shader->setUniformTexture("u_buffer" + vera::toString(i), buffers[i], _shader->textureIndex++ );
+            if (!_isTarget(buffers[i]))
+                _shader->setUniformTexture("u_buffer" + vera::toString(i), buffers[i], _shader->textureIndex++ );
 
         for (size_t i = 0; i < doubleBuffers.size(); i++)
             _shader->setUniformTexture("u_doubleBuffer" + vera::toString(i), doubleBuffers[i]->src, _shader->textureIndex++ );
     
         for (size_t i = 0; i < floods.size(); i++)
-            _shader->setUniformTexture("u_flood" + vera::toString(i), floods[i].dst, _shader->textureIndex++ );
+            if (!_isTarget(floods[i].dst))
+                _shader->setUniformTexture("u_flood" + vera::toString(i), floods[i].dst, _shader->textureIndex++ );
     }
 
     // Pass Convolution Piramids resultant Texture
@@ -377,36 +680,629 @@ bool Uniforms::feedTo(vera::Shader *_shader, bool _lights, bool _buffers ) {
             _shader->setUniform("u_SH", activeCubemap->SH, 9);
         }
     }
-    return update;
+
+    // All of that went behind the cache, and may have pointed the table's samplers elsewhere
+    m_units.count( size_t(std::max(_shader->textureIndex - base, 0)) );
+    m_units.invalidate();
+    UniformBindingsMap::iterator table = m_bindings.find(_shader);
+    if (table != m_bindings.end())
+        for (size_t i = 0; i < table->second.bindings.size(); i++)
+            table->second.bindings[i].sampler = -1;
+}
+
+void Uniforms::_feedBindings(vera::Shader *_shader, bool _lights, bool _buffers ) {
+    UniformBindingTable& table = _getBindings(_shader);
+
+    // Samplers go to units past the ones the caller already took (by name, behind the cache).
+    // What the rest of the units hold only carries over from the last feed while it's held
+    GLint base = _shader->textureIndex;
+    if (m_units_held)
+        m_units.forget(0, base);
+    else
+        m_units.invalidate();
+
+    for (size_t i = 0; i < table.bindings.size(); i++) {
+        UniformBinding& binding = table.bindings[i];
+        if (binding.lights && !_lights)
+            continue;
+
+        switch (binding.source) {
+            case UNIFORM_FUNCTION:
+                if (!binding.function->present)
+                    break;
+
+                // the scene buffers bind themselves at textureIndex, give them their unit
+                if (binding.unit >= 0) {
+                    _shader->textureIndex = base + binding.unit;
+                    binding.function->assign( *_shader );
+                    m_units.forget(base + binding.unit, base + binding.unit + 1);
+                }
+                else
+                    binding.function->assign( *_shader );
+                break;
+
+            case UNIFORM_DATA:
+                if (binding.version == binding.data->version) {
+                    m_data_redundant++;
+                    break;
+                }
+                uploadValues(binding, binding.data->value.data(), binding.data->size);
+                binding.version = binding.data->version;
+                m_data_uploads++;
+                break;
+
+            case UNIFORM_SEQUENCE:
+                if (!binding.sequence->empty()) {
+                    if (binding.version == binding.sequence->version) {
+                        m_data_redundant++;
+                        break;
+                    }
+                    uploadValues(binding, binding.sequence->getValue(), binding.sequence->getComponents());
+                    binding.version = binding.sequence->version;
+                    m_data_uploads++;
+                }
+                break;
+
+            case UNIFORM_TEXTURE:
+            case UNIFORM_TEXTURE_RESOLUTION: {
+                vera::TexturesMap::iterator it = textures.find(binding.key);
+                if (it == textures.end() || it->second == nullptr)
+                    break;
+
+                if (binding.source == UNIFORM_TEXTURE)
+                    _bindUnit(binding, GL_TEXTURE_2D, it->second->getTextureId(), base);
+                else
+                    glUniform2f(binding.location, float(it->second->getWidth()), float(it->second->getHeight()));
+            } break;
+
+            case UNIFORM_STREAM_PREV:
+            case UNIFORM_STREAM_TIME:
+            case UNIFORM_STREAM_FPS:
+            case UNIFORM_STREAM_DURATION:
+            case UNIFORM_STREAM_CURRENT_FRAME:
+            case UNIFORM_STREAM_TOTAL_FRAMES: {
+                vera::TextureStreamsMap::iterator it = streams.find(binding.key);
+                if (it == streams.end() || it->second == nullptr)
+                    break;
+
+                if (binding.source == UNIFORM_STREAM_PREV) {
+                    GLint units[32];
+                    GLint total = std::min(std::min((GLint)it->second->getPrevTexturesTotal(), binding.count), 32);
+                    for (GLint j = 0; j < total && binding.unit >= 0; j++) {
+                        units[j] = base + binding.unit + j;
+                        m_units.bind(GL_TEXTURE_2D, it->second->getPrevTextureId(j), units[j]);
+                    }
+                    if (total > 0 && binding.unit >= 0)
+                        glUniform1iv(binding.location, total, units);
+                }
+                else if (binding.source == UNIFORM_STREAM_TIME)
+                    glUniform1f(binding.location, float(it->second->getTime()));
+                else if (binding.source == UNIFORM_STREAM_FPS)
+                    glUniform1f(binding.location, float(it->second->getFps()));
+                else if (binding.source == UNIFORM_STREAM_DURATION)
+                    glUniform1f(binding.location, float(it->second->getDuration()));
+                else if (binding.source == UNIFORM_STREAM_CURRENT_FRAME)
+                    glUniform1f(binding.location, float(it->second->getCurrentFrame()));
+                else
+                    glUniform1f(binding.location, float(it->second->getTotalFrames()));
+            } break;
+
+            // The fbo the pass renders into leaves its unit empty, it can't be sampled while written
+            case UNIFORM_BUFFER:
+                if (_buffers && binding.index < buffers.size())
+                    _bindUnit(binding, GL_TEXTURE_2D, _isTarget(buffers[binding.index]) ? 0 : buffers[binding.index]->getTextureId(), base);
+                break;
+
+            case UNIFORM_DOUBLE_BUFFER:
+                if (_buffers && binding.index < doubleBuffers.size())
+                    _bindUnit(binding, GL_TEXTURE_2D, doubleBuffers[binding.index]->src->getTextureId(), base);
+                break;
+
+            case UNIFORM_FLOOD:
+                if (_buffers && binding.index < floods.size())
+                    _bindUnit(binding, GL_TEXTURE_2D, _isTarget(floods[binding.index].dst) ? 0 : floods[binding.index].dst->getTextureId(), base);
+                break;
+
+            case UNIFORM_PYRAMID:
+                if (binding.index < pyramids.size())
+                    _bindUnit(binding, GL_TEXTURE_2D, pyramids[binding.index].getResult()->getTextureId(), base);
+                break;
+
+            case UNIFORM_CUBEMAP:
+                if (activeCubemap && binding.unit >= 0) {
+                    _shader->textureIndex = base + binding.unit;
+                    _shader->setUniformTextureCube(binding.name, (vera::TextureCube*)activeCubemap);
+                    m_units.forget(base + binding.unit, base + binding.unit + 1);
+                }
+                break;
+
+            case UNIFORM_SH:
+                if (activeCubemap)
+                    glUniform3fv(binding.location, std::min(binding.count, 9), glm::value_ptr(activeCubemap->SH[0]));
+                break;
+
+            default: {
+                vera::LightsMap::iterator it = lights.find(binding.key);
+                if (it == lights.end() || it->second == nullptr)
+                    break;
+
+                vera::Light* light = it->second;
+                bool directional = light->getLightType() == vera::LIGHT_DIRECTIONAL || light->getLightType() == vera::LIGHT_SPOT;
+                switch (binding.source) {
+                    case UNIFORM_LIGHT:             uploadValue(binding.location, light->getPosition()); break;
+                    case UNIFORM_LIGHT_COLOR:       uploadValue(binding.location, light->color); break;
+                    case UNIFORM_LIGHT_INTENSITY:   uploadValue(binding.location, light->intensity); break;
+                    case UNIFORM_LIGHT_DIRECTION:   if (directional) uploadValue(binding.location, light->direction); break;
+                    case UNIFORM_LIGHT_FALLOFF:     if (light->falloff > 0) uploadValue(binding.location, light->falloff); break;
+                    case UNIFORM_LIGHT_MATRIX:      uploadValue(binding.location, light->getBiasMVPMatrix()); break;
+                    case UNIFORM_LIGHT_SHADOWMAP:   _bindUnit(binding, GL_TEXTURE_2D, light->getShadowMap()->getDepthTextureId(), base); break;
+                    default: break;
+                }
+            } break;
+        }
+    }
+
+    // Whatever the caller binds next goes after the units of the table
+    _shader->textureIndex = std::max(_shader->textureIndex, base + table.units);
+}
+
+// Fingerprint of the sources a table can point to. Inserting or erasing user data and sequences
+// goes through _data(), addSequence() and clearUniforms(), which invalidate the tables, but textures
+// and streams are also added by vera and the python bindings, so their names are part of it
+size_t Uniforms::_layout() {
+    const size_t sizes[] = {    functions.size(), data.size(), sequences.size(), textures.size(), streams.size(),
+                                buffers.size(), doubleBuffers.size(), floods.size(), pyramids.size(), lights.size(),
+                                activeCubemap ? size_t(1) : size_t(0) };
+    size_t layout = 0;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        layout = layout * 31 + sizes[i];
+
+    std::hash<std::string> hash;
+    for (vera::TexturesMap::iterator it = textures.begin(); it != textures.end(); ++it)
+        layout = layout * 31 + hash(it->first);
+    for (vera::TextureStreamsMap::iterator it = streams.begin(); it != streams.end(); ++it)
+        layout = layout * 31 + hash(it->first);
+    return layout;
+}
+
+UniformBindingTable& Uniforms::_getBindings(vera::Shader *_shader) {
+    // Something got recompiled, start over (this also forgets shaders that are gone)
+    size_t version = m_bindings_version;
+    if (m_bindings_built != version) {
+        m_bindings.clear();
+        m_bindings_built = version;
+    }
+
+    GLuint program = _shader->getProgram();
+    size_t layout = _layout();
+    UniformBindingTable& table = m_bindings[_shader];
+    if (table.program == program && table.layout == layout)
+        return table;
+
+    table.program = program;
+    table.layout = layout;
+    table.block = false;
+    table.units = 0;
+    table.bindings.clear();
+
+    GLint total = 0;
+    GLint maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &total);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    table.active = total;
+
+    std::vector<GLchar> buffer(std::max(maxLength, 1) + 1);
+    for (GLint i = 0; i < total; i++) {
+        GLsizei length = 0;
+        GLint count = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, i, (GLsizei)buffer.size(), &length, &count, &type, buffer.data());
+        std::string name(buffer.data(), length);
+
+        // struct members belong to whoever declares the struct, arrays are reported as "name[0]"
+        if (name.find('.') != std::string::npos)
+            continue;
+        size_t bracket = name.find('[');
+        if (bracket != std::string::npos)
+            name.erase(bracket);
+
+        UniformBinding binding;
+        binding.location = glGetUniformLocation(program, name.c_str());
+        binding.count = count;
+        binding.integer = isInteger(type);
+        binding.name = name;
+        if (binding.location >= 0 && _bind(name, binding)) {
+            // every sampler gets its own unit(s), the same ones each time the program is fed. A
+            // type unknown to the headers still gets one when its source binds a texture
+            if (isSampler(type) || isTextureSource(binding.source)) {
+                binding.unit = table.units;
+                table.units += (binding.source == UNIFORM_STREAM_PREV) ? std::min(count, 32) : 1;
+            }
+            table.bindings.push_back(binding);
+        }
+    }
+
+    // Members of the block are not plain uniforms (no location), the block gets fed as a whole
+    #if defined(SUPPORT_UNIFORM_BLOCK)
+    if (program != 0 && isBlockSupported()) {
+        GLuint index = glGetUniformBlockIndex(program, UNIFORM_BLOCK_NAME);
+        table.block = (index != GL_INVALID_INDEX);
+        if (table.block)
+            glUniformBlockBinding(program, index, UNIFORM_BLOCK_BINDING);
+    }
+    #endif
+
+    return table;
+}
+
+bool Uniforms::getReads(vera::Shader *_shader, RenderGraph& _graph, size_t _pass) {
+    if (_shader->getProgram() == 0)
+        return false;
+
+    UniformBindingTable& table = _getBindings(_shader);
+    RenderPass& pass = _graph[_pass];
+
+    // the block carries the time
+    if (table.block)
+        pass.reads |= PASS_READS_TIME;
+
+    for (size_t i = 0; i < table.bindings.size(); i++) {
+        const UniformBinding& binding = table.bindings[i];
+        size_t input = _graph.size();
+
+        switch (binding.source) {
+            case UNIFORM_FUNCTION: {
+                // the ids (time, delta, date, mouse and the scene render) and u_frame move every frame
+                const UniformFunction* function = binding.function;
+                bool time = false;
+                for (size_t id = 0; id < UNIFORM_ID_TOTAL; id++)
+                    time = time || (function == m_functionIds[id]);
+                time = time || binding.name == "u_frame";
+                pass.reads |= time ? PASS_READS_TIME : PASS_READS_SCENE;
+            } break;
+
+            case UNIFORM_DATA:      pass.versions.push_back( &binding.data->version ); break;
+            case UNIFORM_SEQUENCE:  pass.versions.push_back( &binding.sequence->version ); break;
+
+            case UNIFORM_STREAM_PREV:
+            case UNIFORM_STREAM_TIME:
+            case UNIFORM_STREAM_FPS:
+            case UNIFORM_STREAM_DURATION:
+            case UNIFORM_STREAM_CURRENT_FRAME:
+            case UNIFORM_STREAM_TOTAL_FRAMES:
+                pass.reads |= PASS_READS_TIME;
+                break;
+
+            case UNIFORM_BUFFER:        input = _graph.find(PASS_BUFFER, binding.index); break;
+            case UNIFORM_DOUBLE_BUFFER: input = _graph.find(PASS_DOUBLE_BUFFER, binding.index); break;
+            case UNIFORM_PYRAMID:       input = _graph.find(PASS_PYRAMID, binding.index); break;
+            case UNIFORM_FLOOD:         input = _graph.find(PASS_FLOOD, binding.index); break;
+
+            // textures, cubemap and lights
+            default:
+                pass.reads |= PASS_READS_SCENE;
+                break;
+        }
+
+        if (input < _graph.size())
+            _graph.connect(input, _pass);
+    }
+
+    return true;
+}
+
+bool Uniforms::_bind(const std::string& _name, UniformBinding& _binding) {
+    // Same precedence feeding by name has, where sequences overwrite data and data overwrites functions
+    UniformSequenceMap::iterator seq = sequences.find(_name);
+    if (seq != sequences.end()) {
+        _binding.source = UNIFORM_SEQUENCE;
+        _binding.sequence = seq->second.get();
+        return true;
+    }
+
+    UniformDataMap::iterator dat = data.find(_name);
+    if (dat != data.end()) {
+        _binding.source = UNIFORM_DATA;
+        _binding.data = &dat->second;
+        return true;
+    }
+
+    UniformFunctionsMap::iterator fnc = functions.find(_name);
+    if (fnc != functions.end() && fnc->second.assign) {
+        _binding.source = UNIFORM_FUNCTION;
+        _binding.function = &fnc->second;
+        _binding.lights = (_name == "u_scene" || _name == "u_sceneDepth" || _name == "u_sceneNormal" || _name == "u_scenePosition");
+        return true;
+    }
+
+    // Keys starting with "_" are an internal cache (see feeding by name)
+    if (_name[0] != '_' && textures.find(_name) != textures.end()) {
+        _binding.source = UNIFORM_TEXTURE;
+        _binding.key = _name;
+        return true;
+    }
+
+    std::string prefix;
+    if (prefixBefore(_name, "Resolution", prefix) && prefix[0] != '_' && textures.find(prefix) != textures.end()) {
+        _binding.source = UNIFORM_TEXTURE_RESOLUTION;
+        _binding.key = prefix;
+        return true;
+    }
+
+    static const std::pair<const char*, UniformSource> streamSuffixes[] = {
+        { "Prev", UNIFORM_STREAM_PREV }, { "Time", UNIFORM_STREAM_TIME }, { "Fps", UNIFORM_STREAM_FPS },
+        { "Duration", UNIFORM_STREAM_DURATION }, { "CurrentFrame", UNIFORM_STREAM_CURRENT_FRAME }, { "TotalFrames", UNIFORM_STREAM_TOTAL_FRAMES } };
+    for (size_t i = 0; i < sizeof(streamSuffixes) / sizeof(streamSuffixes[0]); i++) {
+        if (prefixBefore(_name, streamSuffixes[i].first, prefix) && streams.find(prefix) != streams.end()) {
+            _binding.source = streamSuffixes[i].second;
+            _binding.key = prefix;
+            return true;
+        }
+    }
+
+    if (indexAfter(_name, "u_buffer", _binding.index))         { _binding.source = UNIFORM_BUFFER; return true; }
+    if (indexAfter(_name, "u_doubleBuffer", _binding.index))   { _binding.source = UNIFORM_DOUBLE_BUFFER; return true; }
+    if (indexAfter(_name, "u_flood", _binding.index))          { _binding.source = UNIFORM_FLOOD; return true; }
+    if (indexAfter(_name, "u_pyramid", _binding.index))        { _binding.source = UNIFORM_PYRAMID; return true; }
+
+    // The "default" light (or the only one) is u_light, the rest u_<name>
+    static const std::pair<const char*, UniformSource> lightSuffixes[] = {
+        { "", UNIFORM_LIGHT }, { "Color", UNIFORM_LIGHT_COLOR }, { "Intensity", UNIFORM_LIGHT_INTENSITY },
+        { "Direction", UNIFORM_LIGHT_DIRECTION }, { "Falloff", UNIFORM_LIGHT_FALLOFF }, { "Matrix", UNIFORM_LIGHT_MATRIX },
+        { "ShadowMap", UNIFORM_LIGHT_SHADOWMAP } };
+    for (vera::LightsMap::iterator it = lights.begin(); it != lights.end(); ++it) {
+        std::string light = (lights.size() == 1 || it->first == "default") ? "u_light" : "u_" + it->first;
+        for (size_t i = 0; i < sizeof(lightSuffixes) / sizeof(lightSuffixes[0]); i++) {
+            if (_name == light + lightSuffixes[i].first) {
+                _binding.source = lightSuffixes[i].second;
+                _binding.key = it->first;
+                _binding.lights = true;
+                return true;
+            }
+        }
+    }
+
+    if (_name == "u_cubeMap" || _name == "u_SH") {
+        _binding.source = (_name == "u_cubeMap") ? UNIFORM_CUBEMAP : UNIFORM_SH;
+        _binding.lights = true;
+        return true;
+    }
+
+    return false;
+}
+
+bool Uniforms::isBlockSupported() {
+    #if defined(SUPPORT_UNIFORM_BLOCK)
+    return vera::getVersionNumber() >= 140;
+    #else
+    return false;
+    #endif
+}
+
+// Goes in the GLSLVIEWER_UBO define, so it has to fit in one line. Precisions are explicit so vertex
+// and fragment stages agree on GLES
+std::string Uniforms::getBlockDeclaration() {
+    return  "layout(std140) uniform " UNIFORM_BLOCK_NAME " { "
+            "highp mat4 u_viewMatrix; highp mat4 u_projectionMatrix; highp mat4 u_inverseViewMatrix; highp mat4 u_inverseProjectionMatrix; "
+            "highp mat4 u_lightMatrix; highp vec4 u_date; "
+            "highp vec3 u_camera; highp float u_time; "
+            "highp vec3 u_light; highp float u_delta; "
+            "highp vec3 u_lightColor; highp float u_lightIntensity; "
+            "highp vec3 u_lightDirection; highp float u_lightFalloff; "
+            "highp vec2 u_resolution; highp vec2 u_mouse; "
+            "highp float u_cameraNearClip; highp float u_cameraFarClip; highp float u_cameraDistance; highp float u_cameraExposure; "
+            "highp int u_frame; highp float u_pixelDensity; };";
+}
+
+void Uniforms::blockUpdate() {
+    if (m_block_used)
+        _updateBlock();
+}
+
+void Uniforms::blockView(const glm::mat4& _view, const glm::mat4& _projection) {
+    // The inverses and the camera position follow the view that replaces the camera's
+    glm::mat4 inverseView = glm::inverse(_view);
+    memcpy(m_block_override.viewMatrix, glm::value_ptr(_view), sizeof(m_block_override.viewMatrix));
+    memcpy(m_block_override.projectionMatrix, glm::value_ptr(_projection), sizeof(m_block_override.projectionMatrix));
+    memcpy(m_block_override.inverseViewMatrix, glm::value_ptr(inverseView), sizeof(m_block_override.inverseViewMatrix));
+    memcpy(m_block_override.inverseProjectionMatrix, glm::value_ptr(glm::inverse(_projection)), sizeof(m_block_override.inverseProjectionMatrix));
+    m_block_override.camera[0] = inverseView[3].x;
+    m_block_override.camera[1] = inverseView[3].y;
+    m_block_override.camera[2] = inverseView[3].z;
+    m_block_override_view = true;
+    _uploadBlock();
+}
+
+void Uniforms::blockResolution(float _width, float _height) {
+    m_block_override.resolution[0] = _width;
+    m_block_override.resolution[1] = _height;
+    m_block_override_resolution = true;
+    _uploadBlock();
+}
+
+void Uniforms::blockReset() {
+    if (!m_block_override_view && !m_block_override_resolution)
+        return;
+
+    m_block_override_view = false;
+    m_block_override_resolution = false;
+    _uploadBlock();
+}
+
+void Uniforms::_updateBlock() {
+    #if defined(SUPPORT_UNIFORM_BLOCK)
+    UniformBlock& block = m_block;
+    memset(&block, 0, sizeof(UniformBlock));
+
+    if (activeCamera) {
+        memcpy(block.viewMatrix, glm::value_ptr(activeCamera->getViewMatrix()), sizeof(block.viewMatrix));
+        memcpy(block.projectionMatrix, glm::value_ptr(activeCamera->getProjectionMatrix()), sizeof(block.projectionMatrix));
+        memcpy(block.inverseViewMatrix, glm::value_ptr(activeCamera->getInverseViewMatrix()), sizeof(block.inverseViewMatrix));
+        memcpy(block.inverseProjectionMatrix, glm::value_ptr(activeCamera->getInverseProjectionMatrix()), sizeof(block.inverseProjectionMatrix));
+        glm::vec3 position = activeCamera->getPosition();
+        block.camera[0] = position.x;
+        block.camera[1] = position.y;
+        block.camera[2] = position.z;
+        block.cameraNearClip = activeCamera->getNearClip();
+        block.cameraFarClip = activeCamera->getFarClip();
+        block.cameraDistance = activeCamera->getDistance();
+        block.cameraExposure = float(activeCamera->getExposure());
+    }
+
+    // Same light feeding by name calls u_light: the "default" one or the only one
+    vera::LightsMap::iterator it = lights.find("default");
+    if (it == lights.end() && lights.size() == 1)
+        it = lights.begin();
+    if (it != lights.end() && it->second) {
+        glm::vec3 position = it->second->getPosition();
+        glm::vec3 color = glm::vec3(it->second->color);
+        memcpy(block.lightMatrix, glm::value_ptr(it->second->getBiasMVPMatrix()), sizeof(block.lightMatrix));
+        memcpy(block.light, glm::value_ptr(position), sizeof(block.light));
+        memcpy(block.lightColor, glm::value_ptr(color), sizeof(block.lightColor));
+        memcpy(block.lightDirection, glm::value_ptr(it->second->direction), sizeof(block.lightDirection));
+        block.lightIntensity = it->second->intensity;
+        block.lightFalloff = it->second->falloff;
+    }
+
+    if (blockFunction)
+        blockFunction(block);
+
+    _uploadBlock();
+    #endif
+}
+
+void Uniforms::_uploadBlock() {
+    #if defined(SUPPORT_UNIFORM_BLOCK)
+    if (!m_block_used)
+        return;
+
+    // The frame values with whatever the current pass replaces
+    UniformBlock block = m_block;
+    if (m_block_override_view) {
+        memcpy(block.viewMatrix, m_block_override.viewMatrix, sizeof(block.viewMatrix));
+        memcpy(block.projectionMatrix, m_block_override.projectionMatrix, sizeof(block.projectionMatrix));
+        memcpy(block.inverseViewMatrix, m_block_override.inverseViewMatrix, sizeof(block.inverseViewMatrix));
+        memcpy(block.inverseProjectionMatrix, m_block_override.inverseProjectionMatrix, sizeof(block.inverseProjectionMatrix));
+        memcpy(block.camera, m_block_override.camera, sizeof(block.camera));
+    }
+
+    if (m_block_override_resolution) {
+        block.resolution[0] = m_block_override.resolution[0];
+        block.resolution[1] = m_block_override.resolution[1];
+    }
+
+    if (m_block_buffer == 0) {
+        glGenBuffers(1, &m_block_buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_block_buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(UniformBlock), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        m_block_uploaded = false;
+    }
+
+    // Same values the buffer already holds
+    if (m_block_uploaded && memcmp(&block, &m_block_gpu, sizeof(UniformBlock)) == 0)
+        return;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, m_block_buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(UniformBlock), &block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    m_block_gpu = block;
+    m_block_uploaded = true;
+    #endif
+}
+
+void Uniforms::benchmarkRun() {
+    size_t iterations = m_bench_iterations;
+    if (iterations == 0)
+        return;
+
+    // Collect the shaders of one whole frame first
+    if (!m_bench_recording) {
+        m_bench_shaders.clear();
+        m_bench_recording = true;
+        return;
+    }
+    m_bench_recording = false;
+    m_bench_iterations = 0;
+
+    std::cout << "// " << iterations << " feeds per shader, in microseconds per draw" << std::endl;
+    std::cout << "// shader, active uniforms, bound uniforms, by name, by table" << std::endl;
+
+    double totalNames = 0.0;
+    double totalTables = 0.0;
+    for (size_t i = 0; i < m_bench_shaders.size(); i++) {
+        vera::Shader* shader = m_bench_shaders[i];
+        shader->use();
+        UniformBindingTable& table = _getBindings(shader);
+
+        std::chrono::time_point<std::chrono::high_resolution_clock> start = std::chrono::high_resolution_clock::now();
+        for (size_t n = 0; n < iterations; n++) {
+            shader->textureIndex = 0;
+            _feedNames(shader, true, true);
+        }
+        double names = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count() / iterations;
+
+        start = std::chrono::high_resolution_clock::now();
+        for (size_t n = 0; n < iterations; n++) {
+            shader->textureIndex = 0;
+            _feedBindings(shader, true, true);
+        }
+        double tables = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count() / iterations;
+
+        std::cout << i << "," << table.active << "," << table.bindings.size() << "," << names << "," << tables << std::endl;
+        totalNames += names;
+        totalTables += tables;
+    }
+
+    std::cout << "// " << m_bench_shaders.size() << " shaders per frame, " << totalNames << "us by name, " << totalTables << "us by table" << std::endl;
+    m_bench_shaders.clear();
 }
 
 void Uniforms::flagChange() {
     Scene::flagChange();
 
-    // Flag all user uniforms as changed
-    for (UniformDataMap::iterator it = data.begin(); it != data.end(); ++it)
-        it->second.change = true;
+    // Flag all user uniforms as changed (to upload again, the values arriving still start a new frame)
+    for (size_t i = 0; i < m_dataTable.size(); i++)
+        m_dataTable[i]->change = true;
 }
 
 void Uniforms::resetChange() {
     Scene::resetChange();
     
     // Flag all user uniforms as NOT changed
-    for (UniformDataMap::iterator it = data.begin(); it != data.end(); ++it)
-        m_changed += it->second.check();
+    for (size_t i = 0; i < m_dataTable.size(); i++)
+        m_changed += m_dataTable[i]->check();
+
+    tracker.setCounter("uniforms:uploads", m_data_uploads);
+    tracker.setCounter("uniforms:redundant", m_data_redundant);
+    m_data_uploads = 0;
+    m_data_redundant = 0;
+
+    tracker.setCounter("textures:binds", m_units.getBinds());
+    tracker.setCounter("textures:skipped", m_units.getSkipped());
+    tracker.setCounter("textures:units", m_units.getSwitches());
+    m_units.resetStats();
 }
 
 bool Uniforms::haveChange() {             
-    if (functions["u_time"].present || 
-        functions["u_date"].present ||
-        functions["u_delta"].present ||
-        functions["u_mouse"].present)
+    if (m_present[UNIFORM_ID_TIME] || 
+        m_present[UNIFORM_ID_DATE] ||
+        m_present[UNIFORM_ID_DELTA] ||
+        m_present[UNIFORM_ID_MOUSE])
+        return true;
+
+    // values from OSC or the console that update() hasn't taken yet
+    if (!m_inputs.empty())
         return true;
 
     return Scene::haveChange();
 }
 
 void Uniforms::checkUniforms( const std::string &_vert_src, const std::string &_frag_src ) {
+    // New sources, new programs
+    invalidateBindings();
+
     // Check active native uniforms
     for (UniformFunctionsMap::iterator it = functions.begin(); it != functions.end(); ++it) {
         std::string name = it->first + ";";
@@ -417,12 +1313,41 @@ void Uniforms::checkUniforms( const std::string &_vert_src, const std::string &_
             m_changed = true;
         } 
     }
+
+    for (size_t i = 0; i < UNIFORM_ID_TOTAL; i++)
+        m_present[i] = m_functionIds[i]->present;
+}
+
+void Uniforms::setFunction( const std::string& _name, const UniformFunction& _function ) {
+    UniformFunction& function = functions[_name];
+    bool present = function.present;
+    function = _function;
+    function.present = present;
+}
+
+void Uniforms::setPresent( UniformFunctionId _id, bool _present ) {
+    m_present[_id] = _present;
+    m_functionIds[_id]->present = _present;
+}
+
+UniformData& Uniforms::_data( const std::string& _name ) {
+    UniformDataMap::iterator it = data.find(_name);
+    if (it != data.end())
+        return it->second;
+
+    UniformData& uniform = data[_name];
+    uniform.id = m_dataTable.size();
+    m_dataTable.push_back(&uniform);
+
+    // tables built before it may have left this name unbound
+    invalidateBindings();
+    return uniform;
 }
 
 void Uniforms::set(const std::string& _name, float _value) {
     UniformValue value;
     value[0] = _value;
-    data[_name].set(value, 1, false);
+    _data(_name).set(value, 1, false);
     m_changed = true;
 }
 
@@ -430,7 +1355,7 @@ void Uniforms::set(const std::string& _name, float _x, float _y) {
     UniformValue value;
     value[0] = _x;
     value[1] = _y;
-    data[_name].set(value, 2, false);
+    _data(_name).set(value, 2, false);
     m_changed = true;
 }
 
@@ -439,7 +1364,7 @@ void Uniforms::set(const std::string& _name, float _x, float _y, float _z) {
     value[0] = _x;
     value[1] = _y;
     value[2] = _z;
-    data[_name].set(value, 3, false);
+    _data(_name).set(value, 3, false);
     m_changed = true;
 }
 
@@ -449,7 +1374,7 @@ void Uniforms::set(const std::string& _name, float _x, float _y, float _z, float
     value[1] = _y;
     value[2] = _z;
     value[3] = _w;
-    data[_name].set(value, 4, false);
+    _data(_name).set(value, 4, false);
     m_changed = true;
 }
 
@@ -459,54 +1384,155 @@ void Uniforms::set(const std::string& _name, const std::vector<float>& _data, bo
     // memcpy(&value, _data.data(), N * sizeof(float) );
     for (size_t i = 0; i < N; i++)
         value[i] = _data[i];
-    data[_name].set(value, N, false, _queue);
+    _data(_name).set(value, N, false, _queue);
     m_changed = true;
 }
 
 bool Uniforms::parseLine( const std::string &_line ) {
+    UniformInput input;
+    if (!parseInput(_line, input))
+        return false;
+
+    // when full the value is lost, it's counted on the queue
+    m_inputs.push( std::move(input) );
+    return true;
+}
+
+bool Uniforms::parseInput( const std::string &_line, UniformInput& _input ) {
+    const char* str = _line.c_str();
+    const char* end = str + _line.size();
+    const char* comma = (const char*)memchr(str, ',', _line.size());
+    if (comma == nullptr)
+        return false;
+
+    size_t count = 0;
+    for (const char* ptr = comma; ptr < end; ) {
+        // each value has to be a number and nothing else (besides spaces) up to the next comma
+        const char* start = ptr + 1;
+        char* stop = nullptr;
+        float value = strtof(start, &stop);
+        while (stop < end && *stop == ' ')
+            stop++;
+        if (stop == start || (stop < end && *stop != ','))
+            return splitInput(_line, _input);
+
+        // more than a mat4, let splitInput() report it
+        if (count == _input.value.size())
+            return splitInput(_line, _input);
+
+        _input.value[count++] = value;
+        ptr = stop;
+    }
+
+    // names up to 15 characters fit in the string itself, no allocation either
+    _input.name.assign(str, comma - str);
+    _input.size = count;
+    return true;
+}
+
+bool Uniforms::splitInput( const std::string &_line, UniformInput& _input ) {
     std::vector<std::string> values = vera::split(_line,',');
     if (values.size() > 1) {
-        data[ values[0] ].parse(values, 1);
-        m_changed = true;
+        if (values.size() - 1 > _input.value.size()) {
+            std::cerr << "// " << values[0] << " has " << values.size() - 1 << " values, uniforms take up to " << _input.value.size() << std::endl;
+            return false;
+        }
+
+        _input.name = values[0];
+        for (size_t i = 1; i < values.size(); i++) 
+            _input.value[i-1] = vera::toFloat(values[i]);
+        _input.size = values.size() - 1;
         return true;
     }
     return false;
 }
 
+void Uniforms::setPolicy( const std::string& _name, UniformPolicy _policy, size_t _capacity) {
+    // goes through the same queue, so it applies in order with the values around it
+    UniformInput input;
+    input.name = _name;
+    input.isPolicy = true;
+    input.policy = _policy;
+    input.capacity = std::max((size_t)1, _capacity);
+    m_inputs.push( std::move(input) );
+}
+
 bool Uniforms::addSequence( const std::string& _name, const std::string& _filename) {
-    std::vector<UniformData> uniform_data_sequence;
-
-    // Open file _filename and read all lines
-    std::ifstream infile(_filename);
-    std::string line = "";
-    while (std::getline(infile, line)) {
-        if (line.size() > 0) {
-            std::vector<std::string> values = vera::split(line,',', true);
-            if (values.size() > 0) {
-                UniformData data;
-                data.parse(values, 0, false);
-                uniform_data_sequence.push_back(data);
-            }
-        }
-    }
+    std::unique_ptr<UniformSequence> sequence(new UniformSequence());
+    if (!sequence->load(_filename))
+        return false;
+
+    sequences[_name] = std::move(sequence);
 
-    // std::cout << "Load " << _name << " from " << _filename <<  " with " << uniform_data_sequence.size() << " values" << std::endl;
-    if (uniform_data_sequence.size() == 0)
+    // the bindings point to the sequence
+    invalidateBindings();
+    return true;
+}
+
+// Writes the rows of a CSV sequence as <name>.useq next to it, to be mapped instead of parsed
+bool Uniforms::convertSequence( const std::string& _filename, float _fps) {
+    UniformSequence sequence;
+    if (!sequence.load(_filename)) {
+        std::cerr << "Can't load a sequence from " << _filename << std::endl;
         return false;
+    }
 
-    sequences[_name] = uniform_data_sequence;
+    sequence.setFps(_fps);
+    std::string output = _filename.substr(0, _filename.find_last_of('.')) + "." + SEQUENCE_EXT;
+    if (!sequence.save(output))
+        return false;
 
+    std::cout << "// " << sequence.size() << " rows of " << sequence.getType() << " at " << sequence.getFps() << " fps saved to " << output << std::endl;
     return true;
 }
 
+void Uniforms::printSequences() {
+    for (UniformSequenceMap::iterator it = sequences.begin(); it != sequences.end(); ++it) {
+        const UniformSequence* seq = it->second.get();
+        std::cout << it->first << "," << seq->getType() << "," << seq->size() << " rows,";
+        if (seq->getFps() > 0.0f)
+            std::cout << seq->getFps() << " fps," << sequence_interpolation_options[seq->getInterpolation()];
+        else
+            std::cout << "one row per frame";
+        std::cout << "," << (seq->isMapped() ? "mapped " : "loaded ") << seq->getBytes() / 1024 << "KB" << std::endl;
+    }
+}
+
 void Uniforms::update() {
     Scene::update();
 
+    // Values written from other threads since the last frame
+    UniformInput input;
+    while (m_inputs.pop(input)) {
+        UniformData& uniform = _data(input.name);
+        if (input.isPolicy) {
+            uniform.policy = input.policy;
+            uniform.capacity = input.capacity;
+            // nothing but FIFO keeps values in the queue
+            if (uniform.policy != UNIFORM_FIFO)
+                uniform.queue = std::queue<UniformValue>();
+            continue;
+        }
+
+        uniform.set(input.value, input.size, false);
+        m_changed = true;
+    }
+
     if (m_play) {
         m_frame++;
         if (m_frame >= std::numeric_limits<size_t>::max()-1)
             m_frame = 0;
     }
+
+    // Sample the sequences once for all the shaders of the frame. Without a frame rate they
+    // follow m_frame (and pause with it), with one they follow the time like u_time does
+    double time = sequenceTime ? sequenceTime() : 0.0;
+    for (UniformSequenceMap::iterator it = sequences.begin(); it != sequences.end(); ++it)
+        if (it->second->update(m_frame, time))
+            it->second->version = ++s_data_version;
+
+    // The GlslViewerFrame block, once for every pass of the frame
+    blockUpdate();
 }
 
 void Uniforms::setStreamsPlay() {
@@ -558,6 +1584,8 @@ void Uniforms::printDefinedUniforms(bool _csv){
     // Print user defined uniform data
     if (_csv) {
         for (UniformDataMap::iterator it= data.begin(); it != data.end(); ++it) {
+            if (it->second.size == 0)
+                continue;
             std::cout << it->first;
             for (int i = 0; i < it->second.size; i++) {
                 std::cout << ',' << it->second.value[i];
@@ -565,38 +1593,47 @@ void Uniforms::printDefinedUniforms(bool _csv){
             std::cout << std::endl;
         }
 
-        for (UniformSequenceMap::iterator it= sequences.begin(); it != sequences.end(); ++it) {
-            if (it->second.size() > 0) {
-                size_t frame = m_frame % it->second.size();
-                std::cout << it->first << ',' << it->second[frame].print() << std::endl;
-            }
-        }
+        for (UniformSequenceMap::iterator it= sequences.begin(); it != sequences.end(); ++it)
+            if (!it->second->empty())
+                std::cout << it->first << ',' << it->second->print() << std::endl;
     }
     else {
         for (UniformDataMap::iterator it= data.begin(); it != data.end(); ++it) {
+            if (it->second.size == 0)
+                continue;
             std::cout << "uniform " << it->second.getType() << "  " << it->first << ";";
             for (int i = 0; i < it->second.size; i++)
                 std::cout << ((i == 0)? " // " : "," ) << it->second.value[i];
-            std::cout << std::endl;
-        }
 
-        for (UniformSequenceMap::iterator it= sequences.begin(); it != sequences.end(); ++it) {
-            if (it->second.size() > 0) {
-                size_t frame = m_frame % it->second.size();
-                std::cout << "uniform " << it->second[frame].getType() << "  " << it->first << "; // " << it->second[frame].print() << std::endl;
+            // how the values that arrive faster than the frames are being handled
+            if (it->second.policy != UNIFORM_LATEST || it->second.coalesced > 0 || it->second.dropped > 0) {
+                std::cout << " (" << uniform_policy_options[it->second.policy];
+                if (it->second.policy == UNIFORM_FIFO)
+                    std::cout << " " << it->second.queue.size() << "/" << it->second.capacity;
+                std::cout << ", " << it->second.coalesced << " coalesced, " << it->second.dropped << " dropped)";
             }
+            std::cout << std::endl;
         }
+
+        for (UniformSequenceMap::iterator it= sequences.begin(); it != sequences.end(); ++it)
+            if (!it->second->empty())
+                std::cout << "uniform " << it->second->getType() << "  " << it->first << "; // " << it->second->print() << std::endl;
+
+        if (m_inputs.getDropped() > 0)
+            std::cout << "// " << m_inputs.getDropped() << " values dropped, they arrived faster than the frames could take them" << std::endl;
     }    
 }
 
 void Uniforms::addDefine(const std::string& _define, const std::string& _value) {
     for (vera::ModelsMap::iterator it = models.begin(); it != models.end(); ++it)
         it->second->addDefine(_define, _value);
+    invalidateBindings();
 }
 
 void Uniforms::delDefine(const std::string& _define) {
     for (vera::ModelsMap::iterator it = models.begin(); it != models.end(); ++it)
         it->second->delDefine(_define);
+    invalidateBindings();
 }
 
 void Uniforms::printDefines() {
@@ -618,16 +1655,16 @@ void Uniforms::printBuffers() {
     for (size_t i = 0; i < pyramids.size(); i++)
         std::cout << "uniform sampler2D u_pyramid" << i << ";" << std::endl;  
 
-    if (functions["u_scene"].present)
+    if (m_present[UNIFORM_ID_SCENE])
         std::cout << "uniform sampler2D u_scene;" << std::endl;
 
-    if (functions["u_sceneDepth"].present)
+    if (m_present[UNIFORM_ID_SCENE_DEPTH])
         std::cout << "uniform sampler2D u_sceneDepth;" << std::endl;
 
-    if (functions["u_scenePosition"].present)
+    if (m_present[UNIFORM_ID_SCENE_POSITION])
         std::cout << "uniform sampler2D u_scenePosition;" << std::endl;
 
-    if (functions["u_sceneNormal"].present)
+    if (m_present[UNIFORM_ID_SCENE_NORMAL])
         std::cout << "uniform sampler2D u_sceneNormal;" << std::endl;
 }
 
@@ -639,10 +1676,13 @@ void Uniforms::clearBuffers() {
 
 void Uniforms::clearUniforms() {
     data.clear();
+    m_dataTable.clear();
     sequences.clear();
+    invalidateBindings();
 
     for (UniformFunctionsMap::iterator it = functions.begin(); it != functions.end(); ++it)
         it->second.present = false;
+    m_present.reset();
 }
 
 bool Uniforms::addCameras( const std::string& _filename ) {
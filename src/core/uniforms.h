@@ -1,15 +1,22 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <queue>
 #include <mutex>
 #include <array>
+#include <bitset>
+#include <atomic>
 #include <vector>
 #include <string>
 #include <functional>
 
 #include "tools/files.h"
 #include "tools/tracker.h"
+#include "tools/lockFreeQueue.h"
+#include "tools/renderGraph.h"
+#include "tools/textureUnits.h"
+#include "tools/uniformSequence.h"
 
 #include "vera/gl/flood.h"
 #include "vera/types/scene.h"
@@ -17,6 +24,15 @@
 
 typedef std::array<float, 16> UniformValue;
 
+// What a uniform does with the values that arrive while one is still waiting for the next frame
+enum UniformPolicy {
+    UNIFORM_LATEST = 0,     // keep only the newest one (live controls)
+    UNIFORM_FIFO,           // one per frame, in order, up to a capacity (the oldest ones get dropped)
+    UNIFORM_AVERAGE         // the mean of all the values of the frame
+};
+
+const std::string uniform_policy_options[] = { "latest", "fifo", "average" };
+
 struct UniformData {
     std::string getType();
 
@@ -27,9 +43,28 @@ struct UniformData {
 
     std::queue<UniformValue>            queue;
     UniformValue                        value;
+    UniformValue                        sum;            // of the values averaged this frame
+    size_t                              samples = 0;
     size_t                              size    = 0;
+    size_t                              version = 0;    // unique and increasing every time value changes
+    UniformPolicy                       policy  = UNIFORM_LATEST;
+    size_t                              capacity = 64;  // of the FIFO queue
+    size_t                              coalesced = 0;  // values merged into another one (latest or average)
+    size_t                              dropped = 0;    // values pushed out of a full FIFO queue
+    size_t                              id      = 0;    // slot in the dense table of user uniforms
     bool                                bInt    = false;
-    bool                                change  = false;
+    bool                                change  = false;    // to upload on the next feed
+    bool                                pending = false;    // a value arrived this frame, new ones merge into it
+};
+
+// A value (or a policy) written from another thread (OSC, console), applied by the render thread on update()
+struct UniformInput {
+    std::string                         name;
+    UniformValue                        value;
+    size_t                              size    = 0;
+    bool                                isPolicy = false;
+    UniformPolicy                       policy  = UNIFORM_LATEST;
+    size_t                              capacity = 64;
 };
 
 struct UniformFunction {
@@ -44,10 +79,94 @@ struct UniformFunction {
     bool                                present = false;
 };
 
+// Built-in functions the render loop asks about every frame. Their entries get created up front
+// and addressed by these ids, so checking them never looks a name up
+enum UniformFunctionId {
+    UNIFORM_ID_TIME = 0, UNIFORM_ID_DELTA, UNIFORM_ID_DATE, UNIFORM_ID_MOUSE,
+    UNIFORM_ID_SCENE, UNIFORM_ID_SCENE_DEPTH, UNIFORM_ID_SCENE_NORMAL, UNIFORM_ID_SCENE_POSITION,
+    UNIFORM_ID_TOTAL
+};
+
+const std::string uniform_id_names[] = {
+    "u_time", "u_delta", "u_date", "u_mouse",
+    "u_scene", "u_sceneDepth", "u_sceneNormal", "u_scenePosition"
+};
+
+// Where the value of an active uniform comes from
+enum UniformSource {
+    UNIFORM_FUNCTION = 0, UNIFORM_DATA, UNIFORM_SEQUENCE,
+    UNIFORM_TEXTURE, UNIFORM_TEXTURE_RESOLUTION,
+    UNIFORM_STREAM_PREV, UNIFORM_STREAM_TIME, UNIFORM_STREAM_FPS, UNIFORM_STREAM_DURATION, UNIFORM_STREAM_CURRENT_FRAME, UNIFORM_STREAM_TOTAL_FRAMES,
+    UNIFORM_BUFFER, UNIFORM_DOUBLE_BUFFER, UNIFORM_FLOOD, UNIFORM_PYRAMID,
+    UNIFORM_LIGHT, UNIFORM_LIGHT_COLOR, UNIFORM_LIGHT_INTENSITY, UNIFORM_LIGHT_DIRECTION, UNIFORM_LIGHT_FALLOFF, UNIFORM_LIGHT_MATRIX, UNIFORM_LIGHT_SHADOWMAP,
+    UNIFORM_CUBEMAP, UNIFORM_SH
+};
+
+// An active uniform of a linked program and the source that feeds it
+struct UniformBinding {
+    UniformSource                       source;
+    GLint                               location    = -1;
+    GLint                               count       = 1;        // array size
+    bool                                integer     = false;    // int, ivec or bool in the shader
+    bool                                lights      = false;    // only fed to passes that take lights
+    size_t                              index       = 0;        // buffers, double buffers, floods and pyramids
+    std::string                         key;                    // textures, streams and lights entries, looked up every frame
+    std::string                         name;
+    UniformFunction*                    function    = nullptr;
+    UniformData*                        data        = nullptr;
+    UniformSequence*                    sequence    = nullptr;
+    size_t                              version     = 0;        // of the data (or sequence entry) last uploaded
+    GLint                               unit        = -1;       // samplers: texture unit past the shader's textureIndex
+    GLint                               sampler     = -1;       // unit last given to the sampler uniform
+};
+
+struct UniformBindingTable {
+    GLuint                              program     = 0;
+    size_t                              layout      = 0;
+    size_t                              active      = 0;        // active uniforms in the program, bound or not
+    bool                                block       = false;    // declares the GlslViewerFrame block
+    GLint                               units       = 0;        // texture units its samplers take
+    std::vector<UniformBinding>         bindings;
+    std::vector<size_t>                 versions;               // of the data uploaded by name, by UniformData::id
+};
+
+// Frame invariant uniforms shared by all the passes through one std140 block. Shaders opt in with the
+// GLSLVIEWER_UBO define (only present on GL3/GLES3), everything else keeps the per uniform path
+#if defined(GL_UNIFORM_BUFFER)
+#define SUPPORT_UNIFORM_BLOCK
+#endif
+
+#define UNIFORM_BLOCK_NAME      "GlslViewerFrame"
+#define UNIFORM_BLOCK_BINDING   0
+
+// CPU mirror of the GlslViewerFrame block, with the std140 offsets
+struct UniformBlock {
+    float   viewMatrix[16];                                 // 0
+    float   projectionMatrix[16];                           // 64
+    float   inverseViewMatrix[16];                          // 128
+    float   inverseProjectionMatrix[16];                    // 192
+    float   lightMatrix[16];                                // 256
+    float   date[4];                                        // 320
+    float   camera[3];          float   time;               // 336
+    float   light[3];           float   delta;              // 352
+    float   lightColor[3];      float   lightIntensity;     // 368
+    float   lightDirection[3];  float   lightFalloff;       // 384
+    float   resolution[2];                                  // 400
+    float   mouse[2];                                       // 408
+    float   cameraNearClip;                                 // 416
+    float   cameraFarClip;
+    float   cameraDistance;
+    float   cameraExposure;
+    int     frame;                                          // 432
+    float   pixelDensity;
+    float   padding[2];
+};
+
 // Uniforms values types (float, vecs and functions)
 typedef std::map<std::string, UniformFunction>          UniformFunctionsMap;
 typedef std::map<std::string, UniformData>              UniformDataMap;
-typedef std::map<std::string, std::vector<UniformData>> UniformSequenceMap;
+typedef std::map<std::string, std::unique_ptr<UniformSequence>> UniformSequenceMap;
+typedef std::map<const vera::Shader*, UniformBindingTable> UniformBindingsMap;
 
 // Buffers types
 typedef std::vector<vera::Fbo*>                 BuffersList;
@@ -68,10 +187,45 @@ public:
     virtual void        flagChange();
     virtual void        resetChange();
     virtual bool        haveChange();
+    bool                haveSceneChange() { return Scene::haveChange(); }   // without the time uniforms
 
     // Feed uniforms to a specific shader
     virtual bool        feedTo( vera::Shader *_shader, bool _lights = true, bool _buffers = true);
 
+    // Each linked program gets a table of its active uniforms (locations and sources) the first
+    // time it's fed, so feedTo() only walks what the shader declares. Tables are rebuilt when the
+    // program or the set of sources changes; call invalidateBindings() when shaders get recompiled
+    bool                bindingTables;
+    void                invalidateBindings() { m_bindings_version++; }
+
+    // What the program of a pass reads according to its table: the passes it samples, the user
+    // uniforms it takes and whether the rest changes with time or with the scene. False if the
+    // program is not linked yet. The stamp changes whenever the tables may point elsewhere
+    bool                getReads( vera::Shader *_shader, RenderGraph& _graph, size_t _pass );
+    size_t              getBindingsStamp() { return _layout() * 31 + m_bindings_version; }
+
+    // The GlslViewerFrame block: camera and light come from the scene, the rest from blockFunction.
+    // update() builds and uploads it once per frame (if some program declares it), and again when a
+    // pass renders with its own view or resolution, which last until blockReset(). Passes that move
+    // the camera in the middle of a frame call blockUpdate() to build it again
+    static bool         isBlockSupported();
+    static std::string  getBlockDeclaration();
+    std::function<void(UniformBlock&)> blockFunction;
+    void                blockUpdate();
+    void                blockView(const glm::mat4& _view, const glm::mat4& _projection);
+    void                blockResolution(float _width, float _height);
+    void                blockReset();
+
+    // Texture binds go through a mirror of what each unit holds (see TextureUnits). Every feedTo()
+    // starts it over, unless the caller holds it across passes that bind no textures of their own
+    // after feeding. feedTarget() is the fbo the next passes render into, feedTo() leaves it out
+    void                holdTextureUnits(bool _hold) { if (_hold != m_units_held) m_units.invalidate(); m_units_held = _hold; }
+    void                feedTarget(const vera::Fbo* _target) { m_feed_target = _target; }
+
+    // Times feedTo() by name and through the binding tables on every shader fed during the next frame
+    void                benchmark(size_t _iterations) { m_bench_iterations = _iterations; }
+    void                benchmarkRun();
+
     // defines
     virtual void        addDefine(const std::string& _define, const std::string& _value);
     virtual void        delDefine(const std::string& _define);
@@ -90,10 +244,17 @@ public:
 
     // Uniforms that trigger functions (u_time, u_data, etc.)
     UniformFunctionsMap functions;
+    // Replaces the function of a uniform keeping whether the shaders use it
+    void                setFunction( const std::string& _name, const UniformFunction& _function );
     virtual void        checkUniforms( const std::string &_vert_src, const std::string &_frag_src );
 
-    // Manually added uniforms
-    UniformDataMap      data;
+    // Presence of the built-in ids, computed by checkUniforms()
+    bool                isPresent( UniformFunctionId _id ) const { return m_present[_id]; }
+    void                setPresent( UniformFunctionId _id, bool _present );
+    UniformFunction&    getFunction( UniformFunctionId _id ) { return *m_functionIds[_id]; }
+
+    // Manually added uniforms, read only. They are added through set(), that gives them their slot
+    const UniformDataMap& getData() const { return data; }
     virtual void        set( const std::string& _name, float _value);
     virtual void        set( const std::string& _name, float _x, float _y);
     virtual void        set( const std::string& _name, float _x, float _y, float _z);
@@ -101,8 +262,20 @@ public:
     virtual void        set( const std::string& _name, const std::vector<float>& _data, bool _queue = true);
     virtual bool        parseLine( const std::string &_line );
 
+    // "<name>,<value>[,<value>...]" to an input. parseInput() reads the numbers in place, anything
+    // that is not a plain number falls back to splitInput() (split and vera::toFloat)
+    static bool         parseInput( const std::string &_line, UniformInput& _input );
+    static bool         splitInput( const std::string &_line, UniformInput& _input );
+
+    // Ingestion policy of a user uniform, _capacity only applies to FIFO. Takes effect on the next update()
+    virtual void        setPolicy( const std::string& _name, UniformPolicy _policy, size_t _capacity = 64);
+
+    // u_<name> values out of a CSV or a .useq file. Sequences with a frame rate follow sequenceTime
     UniformSequenceMap  sequences;
+    std::function<double()> sequenceTime;
     virtual bool        addSequence( const std::string& _name, const std::string& _filename);
+    virtual bool        convertSequence( const std::string& _filename, float _fps);
+    virtual void        printSequences();
     virtual void        setStreamsPlay();
     virtual void        setStreamsFrame(size_t _frame);
     virtual void        setStreamsStop();
@@ -129,6 +302,54 @@ public:
     bool                isPlaying() const { return m_play; }
 
 protected:
+    void                _feedNames( vera::Shader *_shader, bool _lights, bool _buffers );
+    void                _feedBindings( vera::Shader *_shader, bool _lights, bool _buffers );
+    UniformBindingTable& _getBindings( vera::Shader *_shader );
+    bool                _bind( const std::string& _name, UniformBinding& _binding );
+    size_t              _layout();
+
+    UniformFunction*    m_functionIds[UNIFORM_ID_TOTAL];
+    std::bitset<UNIFORM_ID_TOTAL> m_present;
+
+    // Interns a user uniform: std::map nodes never move, so the table keeps pointers to them
+    UniformDataMap      data;
+    UniformData&        _data( const std::string& _name );
+    std::vector<UniformData*> m_dataTable;
+
+    UniformBindingsMap  m_bindings;
+    std::atomic<size_t> m_bindings_version;
+    size_t              m_bindings_built;
+
+    // User data uploaded and skipped (same version already in the program) since the last frame
+    size_t              m_data_uploads;
+    size_t              m_data_redundant;
+
+    void                _bindUnit( UniformBinding& _binding, GLenum _target, GLuint _id, GLint _base );
+    bool                _isTarget( const vera::Fbo* _fbo ) const { return m_feed_target != nullptr && _fbo == m_feed_target; }
+
+    TextureUnits        m_units;
+    bool                m_units_held;
+    const vera::Fbo*    m_feed_target;
+
+    void                _updateBlock();
+    void                _uploadBlock();
+
+    UniformBlock        m_block;            // of the frame
+    UniformBlock        m_block_override;   // of the current pass
+    UniformBlock        m_block_gpu;        // in the buffer
+    GLuint              m_block_buffer;
+    bool                m_block_used;
+    bool                m_block_uploaded;
+    bool                m_block_override_view;
+    bool                m_block_override_resolution;
+
+    std::vector<vera::Shader*> m_bench_shaders;
+    std::atomic<size_t> m_bench_iterations;
+    bool                m_bench_recording;
+
+    // parseLine() only pushes here, so the threads that write never wait on (or race with) the render loop
+    LockFreeQueue<UniformInput> m_inputs;
+
     size_t              m_frame;
     bool                m_play;
     bool                m_colmapFrame = false;
@@ -12,6 +12,9 @@
 #endif
 
 #include <map>
+#include <memory>
+#include <cstdlib>
+#include <algorithm>
 #include <thread>
 #include <mutex>
 #include <atomic>
@@ -34,6 +37,7 @@
 
 #include "core/glslViewer.h"
 #include "core/tools/files.h"
+#include "core/tools/fileWatcher.h"
 #include "core/tools/text.h"
 #include "core/tools/record.h"
 #include "core/tools/console.h"
@@ -60,14 +64,25 @@ int                         textureCounter  = 0;        // number of textures to
 bool                        vFlip           = true;     // texture flip state 
 bool                        bScreensaverMode = false;
 bool                        bRunAtFullFps = false;
+bool                        bOffline = false;           // render sequences as fast as possible
 bool                        bTerminate = false;
 bool                        bStreamsPlaying = true;
+float                       idleMs = -1.0f;             // longest idle wait between window event polls, negative picks one
 
 #if !defined(__EMSCRIPTEN__)
 void                        printUsage(char * executableName);
 void                        onExit();
 #endif
 
+// Slice of frames,<A>,<B> this process renders (--shard i/N)
+int                         shardIndex = 0;
+int                         shardCount = 1;
+bool                        shardInterleaved = false;
+bool                        parseShard(const std::string& _shard, int& _index, int& _count, bool& _interleaved);
+#if !defined(__EMSCRIPTEN__)
+int                         shardsRun(int argc, char **argv, int _count, bool _interleaved);
+#endif
+
 // The sandbox holds:
 //  - the main shader (in 2D)
 //  - the scene (when 3D geometry or vertex shaders are loaded)
@@ -87,6 +102,9 @@ void                        fileWatcherThread();
 // Note: the OSC listener reuse it to process events
 CommandList                 commands;
 std::mutex                  commandsMutex;
+std::shared_ptr<const CommandTable> commandsTableCache;     // rebuilt when commands get added
+std::mutex                  commandsTableMutex;
+std::shared_ptr<const CommandTable> commandsTable();
 std::vector<std::string>    commandsArgs;    // Execute commands
 bool                        commandsExit = false;
 #if defined(SUPPORT_NCURSES)
@@ -96,7 +114,18 @@ bool                        commands_ncurses = false;
 #endif
 void                        commandsRun(const std::string &_cmd);
 void                        commandsRun(const std::string &_cmd, std::mutex &_mutex);
+void                        commandsQueue(const std::string &_cmd);     // from other threads, runs on the next frame
 void                        commandsInit();
+void                        commandsBench(size_t _lines);
+
+// Lines between batch,begin and batch,end, gathered per sending thread (console, OSC...)
+thread_local bool                       commandsBatching = false;
+thread_local std::vector<std::string>   commandsBatch;
+
+#if defined(SUPPORT_LIBAV) && !defined(PLATFORM_RPI)
+// Defaults for the record command (tweaked by record_queue)
+RecordingSettings           recordSettings;
+#endif
 
 void loadFile(std::string path) {
     if ( vera::haveExt(path,"frag") || vera::haveExt(path,"fs")  ) {
@@ -203,8 +232,8 @@ void loadFile(std::string path) {
 
         commandsRun("update");
     }
-    // load CSVs
-    else if (   vera::haveExt(path,"csv") || vera::haveExt(path, "CSV")) {
+    // load CSVs (and their binary .useq version)
+    else if (   vera::haveExt(path,"csv") || vera::haveExt(path, "CSV") || vera::haveExt(path, SEQUENCE_EXT)) {
         std::string filename = vera::getFilename(path);
         filename = filename.substr(0, filename.find_last_of("."));
 
@@ -214,7 +243,7 @@ void loadFile(std::string path) {
                 std::cout << "Sequence " << filename << " added from " << path << std::endl;
         }
         // else, if filename starts with "camera..." we will consider it a camera sequence
-        else if (filename.find("camera") == 0) {
+        else if (filename.find("camera") == 0 && !vera::haveExt(path, SEQUENCE_EXT)) {
             if ( sandbox.uniforms.addCameras(path) )
                 std::cout << "Camera sequence added from " << path << std::endl;
         }
@@ -352,7 +381,6 @@ char* getDefaultSceneVert() {
 // Open Sound Control
 #if defined(SUPPORT_OSC)
 #include <lo/lo_cpp.h>
-std::mutex                  oscMutex;
 #endif
 int                         oscPort = 0;
 // MAIN LOOP
@@ -374,13 +402,20 @@ void loop() {
         commandsArgs.clear();
     }
     #else
-    // If nothing in the scene change skip the frame and try to keep it at 60fps
+    // If nothing in the scene change skip the frame and sleep until something happens (commands, OSC, 
+    // files...). Window events still need polling, so only a headless window without streams waits for good
     if (!bTerminate && !bRunAtFullFps && !sandbox.haveChange()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds( vera::getRestMs() ));
+        float timeout = idleMs;
+        if (timeout < 0.0f)
+            timeout = (vera::getWindowStyle() == vera::HEADLESS && sandbox.uniforms.streams.empty()) ? -1.0f : vera::getRestMs();
+        sandbox.wakeup.wait(timeout);
         return;
     }
     #endif
 
+    // Events that arrived until now get on this frame
+    sandbox.wakeup.frameStart();
+
     // PREP for main render:
     //  - update uniforms
     //  - render buffers, double buffers and pyramid convolutions
@@ -389,6 +424,9 @@ void loop() {
     //  - start the recording FBO (when recording)
     sandbox.renderPrep();
 
+    // Offline sequences are pure fixed time steps, the window is only a context to render into
+    bool offline = bOffline && isRecording();
+
     // Render the main 2D Shader on a billboard or 3D Scene when there is geometry models
     // Note: if the render require multiple views of the render (for quilts or VR) it happens here.
     sandbox.render();
@@ -404,7 +442,8 @@ void loop() {
     //  - draw plot widget (debug)
     //  - draw cursor
     //  - draw help prompt
-    sandbox.renderUI();
+    if (!offline)
+        sandbox.renderUI();
 
     // Finish rendering triggering some events like
     //  - save image/frame if it's needed
@@ -412,16 +451,31 @@ void loop() {
     sandbox.renderDone();
 
 #ifndef __EMSCRIPTEN__
-    if ( bTerminate && sandbox.screenshotFile == "" )
+    // Before the offline throttle, a sequence that just finished can end the app on this frame
+    if ( bTerminate && sandbox.screenshotFile == "" ) {
         bKeepRunnig.store(false);
-    else
+        return;
+    }
+
+    // Offline, skip the swap (and the vsync wait on it) but every now and then
+    // pump the window events so it stays responsive and can still be closed
+    if (offline) {
+        static std::chrono::steady_clock::time_point lastSwap;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now - lastSwap < std::chrono::milliseconds(250))
+            return;
+        lastSwap = now;
+    }
 #endif
-    
+
     // Swap GL buffer
     TRACK_BEGIN("render:swap")
     vera::renderGL();
     TRACK_END("render:swap")
 
+    if (sandbox.wakeup.framePresented() && sandbox.uniforms.tracker.isRunning())
+        sandbox.uniforms.tracker.setCounter("latency:event_ms", sandbox.wakeup.getLatencyMs());
+
     #if defined(__EMSCRIPTEN__)
     return (vera::getXR() == vera::NONE_XR_MODE);
     #endif
@@ -440,6 +494,8 @@ int main(int argc, char **argv) {
     bool haveFragmentShader = false;
     bool haveGeometry = false;
     bool haveTextures = false;
+    int shards = 0;
+    bool shardsInterleaved = false;
 
     for (int i = 1; i < argc ; i++) {
         std::string argument = std::string(argv[i]);
@@ -534,6 +590,15 @@ int main(int argc, char **argv) {
             else
                 std::cout << "Argument '" << argument << "' should be followed by a the OPENGL MINOR version. Skipping argument." << std::endl;
         }
+        else if (   argument == "-shards"       || argument == "--shards" ) {
+            if (++i < argc) {
+                std::vector<std::string> values = vera::split(std::string(argv[i]), ',');
+                shards = values.size() > 0 ? vera::toInt(values[0]) : 0;
+                shardsInterleaved = (values.size() > 1 && values[1] == "interleaved");
+            }
+            else
+                std::cout << "Argument '" << argument << "' should be followed by the number of <workers>. Skipping argument." << std::endl;
+        }
         else if ( vera::haveExt(argument,"vert") || vera::haveExt(argument,"vs") ) {
             haveVertexShader = true;
         }
@@ -578,10 +643,15 @@ int main(int argc, char **argv) {
         printUsage( argv[0] );
         // exit(0);
     }
+
+    // Coordinator: instead of opening a window, run one worker per shard and wait for them
+    if (shards > 1)
+        return shardsRun(argc, argv, shards, shardsInterleaved);
     #endif
 
     // Declare global level commands
     commandsInit();
+    sandbox.commandQueue.exec = [](const std::string& _cmd) { commandsRun(_cmd); };
 
     // Initialize openGL context
     vera::initGL(window_properties);
@@ -645,6 +715,10 @@ int main(int argc, char **argv) {
             bRunAtFullFps = true;
             vera::setFps(0);
         }
+        else if (   argument == "-offline"  || argument == "--offline"      ) {
+            bOffline = true;
+            recordingOffline(true);
+        }
         // add define GCC style
         else if (   argument != "-D"        && argument.find("-D") == 0 ) {
             std::string define = std::string("define,") + argument.substr(2);
@@ -722,6 +796,19 @@ int main(int argc, char **argv) {
         #endif
         }
 
+        else if (   argument == "-shard"    || argument == "--shard" ) {
+            if (++i < argc) {
+                if ( parseShard(std::string(argv[i]), shardIndex, shardCount, shardInterleaved) )
+                    recordingShard(shardIndex, shardCount, shardInterleaved);
+            }
+            else
+                std::cout << "Argument '" << argument << "' should be followed by <index>/<total>. Skipping argument." << std::endl;
+        }
+        // The coordinator already handled it
+        else if (   argument == "-shards"   || argument == "--shards" ) {
+            i++;
+        }
+
         // Excecute COMMANDS
         else if (   argument == "-e" ) {
             if (++i < argc)         
@@ -926,7 +1013,7 @@ int main(int argc, char **argv) {
                     sandbox.uniforms.addStreamingTexture(parameterPair, argument, vFlip, false);
 
                 // Load a sequence of uniform data
-                else if ( vera::haveExt(argument,"csv") || vera::haveExt(argument,"CSV") )
+                else if ( vera::haveExt(argument,"csv") || vera::haveExt(argument,"CSV") || vera::haveExt(argument,SEQUENCE_EXT) )
                     sandbox.uniforms.addSequence(parameterPair, argument);
                 
                 // Else load it as a single texture
@@ -1248,7 +1335,7 @@ int main(int argc, char **argv) {
         if (sandbox.verbose)
             std::cout << line << std::endl;
             
-        commandsRun(line, oscMutex);
+        commandsQueue(line);
     });
 
     if (oscPort > 0) {
@@ -1305,28 +1392,135 @@ void commandsRun(const std::string &_cmd) { commandsRun(_cmd, commandsMutex); }
 void commandsRun(const std::string &_cmd, std::mutex &_mutex) {
     bool resolve = false;
 
-    // Check if _cmd is present in the list of commands
-    for (size_t i = 0; i < commands.size(); i++) {
-        if (vera::beginsWith(_cmd, commands[i].trigger)) {
-            // Do require mutex the thread?
-            if (commands[i].mutex) _mutex.lock();
+    // Only the commands whose trigger begins _cmd, in the order they were added.
+    // Keep the table: a command can add more commands (and rebuild it) while running
+    std::shared_ptr<const CommandTable> table = commandsTable();
+    const std::vector<size_t>& candidates = table->find(_cmd);
+    for (size_t c = 0; c < candidates.size(); c++) {
+        size_t i = candidates[c];
 
-            // Execute de command
-            resolve = commands[i].exec(_cmd);
+        // Do require mutex the thread?
+        bool lock = commands[i].mutex;
+        if (lock) _mutex.lock();
 
-            if (commands[i].mutex) _mutex.unlock();
+        // Execute de command
+        resolve = commands[i].exec(_cmd);
 
-            // If got resolved stop searching
-            if (resolve) break;
-        }
+        if (lock) _mutex.unlock();
+
+        // If got resolved stop searching
+        if (resolve) break;
     }
 
-    // If nothing match maybe the user is trying to define the content of a uniform
-    if (!resolve) {
-        _mutex.lock();
+    // If nothing match maybe the user is trying to define the content of a uniform (lock free, applied on the next frame)
+    if (!resolve)
         sandbox.uniforms.parseLine(_cmd);
-        _mutex.unlock();
+}
+
+std::shared_ptr<const CommandTable> commandsTable() {
+    std::lock_guard<std::mutex> lock(commandsTableMutex);
+    if (!commandsTableCache || commandsTableCache->size() != commands.size())
+        commandsTableCache = std::make_shared<const CommandTable>(commands);
+    return commandsTableCache;
+}
+
+void commandsQueue(const std::string &_cmd) {
+    // Everything between batch,begin and batch,end goes in one piece, so it all applies on the same frame
+    if (_cmd == "batch,begin") {
+        if (commandsBatching)
+            std::cerr << "// Already in a batch, keep adding to it" << std::endl;
+        commandsBatching = true;
+        return;
+    }
+    else if (_cmd == "batch,end" || _cmd == "batch,cancel") {
+        if (!commandsBatching)
+            std::cerr << "// There is no batch to " << _cmd.substr(6) << std::endl;
+        else if (_cmd == "batch,end" && !sandbox.commandQueue.push( std::move(commandsBatch) ))
+            std::cerr << "// Too many commands waiting for a frame, dropped a batch" << std::endl;
+        else
+            sandbox.wakeup.signal();
+        commandsBatching = false;
+        commandsBatch.clear();
+        return;
+    }
+
+    // The longest trigger is the command that will run (record vs record_queue)
+    int match = commandsTable()->longest(_cmd);
+
+    // Commands that wait on the render loop would never return from it, they run here
+    // once everything sent before them is done
+    if (match >= 0 && commands[match].wait) {
+        if (commandsBatching) {
+            std::cerr << "// " << commands[match].trigger << " waits on the render loop, it can't go in a batch" << std::endl;
+            return;
+        }
+
+        while (!sandbox.commandQueue.isIdle() && bKeepRunnig.load())
+            std::this_thread::sleep_for(std::chrono::milliseconds( vera::getRestMs() ));
+        commandsRun(_cmd);
+        return;
     }
+
+    if (commandsBatching) {
+        commandsBatch.push_back(_cmd);
+        return;
+    }
+
+    // Uniform values skip the queue when nothing is waiting in it (they can't pass a command
+    // sent before). They have a lock free queue of their own, applied on the next frame
+    if (match < 0 && sandbox.commandQueue.isIdle() && sandbox.uniforms.parseLine(_cmd)) {
+        sandbox.wakeup.signal();
+        return;
+    }
+
+    if (sandbox.commandQueue.push(_cmd))
+        sandbox.wakeup.signal();
+    else
+        std::cerr << "// Too many commands waiting for a frame, dropped " << _cmd << std::endl;
+}
+
+// Lines per second through each step of a command, without running any: finding the command
+// (scanning the list vs the table) and reading uniform values (split vs in place)
+void commandsBench(size_t _lines) {
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < commands.size(); i++)
+        lines.push_back(commands[i].trigger + ",0");
+    const size_t triggers = lines.size();
+    for (size_t i = 0; i < triggers; i++)
+        lines.push_back("u_bench" + vera::toString((int)i) + "," + vera::toString(i * 0.1f) + ",0.5,1.0");
+
+    std::shared_ptr<const CommandTable> table = commandsTable();
+    size_t found = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < _lines; n++) {
+        const std::string& line = lines[n % lines.size()];
+        for (size_t i = 0; i < commands.size(); i++)
+            if (vera::beginsWith(line, commands[i].trigger))
+                found++;
+    }
+    double scan = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < _lines; n++)
+        found += table->find( lines[n % lines.size()] ).size();
+    double lookup = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    UniformInput input;
+    start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < _lines; n++)
+        found += Uniforms::splitInput( lines[triggers + n % triggers], input );
+    double split = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < _lines; n++)
+        found += Uniforms::parseInput( lines[triggers + n % triggers], input );
+    double inplace = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "// " << _lines << " lines over " << commands.size() << " commands (" << found << " matches), in lines per second" << std::endl;
+    std::cout << "// dispatch by scan, dispatch by table, uniform by split, uniform in place" << std::endl;
+    std::cout << (size_t)(_lines / std::max(scan, 1e-9)) << "," << (size_t)(_lines / std::max(lookup, 1e-9)) << ",";
+    std::cout << (size_t)(_lines / std::max(split, 1e-9)) << "," << (size_t)(_lines / std::max(inplace, 1e-9)) << std::endl;
 }
 
 void commandsInit() {
@@ -1469,9 +1663,18 @@ void commandsInit() {
             commandsMutex.unlock();
             return true;
         }
+        else if (values.size() == 4 || values.size() == 5) {
+            commandsMutex.lock();
+            sandbox.screenshotFile = values[1];
+            sandbox.screenshotWidth = vera::toInt(values[2]);
+            sandbox.screenshotHeight = vera::toInt(values[3]);
+            sandbox.screenshotTiles = (values.size() == 5)? vera::toInt(values[4]) : 0;
+            commandsMutex.unlock();
+            return true;
+        }
         return false;
     },
-    "screenshot[,<filename>]", "saves a screenshot to a filename", false));
+    "screenshot[,<filename>[,<width>,<height>[,<tiles>]]]", "saves a screenshot to a filename, optionally at any resolution rendering <tiles>x<tiles> pieces (PNG or TGA)", false));
 
     commands.push_back(Command("sequence", [&](const std::string& _line){ 
         std::vector<std::string> values = vera::split(_line,',');
@@ -1490,6 +1693,7 @@ void commandsInit() {
             commandsMutex.lock();
             recordingStartSecs(from, to, fps);
             commandsMutex.unlock();
+            sandbox.wakeup.signal();
 
             float pct = 0.0f;
             while (pct < 1.0f) {
@@ -1506,7 +1710,7 @@ void commandsInit() {
         }
         return false;
     },
-    "sequence,<from_sec>,<to_sec>[,<fps>]","save a PNG sequence <from_sec> <to_sec> at <fps> (default: 24)",false));
+    "sequence,<from_sec>,<to_sec>[,<fps>]","save a PNG sequence <from_sec> <to_sec> at <fps> (default: 24)",false, true));
 
     commands.push_back(Command("secs", [&](const std::string& _line){ 
         std::vector<std::string> values = vera::split(_line,',');
@@ -1525,6 +1729,7 @@ void commandsInit() {
             commandsMutex.lock();
             recordingStartSecs(from, to, fps);
             commandsMutex.unlock();
+            sandbox.wakeup.signal();
 
             float pct = 0.0f;
             while (pct < 1.0f) {
@@ -1541,7 +1746,7 @@ void commandsInit() {
         }
         return false;
     },
-    "secs,<A>,<B>[,<fps>]","saves a sequence of images from second A to second B at <fps> (default: 24)", false));
+    "secs,<A>,<B>[,<fps>]","saves a sequence of images from second A to second B at <fps> (default: 24)", false, true));
 
     commands.push_back(Command("frames", [&](const std::string& _line){ 
         std::vector<std::string> values = vera::split(_line,',');
@@ -1550,15 +1755,31 @@ void commandsInit() {
             int to = vera::toInt(values[2]);
             float fps = 24.0;
 
-            if (values.size() == 4)
-                fps = vera::toFloat(values[3]);
+            // by default the slice given by --shard, unless the command brings its own
+            int index = shardIndex;
+            int count = shardCount;
+            bool interleaved = shardInterleaved;
+            for (size_t i = 3; i < values.size(); i++) {
+                if (vera::beginsWith(values[i], "shard=")) {
+                    if ( !parseShard(values[i].substr(6), index, count, interleaved) )
+                        return false;
+                }
+                else if (values[i] == "interleaved")
+                    interleaved = true;
+                else if (values[i] == "contiguous")
+                    interleaved = false;
+                else
+                    fps = vera::toFloat(values[i]);
+            }
 
             if (from >= to)
                 from = 0.0;
 
             commandsMutex.lock();
+            recordingShard(index, count, interleaved);
             recordingStartFrames(from, to, fps);
             commandsMutex.unlock();
+            sandbox.wakeup.signal();
 
             float pct = 0.0f;
             while (pct < 1.0f) {
@@ -1576,13 +1797,13 @@ void commandsInit() {
         }
         return false;
     },
-    "frames,<A>,<B>[,<fps>]","saves a sequence of images from frame <A> to <B> at <fps> (default: 24)", false));
+    "frames,<A>,<B>[,<fps>][,shard=<i>/<N>[,interleaved]]","saves a sequence of images from frame <A> to <B> at <fps> (default: 24), optionally only the <i> slice out of <N>", false, true));
 
     #if defined(SUPPORT_LIBAV) && !defined(PLATFORM_RPI)
     commands.push_back(Command("record", [&](const std::string& _line){ 
         std::vector<std::string> values = vera::split(_line,',');
         if (values.size() >= 3) {
-            RecordingSettings settings;
+            RecordingSettings settings = recordSettings;
             settings.src_width = vera::getWindowWidth();
             settings.src_height = vera::getWindowHeight();
             settings.src_fps = vera::getFps();
@@ -1647,6 +1868,7 @@ void commandsInit() {
                 commandsMutex.lock();
                 recordingPipeOpen(settings, from, to);
                 commandsMutex.unlock();
+                sandbox.wakeup.signal();
 
                 float pct = 0.0f;
                 while (pct < 1.0f) {
@@ -1663,7 +1885,74 @@ void commandsInit() {
         }
         return false;
     },
-    "record,<file>,<A>,<B>[,<fps>]","record a video from second <A> to second <B> at <fps> (default: 24.0f)", false));
+    "record,<file>,<A>,<B>[,<fps>]","record a video from second <A> to second <B> at <fps> (default: 24.0f)", false, true));
+
+    commands.push_back(Command("record_backend", [&](const std::string& _line){ 
+        std::vector<std::string> values = vera::split(_line,',');
+        if (_line == "record_backend") {
+            std::cout << recording_backend_options[recordSettings.backend] << std::endl;
+            return true;
+        }
+        else if (values.size() == 2) {
+            for (size_t i = 0; i < 2; i++) {
+                if (values[1] == recording_backend_options[i]) {
+                    recordSettings.backend = RecordingBackend(i);
+                    return true;
+                }
+            }
+        }
+        return false;
+    },
+    "record_backend[,libav|ffmpeg]","encode videos through an ffmpeg pipe or in-process with libav (default: ffmpeg, GIFs always use ffmpeg)", false));
+
+    commands.push_back(Command("record_format", [&](const std::string& _line){ 
+        std::vector<std::string> values = vera::split(_line,',');
+        if (_line == "record_format") {
+            std::cout << pix_fmt_options[recordSettings.src_pix_fmt] << std::endl;
+            return true;
+        }
+        else if (values.size() == 2) {
+            for (size_t i = 0; i < 3; i++) {
+                if (values[1] == pix_fmt_options[i]) {
+                    recordSettings.src_pix_fmt = RecordingPixelFormat(i);
+                    return true;
+                }
+            }
+        }
+        return false;
+    },
+    "record_format[,rgb24|yuv420p|nv12]","pixel format of the frames sent to ffmpeg. YUV ones are converted on the GPU (default: rgb24)", false));
+
+    commands.push_back(Command("record_queue", [&](const std::string& _line){ 
+        std::vector<std::string> values = vera::split(_line,',');
+        if (_line == "record_queue") {
+            RecordingQueueStats stats = getRecordingQueueStats();
+            std::cout << "capacity," << stats.capacity << std::endl;
+            std::cout << "policy," << frame_policy_options[recordSettings.queue_policy] << std::endl;
+            std::cout << "depth," << stats.depth << std::endl;
+            std::cout << "max_depth," << stats.maxDepth << std::endl;
+            std::cout << "stalls," << stats.stalls << std::endl;
+            std::cout << "stall_secs," << stats.stallSecs << std::endl;
+            std::cout << "dropped," << stats.dropped << std::endl;
+            std::cout << "duplicated," << stats.duplicated << std::endl;
+            std::cout << "written," << stats.written << std::endl;
+            return true;
+        }
+        else if (values.size() >= 2) {
+            int capacity = vera::toInt(values[1]);
+            if (capacity > 0)
+                recordSettings.queue_capacity = capacity;
+
+            if (values.size() > 2) {
+                for (size_t i = 0; i < 3; i++)
+                    if (values[2] == frame_policy_options[i])
+                        recordSettings.queue_policy = FramePolicy(i);
+            }
+            return true;
+        }
+        return false;
+    },
+    "record_queue[,<frames>[,block|drop|duplicate]]","return the stats of the video recording queue, or set its capacity and what to do when it's full (default: 8,block)", false));
     #endif
 
     // General environment commands
@@ -1687,6 +1976,62 @@ void commandsInit() {
     },
     "fullFps[,on|off]", "go to full FPS or not", false));
 
+    commands.push_back(Command("idle", [&](const std::string& _line){
+        if (_line == "idle") {
+            if (idleMs < 0.0f)
+                std::cout << "auto" << std::endl;
+            else
+                std::cout << idleMs << std::endl;
+            return true;
+        }
+        else {
+            std::vector<std::string> values = vera::split(_line,',');
+            if (values.size() == 2) {
+                idleMs = (values[1] == "auto") ? -1.0f : std::max(0.0f, vera::toFloat(values[1]));
+                return true;
+            }
+        }
+        return false;
+    },
+    "idle[,<ms>|auto]", "longest time an idle window sleeps before polling its events again (auto: the frame rest time, or until something happens when headless)", false));
+
+    commands.push_back(Command("latency", [&](const std::string& _line){
+        if (_line == "latency") {
+            std::cout << "last," << sandbox.wakeup.getLatencyMs() << "ms" << std::endl;
+            std::cout << "average," << sandbox.wakeup.getLatencyAverageMs() << "ms" << std::endl;
+            std::cout << "max," << sandbox.wakeup.getLatencyMaxMs() << "ms" << std::endl;
+            std::cout << "events," << sandbox.wakeup.getEvents() << std::endl;
+            std::cout << "wakeups," << sandbox.wakeup.getWakeups() << std::endl;
+            return true;
+        }
+        else if (_line == "latency,reset") {
+            sandbox.wakeup.resetStats();
+            return true;
+        }
+        return false;
+    },
+    "latency[,reset]", "time from an event (command, OSC message, file change) to the frame that shows it on screen", false));
+
+    commands.push_back(Command("offline", [&](const std::string& _line){
+        if (_line == "offline") {
+            std::string rta = bOffline ? "on" : "off";
+            std::cout <<  rta << std::endl; 
+            return true;
+        }
+        else {
+            std::vector<std::string> values = vera::split(_line,',');
+            if (values.size() == 2) {
+                commandsMutex.lock();
+                bOffline = (values[1] == "on");
+                recordingOffline(bOffline);
+                commandsMutex.unlock();
+                return true;
+            }
+        }
+        return false;
+    },
+    "offline[,on|off]", "render secs/frames/sequence/record as fast as possible, skipping vsync, swaps and UI", false));
+
     commands.push_back(Command("fps", [&](const std::string& _line){
         std::vector<std::string> values = vera::split(_line,',');
         if (values.size() == 2) {
@@ -2104,7 +2449,42 @@ void commandsInit() {
         }
         return false;
     },
-    "wait,<seconds>", "wait for X <seconds> before excecuting another command", false));
+    "wait,<seconds>", "wait for X <seconds> before excecuting another command", false, true));
+
+    commands.push_back(Command("commands_queue", [&](const std::string& _line){ 
+        std::vector<std::string> values = vera::split(_line,',');
+        if (_line == "commands_queue") {
+            std::cout << "budget," << sandbox.commandQueue.getBudget() << "ms" << std::endl;
+            std::cout << "pending," << sandbox.commandQueue.size() << std::endl;
+            std::cout << "executed," << sandbox.commandQueue.getExecuted() << std::endl;
+            std::cout << "batches," << sandbox.commandQueue.getBatches() << std::endl;
+            std::cout << "dropped," << sandbox.commandQueue.getDropped() << std::endl;
+            std::cout << "deferred_frames," << sandbox.commandQueue.getDeferred() << std::endl;
+            std::cout << "latency_avg," << sandbox.commandQueue.getLatencyAverageMs() << "ms" << std::endl;
+            std::cout << "latency_max," << sandbox.commandQueue.getLatencyMaxMs() << "ms" << std::endl;
+            return true;
+        }
+        else if (values.size() == 3 && values[1] == "budget") {
+            sandbox.commandQueue.setBudget( vera::toFloat(values[2]) );
+            return true;
+        }
+        else if (_line == "commands_queue,reset") {
+            sandbox.commandQueue.resetStats();
+            return true;
+        }
+        else if (values.size() >= 2 && values[1] == "bench") {
+            commandsBench( (values.size() > 2) ? std::max(1, vera::toInt(values[2])) : 100000 );
+            return true;
+        }
+        return false;
+    },
+    "commands_queue[,budget,<ms>|reset|bench[,<lines>]]", "stats of the commands waiting for the render loop, the time per frame spent running them (0 no limit) or how many lines per second can be dispatched", false));
+
+    commands.push_back(Command("batch", [&](const std::string& _line){ 
+        // Gathered before they get queued (see commandsQueue()), run directly there is nothing to hold
+        return _line == "batch,begin" || _line == "batch,end" || _line == "batch,cancel";
+    },
+    "batch,begin|end|cancel", "commands sent between begin and end are applied together on the same frame", false));
 
     // ACTIONS commands
     //
@@ -2169,6 +2549,32 @@ void commandsInit() {
     "q", "close glslViewer", false));
 }
 
+// Parses "<i>/<N>[,interleaved]"
+bool parseShard(const std::string& _shard, int& _index, int& _count, bool& _interleaved) {
+    std::vector<std::string> values = vera::split(_shard, ',');
+    std::vector<std::string> slice;
+    if (values.size() > 0)
+        slice = vera::split(values[0], '/');
+
+    if (slice.size() != 2 || !vera::isInt(slice[0]) || !vera::isInt(slice[1])) {
+        std::cerr << "Shard should look like <index>/<total>, not " << _shard << std::endl;
+        return false;
+    }
+
+    int index = vera::toInt(slice[0]);
+    int count = vera::toInt(slice[1]);
+    if (count < 1 || index < 0 || index >= count) {
+        std::cerr << "Shard index should be between 0 and " << (count - 1) << std::endl;
+        return false;
+    }
+
+    _index = index;
+    _count = count;
+    if (values.size() > 1)
+        _interleaved = (values[1] == "interleaved");
+    return true;
+}
+
 #ifndef __EMSCRIPTEN__
 
 void printUsage(char * executableName) {
@@ -2208,6 +2614,9 @@ void printUsage(char * executableName) {
     std::cerr << "      --noncurses                 # disable ncurses command interface" << std::endl;
     std::cerr << "      --fps <fps>                 # fix the max FPS" << std::endl;
     std::cerr << "      --fxaa                      # set FXAA as postprocess filter" << std::endl;
+    std::cerr << "      --offline                   # render sequences as fast as possible instead of in real time" << std::endl;
+    std::cerr << "      --shard <i>/<N>[,interleaved]   # render only the <i> slice of <N> of the frames command (contiguous by default)" << std::endl;
+    std::cerr << "      --shards <N>[,interleaved]  # spawn <N> local glslViewer workers, one per shard, and report the aggregated throughput" << std::endl;
     std::cerr << "      --quilt <0-15>              # quilt render (HoloPlay)" << std::endl;
     std::cerr << "      --quilt_tile <N>            # render a particular tile of a quilt (HoloPlay)" << std::endl;
     std::cerr << "      --lenticular <visual.json>  # lenticular calibration file, Looking Glass Model (HoloPlay)" << std::endl;
@@ -2220,8 +2629,79 @@ void printUsage(char * executableName) {
     std::cerr << "      --help                      # print help for one or all command" << std::endl;
 }
 
+std::string shellQuote(const std::string& _arg) {
+    #if defined(PLATFORM_WINDOWS)
+    return "\"" + _arg + "\"";
+    #else
+    std::string rta = "'";
+    for (size_t i = 0; i < _arg.size(); i++)
+        rta += (_arg[i] == '\'') ? std::string("'\\''") : std::string(1, _arg[i]);
+    return rta + "'";
+    #endif
+}
+
+// Runs _count copies of this same command line, each with its own --shard, and waits for all of them
+int shardsRun(int argc, char **argv, int _count, bool _interleaved) {
+    std::string cmd = shellQuote(argv[0]);
+    int frames = 0;
+    bool exits = false;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = std::string(argv[i]);
+        if (argument == "-shards" || argument == "--shards") {
+            i++;
+            continue;
+        }
+
+        // the frames to render, only to report the throughput
+        if ((argument == "-e" || argument == "-E") && i + 1 < argc) {
+            exits = exits || (argument == "-E");
+            std::vector<std::string> values = vera::split(std::string(argv[i+1]), ',');
+            if (values.size() >= 3 && values[0] == "frames")
+                frames += std::max(0, vera::toInt(values[2]) - vera::toInt(values[1]));
+        }
+
+        cmd += " " + shellQuote(argument);
+    }
+
+    if (!exits)
+        std::cout << "Without a -E command the workers will keep running after rendering their frames" << std::endl;
+
+    std::cout << "Rendering on " << _count << " " << (_interleaved ? "interleaved" : "contiguous") << " shards" << std::endl;
+
+    std::atomic<int> failed(0);
+    std::vector<std::thread> workers;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < _count; i++) {
+        std::string worker = cmd + " --noncurses --shard " + vera::toString(i) + "/" + vera::toString(_count);
+        if (_interleaved)
+            worker += ",interleaved";
+
+        workers.push_back( std::thread([worker, i, &failed](){
+            if (std::system(worker.c_str()) != 0) {
+                std::cerr << "Shard " << i << " failed" << std::endl;
+                failed++;
+            }
+        }) );
+    }
+
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << _count << " shards finished in " << secs << " secs";
+    if (frames > 0 && secs > 0.0)
+        std::cout << ", " << frames << " frames (" << (frames / secs) << " fps)";
+    std::cout << std::endl;
+
+    return failed.load() > 0 ? 1 : 0;
+}
+
 void onExit() {
 
+    // The last frames of an interrupted recording are still on their way back from the GPU
+    if (isRecording())
+        sandbox.onRecordingEnd();
+
     #if defined(SUPPORT_LIBAV) && !defined(PLATFORM_RPI)
     recordingPipeClose();
     #endif
@@ -2243,28 +2723,24 @@ void onExit() {
 //  Watching Thread
 //============================================================================
 void fileWatcherThread() {
-    struct stat st;
+    // inotify on Linux, polling stat() elsewhere. Only files whose content changed come back
+    FileWatcher watcher;
+    if (sandbox.verbose)
+        std::cout << "// Watching files " << (watcher.isNotified() ? "with inotify" : "by polling them") << std::endl;
+
     while ( bKeepRunnig.load() ) {
-        for (size_t i = 0; i < files.size(); i++) {
-            // IMPORTANT: check stat()'s return value. On failure (e.g. a shader
-            // #include dependency whose path can't be stat'd) `st` is left
-            // untouched, retaining the PREVIOUS file's mtime -- which then reads
-            // as a "change" on every poll, firing onFileChange()/resetShaders()
-            // twice a second. That spurious reset calls console_clear(), which
-            // wipes the command line being typed in the ncurses console. Skip
-            // files we can't stat instead of acting on stale data.
-            if ( stat( files[i].path.c_str(), &st ) != 0 )
-                continue;
-
-            int date = st.st_mtime;
-            if ( date != files[i].lastChange ) {
-                filesMutex.lock();
-                files[i].lastChange = date;
-                sandbox.onFileChange( files, i );
-                filesMutex.unlock();
+        std::vector<std::string> changed = watcher.update(files, filesMutex, 500);
+        for (size_t c = 0; c < changed.size(); c++) {
+            // onFileChange() can rebuild the list (shader dependencies), so look the index up every time
+            filesMutex.lock();
+            for (size_t i = 0; i < files.size(); i++) {
+                if (files[i].path == changed[c]) {
+                    sandbox.onFileChange( files, i );
+                    break;
+                }
             }
+            filesMutex.unlock();
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds( 500 ));
     }
 }
 
@@ -2288,18 +2764,16 @@ void cinWatcherThread() {
     // Argument commands to execute comming from -e or -E
     if (commandsArgs.size() > 0) {
         for (size_t i = 0; i < commandsArgs.size(); i++) {
-            commandsRun(commandsArgs[i]);
+            commandsQueue(commandsArgs[i]);
             #if defined(SUPPORT_NCURSES)
             console_refresh();
             #endif
         }
         commandsArgs.clear();
 
-        // If it's using -E exit after executing all commands
-        if (commandsExit) {
-            bTerminate = true;
-            // bKeepRunnig.store(false);
-        }
+        // If it's using -E exit after executing all commands (queued behind them)
+        if (commandsExit)
+            commandsQueue("exit");
     }
 
     #if defined(SUPPORT_NCURSES)
@@ -2308,7 +2782,7 @@ void cinWatcherThread() {
             std::string cmd;
             if (console_getline(cmd, commands, sandbox))
                 if (cmd.size() > 0)
-                    commandsRun(cmd);
+                    commandsQueue(cmd);
         }
         console_end();
     } else
@@ -2318,7 +2792,7 @@ void cinWatcherThread() {
         std::string cmd;
         std::cout << "// > ";
         while (std::getline(std::cin, cmd)) {
-            commandsRun(cmd);
+            commandsQueue(cmd);
             std::cout << "// > ";
         }
     }